@@ -0,0 +1,599 @@
+#ifndef PROJECT_ARROW_C_H
+#define PROJECT_ARROW_C_H
+
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "common.h"
+
+
+/**
+ * Batches in and out through the Arrow C data interface
+ * (https://arrow.apache.org/docs/format/CDataInterface.html), so the engine
+ * can hand results to an Arrow consumer and scan Arrow record batches
+ * without a serialization step.
+ *
+ * A batch is exported as a struct array with one child per column:
+ *
+ *   int32 columns   "i", the values and the validity bitmap are shared (our
+ *                   bitmap already is an LSB-first Arrow bitmap)
+ *   string columns  "vu" (utf8 view), whose 16-byte views match DbString for
+ *                   strings up to 12 bytes; the long ones get (buffer,
+ *                   offset) instead of a pointer, with the chunks of the
+ *                   StringHeap as the data buffers
+ *
+ * Only the string views are rewritten. A batch with a selection vector is
+ * compacted first, since Arrow has no selection vectors.
+ */
+
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+    void (*release)(struct ArrowSchema*);
+    void *private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+    void (*release)(struct ArrowArray*);
+    void *private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+    int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema *out);
+    int (*get_next)(struct ArrowArrayStream*, struct ArrowArray *out);
+    const char* (*get_last_error)(struct ArrowArrayStream*);
+    void (*release)(struct ArrowArrayStream*);
+    void *private_data;
+};
+
+#endif  // ARROW_C_STREAM_INTERFACE
+
+
+/**
+ * The private data of an exported array. Every array, the children
+ * included, holds a reference to the batch, so a consumer may move a child
+ * out and release it on its own.
+ */
+struct ArrowExportedArray {
+    std::shared_ptr<BatchResult> batch;
+    std::vector<const void*> buffers;
+    std::vector<std::vector<uint64_t>> owned;
+    std::vector<ArrowArray> children;
+    std::vector<ArrowArray*> child_ptrs;
+};
+
+
+struct ArrowExportedSchema {
+    std::string format;
+    std::string name;
+    std::vector<ArrowSchema> children;
+    std::vector<ArrowSchema*> child_ptrs;
+};
+
+
+inline void releaseExportedArray(ArrowArray *array) {
+    auto priv = static_cast<ArrowExportedArray*>(array->private_data);
+    for (auto child : priv->child_ptrs) {
+        if (child->release != nullptr)
+            child->release(child);
+    }
+    delete priv;
+    array->release = nullptr;
+}
+
+
+inline void releaseExportedSchema(ArrowSchema *schema) {
+    auto priv = static_cast<ArrowExportedSchema*>(schema->private_data);
+    for (auto child : priv->child_ptrs) {
+        if (child->release != nullptr)
+            child->release(child);
+    }
+    delete priv;
+    schema->release = nullptr;
+}
+
+
+inline int64_t countNulls(const uint64_t *validity, uint32_t n) {
+    if (validity == nullptr)
+        return 0;
+    int64_t valid = 0;
+    for (uint32_t w = 0; w < n / 64; w++)
+        valid += __builtin_popcountll(validity[w]);
+    if (n % 64 != 0)
+        valid += __builtin_popcountll(validity[n / 64] & ((1ull << (n % 64)) - 1));
+    return n - valid;
+}
+
+
+inline void fillArray(ArrowArray *out, ArrowExportedArray *priv, uint32_t n, int64_t null_count) {
+    out->length = n;
+    out->null_count = null_count;
+    out->offset = 0;
+    out->n_buffers = (int64_t) priv->buffers.size();
+    out->n_children = (int64_t) priv->children.size();
+    out->buffers = priv->buffers.data();
+    for (auto& child : priv->children)
+        priv->child_ptrs.push_back(&child);
+    out->children = priv->child_ptrs.empty() ? nullptr : priv->child_ptrs.data();
+    out->dictionary = nullptr;
+    out->release = &releaseExportedArray;
+    out->private_data = priv;
+}
+
+
+inline void fillSchema(ArrowSchema *out, ArrowExportedSchema *priv, int64_t flags) {
+    out->format = priv->format.c_str();
+    out->name = priv->name.c_str();
+    out->metadata = nullptr;
+    out->flags = flags;
+    out->n_children = (int64_t) priv->children.size();
+    for (auto& child : priv->children)
+        priv->child_ptrs.push_back(&child);
+    out->children = priv->child_ptrs.empty() ? nullptr : priv->child_ptrs.data();
+    out->dictionary = nullptr;
+    out->release = &releaseExportedSchema;
+    out->private_data = priv;
+}
+
+
+/**
+ * The validity of vec as a new bitmap for the rows of sel (or all n rows).
+ */
+inline void exportValidity(const uint64_t *validity, uint32_t n, const DbVector<uint32_t> *sel,
+                           ArrowExportedArray *priv) {
+    if (validity == nullptr) {
+        priv->buffers.push_back(nullptr);
+        return;
+    }
+    if (sel == nullptr) {
+        priv->buffers.push_back(validity);
+        return;
+    }
+    uint64_t *gathered = validity_gather(n, validity, sel->col);
+    priv->owned.emplace_back(gathered, gathered + validityWords(n));
+    delete[] gathered;
+    priv->buffers.push_back(priv->owned.back().data());
+}
+
+
+inline void exportInt32(const std::shared_ptr<BatchResult>& batch, DbVector<int32_t> *vec, ArrowArray *out) {
+    const DbVector<uint32_t> *sel = batch->res_sel;
+    uint32_t n = sel == nullptr ? vec->n : sel->n;
+    auto priv = new ArrowExportedArray();
+    priv->batch = batch;
+    exportValidity(vec->validity, n, sel, priv);
+
+    if (sel == nullptr) {
+        priv->buffers.push_back(vec->col);
+    }
+    else {
+        priv->owned.emplace_back((n + 1) / 2);
+        auto values = reinterpret_cast<int32_t*>(priv->owned.back().data());
+        for (uint32_t i = 0; i < n; i++)
+            values[i] = vec->col[sel->col[i]];
+        priv->buffers.push_back(values);
+    }
+
+    const uint64_t *validity = static_cast<const uint64_t*>(priv->buffers[0]);
+    fillArray(out, priv, n, countNulls(validity, n));
+}
+
+
+inline void exportString(const std::shared_ptr<BatchResult>& batch, DbVector<DbString> *vec, ArrowArray *out) {
+    const DbVector<uint32_t> *sel = batch->res_sel;
+    uint32_t n = sel == nullptr ? vec->n : sel->n;
+    auto priv = new ArrowExportedArray();
+    priv->batch = batch;
+    exportValidity(vec->validity, n, sel, priv);
+
+    const StringHeap *heap = batch->heap;
+    uint32_t num_of_chunks = heap == nullptr ? 0 : heap->getNumOfChunks();
+
+    // long strings outside the heap are copied behind the chunks
+    std::vector<char> extra{};
+    priv->owned.emplace_back(2 * (size_t) n);
+    auto views = reinterpret_cast<char*>(priv->owned.back().data());
+    uint32_t chunk = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const DbString& s = vec->col[sel == nullptr ? i : sel->col[i]];
+        char *view = views + 16 * (size_t) i;
+        memset(view, 0, 16);
+        memcpy(view, &s.len, sizeof(s.len));
+        if (s.len <= DbString::INLINE_LEN) {
+            memcpy(view + 4, s.prefix, s.len);
+            continue;
+        }
+
+        memcpy(view + 4, s.prefix, sizeof(s.prefix));
+        uint32_t buffer_index;
+        uint32_t offset;
+        if (heap != nullptr && heap->find(s.ptr, &chunk, &offset)) {
+            buffer_index = chunk;
+        }
+        else {
+            buffer_index = num_of_chunks;
+            offset = (uint32_t) extra.size();
+            extra.insert(extra.end(), s.ptr, s.ptr + s.len);
+        }
+        memcpy(view + 8, &buffer_index, sizeof(buffer_index));
+        memcpy(view + 12, &offset, sizeof(offset));
+    }
+    priv->buffers.push_back(views);
+
+    std::vector<int64_t> sizes{};
+    for (uint32_t c = 0; c < num_of_chunks; c++) {
+        priv->buffers.push_back(heap->getChunk(c));
+        sizes.push_back((int64_t) heap->getChunkSize(c));
+    }
+    if (!extra.empty()) {
+        priv->owned.emplace_back((extra.size() + 7) / 8);
+        memcpy(priv->owned.back().data(), extra.data(), extra.size());
+        priv->buffers.push_back(priv->owned.back().data());
+        sizes.push_back((int64_t) extra.size());
+    }
+    priv->owned.emplace_back(sizes.size());
+    memcpy(priv->owned.back().data(), sizes.data(), sizes.size() * sizeof(int64_t));
+    priv->buffers.push_back(priv->owned.back().data());
+
+    const uint64_t *validity = static_cast<const uint64_t*>(priv->buffers[0]);
+    fillArray(out, priv, n, countNulls(validity, n));
+}
+
+
+/**
+ * The schema of the batches br is an example of.
+ */
+inline void exportSchema(BatchResult *br, ArrowSchema *out) {
+    auto priv = new ArrowExportedSchema();
+    priv->format = "+s";
+    priv->children.resize(br->data.size() + br->str_data.size());
+
+    uint32_t i = 0;
+    auto add_child = [&](const std::string& name, const char *format) {
+        auto child = new ArrowExportedSchema();
+        child->format = format;
+        child->name = name;
+        fillSchema(&priv->children[i++], child, ARROW_FLAG_NULLABLE);
+    };
+    for (const auto& elem : br->data)
+        add_child(elem.first, "i");
+    for (const auto& elem : br->str_data)
+        add_child(elem.first, "vu");
+
+    fillSchema(out, priv, 0);
+}
+
+
+/**
+ * Export br as a struct array. Takes ownership of br, which is deleted when
+ * the consumer has released the array and all of its children.
+ */
+inline void exportBatch(BatchResult *br, ArrowArray *out) {
+    std::shared_ptr<BatchResult> batch(br);
+    auto priv = new ArrowExportedArray();
+    priv->batch = batch;
+    priv->buffers.push_back(nullptr);
+    priv->children.resize(br->data.size() + br->str_data.size());
+
+    uint32_t i = 0;
+    for (const auto& elem : br->data)
+        exportInt32(batch, elem.second, &priv->children[i++]);
+    for (const auto& elem : br->str_data)
+        exportString(batch, elem.second, &priv->children[i++]);
+
+    uint32_t n = br->res_sel != nullptr ? br->res_sel->n : (i == 0 ? 0 : br->getn());
+    fillArray(out, priv, n, 0);
+}
+
+
+/**
+ * A stream over the batches of an operator.
+ */
+struct ArrowExportedStream {
+    BaseOperator *op;
+    BatchResult *first;
+    bool done;
+    std::string error;
+};
+
+
+inline int exportedStreamGetSchema(ArrowArrayStream *stream, ArrowSchema *out) {
+    auto priv = static_cast<ArrowExportedStream*>(stream->private_data);
+    try {
+        // the schema comes from the first batch, which is kept for get_next
+        if (priv->first == nullptr && !priv->done) {
+            priv->first = priv->op->next();
+            priv->done = priv->first == nullptr;
+        }
+        if (priv->first == nullptr) {
+            priv->error = "Empty stream has no schema";
+            return EINVAL;
+        }
+        exportSchema(priv->first, out);
+        return 0;
+    }
+    catch (const std::exception& e) {
+        priv->error = e.what();
+        return EIO;
+    }
+}
+
+
+inline int exportedStreamGetNext(ArrowArrayStream *stream, ArrowArray *out) {
+    auto priv = static_cast<ArrowExportedStream*>(stream->private_data);
+    try {
+        BatchResult *br = priv->first;
+        priv->first = nullptr;
+        if (br == nullptr && !priv->done)
+            br = priv->op->next();
+        if (br == nullptr) {
+            priv->done = true;
+            out->release = nullptr;
+            return 0;
+        }
+        exportBatch(br, out);
+        return 0;
+    }
+    catch (const std::exception& e) {
+        priv->error = e.what();
+        return EIO;
+    }
+}
+
+
+inline const char* exportedStreamGetLastError(ArrowArrayStream *stream) {
+    auto priv = static_cast<ArrowExportedStream*>(stream->private_data);
+    return priv->error.empty() ? nullptr : priv->error.c_str();
+}
+
+
+inline void releaseExportedStream(ArrowArrayStream *stream) {
+    auto priv = static_cast<ArrowExportedStream*>(stream->private_data);
+    delete priv->first;
+    priv->op->close();
+    delete priv->op;
+    delete priv;
+    stream->release = nullptr;
+}
+
+
+/**
+ * Export the batches of op as a stream. Takes ownership of op and opens it;
+ * it is closed and deleted with the stream. The batches must stay valid
+ * after the following next() (no recycling scans below op).
+ */
+inline void exportStream(BaseOperator *op, ArrowArrayStream *out) {
+    op->open();
+    out->get_schema = &exportedStreamGetSchema;
+    out->get_next = &exportedStreamGetNext;
+    out->get_last_error = &exportedStreamGetLastError;
+    out->release = &releaseExportedStream;
+    out->private_data = new ArrowExportedStream{op, nullptr, false, ""};
+}
+
+
+/**
+ * n bits of an Arrow bitmap starting at bit offset as a new bitmap, or
+ * nullptr if there is none.
+ */
+inline uint64_t* importValidity(const void *buffer, uint64_t offset, uint32_t n) {
+    if (buffer == nullptr)
+        return nullptr;
+
+    auto bytes = static_cast<const uint8_t*>(buffer);
+    auto res = new uint64_t[validityWords(n)];
+    memset(res, 0, sizeof(uint64_t) * validityWords(n));
+    if (offset % 8 == 0) {
+        memcpy(res, bytes + offset / 8, (n + 7) / 8);
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++) {
+            uint64_t bit = offset + i;
+            res[i >> 6] |= (uint64_t) ((bytes[bit >> 3] >> (bit & 7)) & 1) << (i & 63);
+        }
+    }
+    return res;
+}
+
+
+#define ARROW_COL_INT32     1
+#define ARROW_COL_UTF8      2
+#define ARROW_COL_VIEW      3
+
+
+/**
+ * Scans the record batches of an Arrow stream (struct arrays of int32 or
+ * date32, utf8 and utf8 view columns), vector_size rows at a time.
+ *
+ * int32 values are not copied, the vectors point into the Arrow buffers; the
+ * bitmaps are realigned, and strings get DbString headers that point into
+ * the Arrow data. A batch is valid until the following next(), which may
+ * release the record batch it came from.
+ */
+class ArrowScanOperator : public BaseOperator {
+private:
+    ArrowArrayStream stream_;
+    uint32_t vector_size_;
+    std::vector<std::string> names_;
+    std::vector<int> types_;
+    ArrowArray array_;
+    uint64_t row_;
+
+    void check_(int rc) {
+        if (rc != 0) {
+            const char *error = stream_.get_last_error(&stream_);
+            throw std::runtime_error(std::string("Arrow stream failed: ") + (error == nullptr ? "" : error));
+        }
+    }
+
+    void releaseArray_() {
+        if (array_.release != nullptr)
+            array_.release(&array_);
+        array_.release = nullptr;
+    }
+
+public:
+    /**
+     * Takes ownership of stream (it is moved, as the interface prescribes).
+     */
+    explicit ArrowScanOperator(ArrowArrayStream *stream, uint32_t vector_size = DEFAULT_VECTOR_SIZE) :
+            stream_(*stream), vector_size_(vector_size), row_(0) {
+        stream->release = nullptr;
+        array_.release = nullptr;
+    }
+
+    ~ArrowScanOperator() final {
+        releaseArray_();
+        if (stream_.release != nullptr)
+            stream_.release(&stream_);
+    }
+
+    void open() final {
+        ArrowSchema schema;
+        check_(stream_.get_schema(&stream_, &schema));
+
+        names_.clear();
+        types_.clear();
+        std::string error{};
+        if (strcmp(schema.format, "+s") != 0)
+            error = std::string("Unsupported Arrow format ") + schema.format;
+        for (int64_t i = 0; i < schema.n_children && error.empty(); i++) {
+            const ArrowSchema *child = schema.children[i];
+            std::string format = child->format;
+            if (format == "i" || format == "tdD")
+                types_.push_back(ARROW_COL_INT32);
+            else if (format == "u")
+                types_.push_back(ARROW_COL_UTF8);
+            else if (format == "vu")
+                types_.push_back(ARROW_COL_VIEW);
+            else
+                error = "Unsupported Arrow format " + format;
+            names_.emplace_back(child->name == nullptr ? "" : child->name);
+        }
+        schema.release(&schema);
+        if (!error.empty())
+            throw std::invalid_argument(error);
+
+        releaseArray_();
+        row_ = 0;
+    }
+
+    void close() final {
+        releaseArray_();
+    }
+
+    bool reusesBatches() const final {
+        return true;
+    }
+
+    BatchResult* next() final {
+        while (array_.release == nullptr || row_ >= (uint64_t) array_.length) {
+            releaseArray_();
+            check_(stream_.get_next(&stream_, &array_));
+            if (array_.release == nullptr)
+                return nullptr;
+            bool struct_nulls = array_.n_buffers > 0 && array_.buffers[0] != nullptr && array_.null_count != 0;
+            if (struct_nulls || array_.n_children != (int64_t) names_.size())
+                throw std::invalid_argument("Unsupported Arrow record batch");
+            row_ = 0;
+        }
+
+        auto n = (uint32_t) std::min<uint64_t>(vector_size_, (uint64_t) array_.length - row_);
+        BatchResult *br = new BatchResult();
+        for (uint32_t c = 0; c < names_.size(); c++) {
+            const ArrowArray *child = array_.children[c];
+            uint64_t first = (uint64_t) (array_.offset + child->offset) + row_;
+            uint64_t *validity = child->null_count == 0 ? nullptr : importValidity(child->buffers[0], first, n);
+
+            if (types_[c] == ARROW_COL_INT32) {
+                auto values = static_cast<const int32_t*>(child->buffers[1]);
+                auto vec = new DbVector<int32_t>(n, const_cast<int32_t*>(values + first));
+                vec->setValidity(validity);
+                br->add(names_[c], vec);
+                continue;
+            }
+
+            auto vec = new DbVector<DbString>(n);
+            vec->setValidity(validity);
+            if (types_[c] == ARROW_COL_UTF8)
+                importUtf8_(child, first, n, vec->col);
+            else
+                importView_(child, first, n, vec->col);
+            br->addStr(names_[c], vec);
+        }
+
+        row_ += n;
+        return br;
+    }
+
+private:
+    static void importUtf8_(const ArrowArray *child, uint64_t first, uint32_t n, DbString *out) {
+        auto offsets = static_cast<const int32_t*>(child->buffers[1]);
+        auto data = static_cast<const char*>(child->buffers[2]);
+        for (uint32_t i = 0; i < n; i++) {
+            const char *s = data + offsets[first + i];
+            auto len = (uint32_t) (offsets[first + i + 1] - offsets[first + i]);
+            DbString& res = out[i];
+            memset(&res, 0, sizeof(res));
+            res.len = len;
+            if (len <= DbString::INLINE_LEN) {
+                memcpy(res.prefix, s, len);
+            }
+            else {
+                memcpy(res.prefix, s, sizeof(res.prefix));
+                res.ptr = s;
+            }
+        }
+    }
+
+    static void importView_(const ArrowArray *child, uint64_t first, uint32_t n, DbString *out) {
+        auto views = static_cast<const char*>(child->buffers[1]) + 16 * first;
+        for (uint32_t i = 0; i < n; i++) {
+            const char *view = views + 16 * (size_t) i;
+            DbString& res = out[i];
+            memcpy(&res, view, sizeof(res));
+            if (res.len > DbString::INLINE_LEN) {
+                int32_t buffer_index;
+                int32_t offset;
+                memcpy(&buffer_index, view + 8, sizeof(buffer_index));
+                memcpy(&offset, view + 12, sizeof(offset));
+                res.ptr = static_cast<const char*>(child->buffers[2 + buffer_index]) + offset;
+            }
+        }
+    }
+};
+
+
+#endif //PROJECT_ARROW_C_H
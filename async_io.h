@@ -0,0 +1,621 @@
+#ifndef PROJECT_ASYNC_IO_H
+#define PROJECT_ASYNC_IO_H
+
+
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "columnar_file.h"
+
+
+/**
+ * Asynchronous reads for scans of data that is not in memory.
+ *
+ * An AsyncReader takes reads of whole buffers and reports them back by tag
+ * once they are complete, in any order. There are two of them:
+ *
+ *   IoUringReader     io_uring through the raw system calls (no liburing)
+ *   ThreadPoolReader  a few threads doing blocking pread(), for kernels or
+ *                     sandboxes without io_uring
+ *
+ * ReadAheadScanOperator keeps a window of batches in flight on top of them.
+ */
+
+
+#define IO_MODE_AUTO        0   // io_uring if the kernel allows it, else threads
+#define IO_MODE_URING       1
+#define IO_MODE_THREADS     2
+
+
+class AsyncReader {
+public:
+    virtual ~AsyncReader() = default;
+
+    /**
+     * Queue a read of exactly len bytes at offset into buf.
+     */
+    virtual void submit(int fd, void *buf, uint32_t len, uint64_t offset, uint64_t tag) = 0;
+
+    /**
+     * Start the queued reads.
+     */
+    virtual void flush() = 0;
+
+    /**
+     * Block until a read is complete and return its tag.
+     */
+    virtual uint64_t wait() = 0;
+};
+
+
+class IoUringReader : public AsyncReader {
+private:
+    struct Request {
+        int fd;
+        char *buf;
+        uint32_t len;
+        uint64_t offset;
+        uint64_t tag;
+    };
+
+    int ring_fd_;
+    void *sq_ring_;
+    size_t sq_ring_size_;
+    void *cq_ring_;
+    size_t cq_ring_size_;
+    io_uring_sqe *sqes_;
+    size_t sqes_size_;
+
+    uint32_t *sq_head_;
+    uint32_t *sq_tail_;
+    uint32_t sq_mask_;
+    uint32_t *sq_array_;
+    uint32_t *cq_head_;
+    uint32_t *cq_tail_;
+    uint32_t cq_mask_;
+    io_uring_cqe *cqes_;
+    uint32_t entries_;
+
+    // the requests in flight by slot, user_data is the slot
+    std::vector<Request> requests_;
+    std::vector<uint32_t> free_slots_;
+    uint32_t to_submit_;
+
+    static inline uint32_t loadAcquire_(const uint32_t *p) {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    static inline void storeRelease_(uint32_t *p, uint32_t v) {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+
+public:
+    /**
+     * Throws std::runtime_error if io_uring is not available.
+     */
+    explicit IoUringReader(uint32_t entries) :
+            ring_fd_(-1), sq_ring_(MAP_FAILED), sq_ring_size_(0), cq_ring_(MAP_FAILED), cq_ring_size_(0),
+            sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)), sqes_size_(0), to_submit_(0) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd_ = (int) syscall(__NR_io_uring_setup, entries, &params);
+        if (ring_fd_ < 0)
+            throw std::runtime_error("io_uring_setup failed");
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap)
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            release_();
+            throw std::runtime_error("io_uring mmap failed");
+        }
+        if (single_mmap) {
+            cq_ring_ = sq_ring_;
+        }
+        else {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                release_();
+                throw std::runtime_error("io_uring mmap failed");
+            }
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+        if (sqes_ == MAP_FAILED) {
+            release_();
+            throw std::runtime_error("io_uring mmap failed");
+        }
+
+        auto sq = static_cast<char*>(sq_ring_);
+        sq_head_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+
+        auto cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // never more reads in flight than the submission queue holds, so the
+        // completion queue (twice as large) cannot overflow
+        entries_ = params.sq_entries;
+        requests_.resize(entries_);
+        for (uint32_t i = entries_; i > 0; i--)
+            free_slots_.push_back(i - 1);
+    }
+
+    IoUringReader(const IoUringReader&) = delete;
+    IoUringReader& operator=(const IoUringReader&) = delete;
+
+    ~IoUringReader() final {
+        release_();
+    }
+
+    void submit(int fd, void *buf, uint32_t len, uint64_t offset, uint64_t tag) final {
+        if (free_slots_.empty())
+            throw std::runtime_error("Too many reads in flight");
+
+        uint32_t slot = free_slots_.back();
+        free_slots_.pop_back();
+        requests_[slot] = Request{fd, static_cast<char*>(buf), len, offset, tag};
+        push_(slot);
+    }
+
+    void flush() final {
+        while (to_submit_ > 0) {
+            auto rc = (int) syscall(__NR_io_uring_enter, ring_fd_, to_submit_, 0, 0, nullptr, 0);
+            if (rc < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                    continue;
+                throw std::runtime_error("io_uring_enter failed");
+            }
+            to_submit_ -= (uint32_t) rc;
+        }
+    }
+
+    uint64_t wait() final {
+        flush();
+        while (true) {
+            uint32_t head = *cq_head_;
+            if (head == loadAcquire_(cq_tail_)) {
+                auto rc = (int) syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (rc < 0 && errno != EINTR)
+                    throw std::runtime_error("io_uring_enter failed");
+                continue;
+            }
+
+            io_uring_cqe cqe = cqes_[head & cq_mask_];
+            storeRelease_(cq_head_, head + 1);
+
+            auto slot = (uint32_t) cqe.user_data;
+            Request& req = requests_[slot];
+            if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+                push_(slot);
+                flush();
+                continue;
+            }
+            if (cqe.res <= 0) {
+                free_slots_.push_back(slot);
+                throw std::runtime_error(cqe.res == 0 ? "Unexpected end of file" : "Read failed");
+            }
+
+            // a short read, ask for the rest
+            if ((uint32_t) cqe.res < req.len) {
+                req.buf += cqe.res;
+                req.len -= (uint32_t) cqe.res;
+                req.offset += (uint64_t) cqe.res;
+                push_(slot);
+                flush();
+                continue;
+            }
+
+            free_slots_.push_back(slot);
+            return req.tag;
+        }
+    }
+
+private:
+    void push_(uint32_t slot) {
+        const Request& req = requests_[slot];
+        uint32_t tail = *sq_tail_;
+        uint32_t idx = tail & sq_mask_;
+        io_uring_sqe *sqe = &sqes_[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = req.fd;
+        sqe->addr = (uint64_t) (uintptr_t) req.buf;
+        sqe->len = req.len;
+        sqe->off = req.offset;
+        sqe->user_data = slot;
+        sq_array_[idx] = idx;
+        storeRelease_(sq_tail_, tail + 1);
+        to_submit_++;
+    }
+
+    void release_() {
+        if (sqes_ != MAP_FAILED)
+            munmap(sqes_, sqes_size_);
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+            munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_ != MAP_FAILED)
+            munmap(sq_ring_, sq_ring_size_);
+        if (ring_fd_ >= 0)
+            ::close(ring_fd_);
+        sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+        cq_ring_ = sq_ring_ = MAP_FAILED;
+        ring_fd_ = -1;
+    }
+};
+
+
+class ThreadPoolReader : public AsyncReader {
+private:
+    struct Request {
+        int fd;
+        char *buf;
+        uint32_t len;
+        uint64_t offset;
+        uint64_t tag;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable submitted_;
+    std::condition_variable completed_;
+    std::deque<Request> queued_;
+    std::deque<Request> requests_;
+    std::deque<uint64_t> completions_;
+    std::exception_ptr error_;
+    bool stop_;
+    std::vector<std::thread> threads_;
+
+public:
+    explicit ThreadPoolReader(uint32_t num_of_threads) : error_(nullptr), stop_(false) {
+        for (uint32_t t = 0; t < std::max(num_of_threads, 1u); t++)
+            threads_.emplace_back([this]() { work_(); });
+    }
+
+    ~ThreadPoolReader() final {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            stop_ = true;
+        }
+        submitted_.notify_all();
+        for (auto& thread : threads_)
+            thread.join();
+    }
+
+    void submit(int fd, void *buf, uint32_t len, uint64_t offset, uint64_t tag) final {
+        queued_.push_back(Request{fd, static_cast<char*>(buf), len, offset, tag});
+    }
+
+    void flush() final {
+        if (queued_.empty())
+            return;
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            requests_.insert(requests_.end(), queued_.begin(), queued_.end());
+        }
+        queued_.clear();
+        submitted_.notify_all();
+    }
+
+    uint64_t wait() final {
+        flush();
+        std::unique_lock<std::mutex> lock(mutex_);
+        completed_.wait(lock, [this]() { return !completions_.empty() || error_ != nullptr; });
+        if (error_ != nullptr)
+            std::rethrow_exception(error_);
+        uint64_t tag = completions_.front();
+        completions_.pop_front();
+        return tag;
+    }
+
+private:
+    void work_() {
+        while (true) {
+            Request req{};
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                submitted_.wait(lock, [this]() { return stop_ || !requests_.empty(); });
+                if (stop_)
+                    return;
+                req = requests_.front();
+                requests_.pop_front();
+            }
+
+            const char *error = nullptr;
+            while (req.len > 0) {
+                ssize_t rc = pread(req.fd, req.buf, req.len, (off_t) req.offset);
+                if (rc < 0 && errno == EINTR)
+                    continue;
+                if (rc <= 0) {
+                    error = rc == 0 ? "Unexpected end of file" : "Read failed";
+                    break;
+                }
+                req.buf += rc;
+                req.len -= (uint32_t) rc;
+                req.offset += (uint64_t) rc;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(mutex_);
+                if (error != nullptr && error_ == nullptr)
+                    error_ = std::make_exception_ptr(std::runtime_error(error));
+                else
+                    completions_.push_back(req.tag);
+            }
+            completed_.notify_one();
+        }
+    }
+};
+
+
+/**
+ * The reader for mode; IO_MODE_AUTO falls back to threads when io_uring
+ * cannot be set up.
+ */
+inline std::unique_ptr<AsyncReader> makeAsyncReader(int mode, uint32_t entries, uint32_t num_of_threads = 4) {
+    if (mode != IO_MODE_THREADS) {
+        try {
+            return std::unique_ptr<AsyncReader>(new IoUringReader(entries));
+        }
+        catch (const std::runtime_error&) {
+            if (mode == IO_MODE_URING)
+                throw;
+        }
+    }
+    return std::unique_ptr<AsyncReader>(new ThreadPoolReader(num_of_threads));
+}
+
+
+/**
+ * Scans a columnar file with read-ahead: the next depth batches are always
+ * being read while the operators above process the current one.
+ *
+ * Every batch has a slot of page-aligned column buffers. The slot of the
+ * batch returned by next() is reused for a new read when next() is called
+ * again, so a batch (and its vectors, which do not own their memory) is only
+ * valid until the following next(). Operators that keep vectors across
+ * batches must copy them.
+ *
+ * The blocks of compressed columns are read into the slot as they are and
+ * decoded into a buffer per column once their batch is next.
+ *
+ * With direct the file is read with O_DIRECT, bypassing the page cache; this
+ * needs plain columns and batches of whole pages.
+ */
+class ReadAheadScanOperator : public BaseOperator {
+private:
+    struct Slot {
+        std::vector<int32_t*> buffers;
+        uint32_t pending;
+    };
+
+    ColumnarFile *file_;
+    std::vector<std::string> columns_;
+    std::vector<const ColumnHeader*> headers_;
+    std::vector<size_t> buffer_sizes_;
+    std::vector<std::vector<int32_t>> decoded_;
+    uint32_t depth_;
+    int io_mode_;
+    bool direct_;
+
+    uint32_t batch_size_;
+    uint64_t num_of_rows_;
+    uint32_t num_of_batches_;
+
+    int fd_;
+    std::unique_ptr<AsyncReader> reader_;
+    std::vector<Slot> slots_;
+    uint32_t next_read_;
+    uint32_t next_batch_;
+    uint32_t in_flight_;
+
+public:
+    ReadAheadScanOperator(ColumnarFile *file,
+                          std::vector<std::string> columns,
+                          uint32_t depth = 16,
+                          int io_mode = IO_MODE_AUTO,
+                          bool direct = false) :
+            file_(file),
+            columns_(std::move(columns)),
+            depth_(depth == 0 ? 1 : depth),
+            io_mode_(io_mode),
+            direct_(direct),
+            batch_size_(file->getBatchSize()),
+            num_of_rows_(file->getNumOfRows()),
+            num_of_batches_(file->getNumOfBatches()),
+            fd_(-1),
+            next_read_(0),
+            next_batch_(0),
+            in_flight_(0) {
+        if (direct_ && (batch_size_ * sizeof(int32_t)) % COLUMNAR_PAGE_SIZE != 0)
+            throw std::invalid_argument("O_DIRECT scans need batches of whole pages");
+
+        for (const auto& name : columns_) {
+            const ColumnHeader *col = file_->getColumnHeader(name);
+            headers_.push_back(col);
+
+            uint64_t max_length = batch_size_ * sizeof(int32_t);
+            if (col->encoding != COL_ENCODING_PLAIN) {
+                if (direct_)
+                    throw std::invalid_argument("O_DIRECT scans need plain columns");
+                const uint64_t *index = file_->getBlockIndex(col);
+                max_length = 0;
+                for (uint32_t b = 0; b < num_of_batches_; b++)
+                    max_length = std::max(max_length, index[b + 1] - index[b]);
+                max_length += BLOCK_PADDING;
+            }
+            buffer_sizes_.push_back(alignToPage(max_length));
+        }
+    }
+
+    ~ReadAheadScanOperator() final {
+        try {
+            release_();
+        }
+        catch (...) {
+            // a failed read while draining, the buffers are freed regardless
+        }
+    }
+
+    void open() final {
+        release_();
+        fd_ = ::open(file_->getPath().c_str(), O_RDONLY | (direct_ ? O_DIRECT : 0));
+        if (fd_ < 0)
+            throw std::runtime_error("Cannot open " + file_->getPath());
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        reader_ = makeAsyncReader(io_mode_, depth_ * (uint32_t) columns_.size());
+        slots_.resize(depth_);
+        for (auto& slot : slots_) {
+            slot.pending = 0;
+            for (uint32_t i = 0; i < columns_.size(); i++) {
+                void *buffer = aligned_alloc(COLUMNAR_PAGE_SIZE, buffer_sizes_[i]);
+                if (buffer == nullptr)
+                    throw std::bad_alloc();
+                slot.buffers.push_back(static_cast<int32_t*>(buffer));
+            }
+        }
+
+        decoded_.clear();
+        for (auto col : headers_)
+            decoded_.emplace_back(col->encoding == COL_ENCODING_PLAIN ? 0 : batch_size_);
+
+        next_read_ = 0;
+        next_batch_ = 0;
+        while (next_read_ < num_of_batches_ && next_read_ < depth_)
+            read_(next_read_++);
+        reader_->flush();
+    }
+
+    void close() final {
+        release_();
+    }
+
+    bool reusesBatches() const final {
+        return true;
+    }
+
+    BatchResult* next() final {
+        // the previous batch is consumed, its slot reads ahead
+        if (next_batch_ > 0 && next_read_ < num_of_batches_) {
+            read_(next_read_++);
+            reader_->flush();
+        }
+
+        if (next_batch_ >= num_of_batches_)
+            return nullptr;
+
+        Slot& slot = slots_[next_batch_ % depth_];
+        while (slot.pending > 0)
+            complete_(reader_->wait());
+
+        uint64_t row = (uint64_t) next_batch_ * batch_size_;
+        auto n = (uint32_t) std::min<uint64_t>(batch_size_, num_of_rows_ - row);
+        BatchResult *br = new BatchResult();
+        for (uint32_t i = 0; i < columns_.size(); i++) {
+            if (headers_[i]->encoding == COL_ENCODING_PLAIN) {
+                br->add(columns_[i], new DbVector<int32_t>(n, slot.buffers[i]));
+            }
+            else {
+                auto block = reinterpret_cast<const uint8_t*>(slot.buffers[i]);
+                const uint64_t *index = file_->getBlockIndex(headers_[i]);
+                decodeBlock(headers_[i]->encoding, block, index[next_batch_ + 1] - index[next_batch_], n, decoded_[i].data());
+                br->add(columns_[i], new DbVector<int32_t>(n, decoded_[i].data()));
+            }
+        }
+
+        next_batch_++;
+        return br;
+    }
+
+private:
+    void read_(uint32_t batch) {
+        uint32_t s = batch % depth_;
+        Slot& slot = slots_[s];
+        uint64_t row = (uint64_t) batch * batch_size_;
+
+        for (uint32_t i = 0; i < columns_.size(); i++) {
+            const ColumnHeader *col = headers_[i];
+            uint64_t offset;
+            uint32_t len;
+            if (col->encoding == COL_ENCODING_PLAIN) {
+                offset = col->offset + row * sizeof(int32_t);
+                len = (uint32_t) (std::min<uint64_t>(batch_size_, num_of_rows_ - row) * sizeof(int32_t));
+                if (direct_)
+                    len = (uint32_t) alignToPage(len);
+            }
+            else {
+                const uint64_t *index = file_->getBlockIndex(col);
+                offset = col->offset + index[batch];
+                len = (uint32_t) (index[batch + 1] - index[batch]);
+            }
+
+            reader_->submit(fd_, slot.buffers[i], len, offset, (uint64_t) s * columns_.size() + i);
+            slot.pending++;
+            in_flight_++;
+        }
+    }
+
+    void complete_(uint64_t tag) {
+        slots_[tag / columns_.size()].pending--;
+        in_flight_--;
+    }
+
+    void release_() {
+        // the reads in flight still write into the buffers
+        std::exception_ptr error = nullptr;
+        try {
+            while (reader_ != nullptr && in_flight_ > 0)
+                complete_(reader_->wait());
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        reader_.reset();
+        in_flight_ = 0;
+
+        for (auto& slot : slots_) {
+            for (auto buffer : slot.buffers)
+                free(buffer);
+        }
+        slots_.clear();
+
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+
+        if (error != nullptr)
+            std::rethrow_exception(error);
+    }
+};
+
+
+#endif //PROJECT_ASYNC_IO_H
@@ -0,0 +1,83 @@
+#ifndef PROJECT_BLOOM_H
+#define PROJECT_BLOOM_H
+
+
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * Register-blocked bloom filter (Lang et al., "Performance-optimal filtering:
+ * Bloom overtakes Cuckoo at high throughput", VLDB 2019).
+ *
+ * A key sets K bits within a single 64-bit word, so a lookup is one load and
+ * one compare, and a batch of lookups is a branch-free loop. The word comes
+ * from the high bits of the key's hash, the bit positions from a remix of
+ * it; hash tables index with the low bits, so the two stay independent.
+ *
+ * With 16 bits per key about 0.5% of the keys that are not in the filter
+ * pass.
+ */
+class BlockedBloomFilter {
+private:
+    static const uint32_t K = 4;
+
+    std::vector<uint64_t> words_;
+    uint32_t shift_;
+
+    static inline uint64_t bits_(uint32_t hash) {
+        uint32_t b = hash * 0x9E3779B1u;
+        return (1ull << (b >> 26)) | (1ull << ((b >> 20) & 63)) | (1ull << ((b >> 14) & 63)) | (1ull << ((b >> 8) & 63));
+    }
+
+    inline uint32_t word_(uint32_t hash) const {
+        return hash >> shift_;
+    }
+
+public:
+    explicit BlockedBloomFilter(uint64_t num_of_keys, uint32_t bits_per_key = 16) {
+        uint64_t num_of_words = 2;
+        uint32_t log2 = 1;
+        while (num_of_words * 64 < num_of_keys * bits_per_key && log2 < 31) {
+            num_of_words <<= 1;
+            log2++;
+        }
+        words_.assign(num_of_words, 0);
+        shift_ = 32 - log2;
+    }
+
+    void insert(uint32_t hash) {
+        words_[word_(hash)] |= bits_(hash);
+    }
+
+    void prefetch(uint32_t hash) const {
+        __builtin_prefetch(&words_[word_(hash)]);
+    }
+
+    bool contains(uint32_t hash) const {
+        uint64_t bits = bits_(hash);
+        return (words_[word_(hash)] & bits) == bits;
+    }
+
+    /**
+     * res_sel = the j < n whose hashes[j] may be in the filter; returns
+     * their number.
+     */
+    uint32_t filter(uint32_t n, uint32_t *res_sel, const uint32_t *hashes) const {
+        const uint64_t *words = words_.data();
+        uint32_t res = 0;
+        for (uint32_t j = 0; j < n; j++) {
+            uint64_t bits = bits_(hashes[j]);
+            res_sel[res] = j;
+            res += (words[word_(hashes[j])] & bits) == bits;
+        }
+        return res;
+    }
+
+    uint64_t getSizeInBytes() const {
+        return words_.size() * sizeof(uint64_t);
+    }
+};
+
+
+#endif //PROJECT_BLOOM_H
@@ -0,0 +1,630 @@
+#ifndef PROJECT_CODEGEN_H
+#define PROJECT_CODEGEN_H
+
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "common.h"
+#include "jit.h"
+
+
+/**
+ * Push-based code generation for whole pipelines (Neumann, "Efficiently
+ * compiling efficient query plans for modern hardware", VLDB 2011).
+ *
+ * A plan of Cg* nodes is not run but generates C++: produce() asks a node
+ * to emit the code that yields its tuples, and every node that yields one
+ * calls consume() on its parent, which emits what it does with the tuple
+ * right there. The scan opens the loop over the rows of a batch and the
+ * other nodes nest into it, so a pipeline scan -> select -> project ->
+ * aggregate becomes one loop: a selection is an if, a projection a local
+ * variable, an aggregate an accumulator, and the values of a tuple stay in
+ * registers from one node to the next. Only the node ending a pipeline
+ * writes to memory, the output columns (CgMaterialize) or the aggregates
+ * (CgAggregate).
+ *
+ * All values are int64 in the generated code; columns are int32.
+ *
+ * The generated function processes one batch:
+ *
+ *   extern "C" uint32_t <symbol>(uint32_t n, const uint32_t *sel,
+ *                                int32_t **in, int32_t **out, int64_t *state)
+ *
+ * in are the scanned columns, sel the batch's selection vector (nullptr
+ * for all n rows); it returns the number of rows written to out. A
+ * CompiledPipeline generates and compiles it (jit.h), a PipelineJitOperator
+ * runs it on the batches of a child.
+ */
+
+
+#define CG_COUNT    1
+#define CG_SUM      2
+#define CG_MIN      3
+#define CG_MAX      4
+
+
+typedef uint32_t (*PipelineKernel)(uint32_t, const uint32_t*, int32_t**, int32_t**, int64_t*);
+
+
+/**
+ * The code being generated and what the nodes agreed on so far: the
+ * columns the scan reads, the C++ expression of every attribute of the
+ * current tuple, the output columns and the aggregate state.
+ */
+class CodegenContext {
+private:
+    std::string code_;
+    uint32_t indent_;
+    uint32_t next_var_;
+    std::vector<std::string> inputs_;
+    std::vector<std::string> outputs_;
+    std::vector<int64_t> state_;
+    std::map<std::string, std::string> attributes_;
+
+public:
+    CodegenContext() : indent_(1), next_var_(0) {}
+
+    void line(const std::string& statement) {
+        code_.append(4 * indent_, ' ');
+        code_ += statement;
+        code_ += '\n';
+    }
+
+    /**
+     * Emits head, e.g. "for (...) {", and indents what follows until
+     * close().
+     */
+    void open(const std::string& head) {
+        line(head);
+        indent_++;
+    }
+
+    void close() {
+        indent_--;
+        line("}");
+    }
+
+    /**
+     * A fresh local variable name.
+     */
+    std::string newVar(const std::string& prefix) {
+        return prefix + std::to_string(next_var_++);
+    }
+
+    /**
+     * The index of a column in in, added if it is new.
+     */
+    uint32_t addInput(const std::string& col_name) {
+        for (uint32_t k = 0; k < inputs_.size(); k++) {
+            if (inputs_[k] == col_name)
+                return k;
+        }
+        inputs_.push_back(col_name);
+        return (uint32_t) inputs_.size() - 1;
+    }
+
+    uint32_t addOutput(const std::string& col_name) {
+        outputs_.push_back(col_name);
+        return (uint32_t) outputs_.size() - 1;
+    }
+
+    /**
+     * A slot of the state, which holds initial before the first batch.
+     */
+    uint32_t addState(int64_t initial) {
+        state_.push_back(initial);
+        return (uint32_t) state_.size() - 1;
+    }
+
+    void setAttribute(const std::string& name, std::string expr) {
+        attributes_[name] = std::move(expr);
+    }
+
+    const std::string& getAttribute(const std::string& name) const {
+        auto it = attributes_.find(name);
+        if (it == attributes_.end())
+            throw std::invalid_argument("no attribute " + name + " in the pipeline");
+        return it->second;
+    }
+
+    const std::string& getCode() const {
+        return code_;
+    }
+
+    const std::vector<std::string>& getInputs() const {
+        return inputs_;
+    }
+
+    const std::vector<std::string>& getOutputs() const {
+        return outputs_;
+    }
+
+    const std::vector<int64_t>& getState() const {
+        return state_;
+    }
+};
+
+
+/************************************************************************
+ *
+ * Expressions
+ *
+ **************************************************************************/
+
+
+class CgExpr {
+public:
+    virtual ~CgExpr() = default;
+
+    /**
+     * C++ for the value of the expression on the current tuple.
+     */
+    virtual std::string generate(const CodegenContext& ctx) const = 0;
+};
+
+
+typedef std::shared_ptr<const CgExpr> CgExprPtr;
+
+
+class CgColumnExpr : public CgExpr {
+private:
+    std::string name_;
+
+public:
+    explicit CgColumnExpr(std::string name) : name_(std::move(name)) {}
+
+    std::string generate(const CodegenContext& ctx) const final {
+        return ctx.getAttribute(name_);
+    }
+};
+
+
+class CgConstantExpr : public CgExpr {
+private:
+    int64_t value_;
+
+public:
+    explicit CgConstantExpr(int64_t value) : value_(value) {}
+
+    std::string generate(const CodegenContext&) const final {
+        return "INT64_C(" + std::to_string(value_) + ")";
+    }
+};
+
+
+/**
+ * left op right for a C++ operator op: arithmetic, comparisons and &&.
+ */
+class CgBinaryExpr : public CgExpr {
+private:
+    std::string op_;
+    CgExprPtr left_;
+    CgExprPtr right_;
+
+public:
+    CgBinaryExpr(std::string op, CgExprPtr left, CgExprPtr right) :
+        op_(std::move(op)), left_(std::move(left)), right_(std::move(right)) {}
+
+    std::string generate(const CodegenContext& ctx) const final {
+        return "(" + left_->generate(ctx) + " " + op_ + " " + right_->generate(ctx) + ")";
+    }
+};
+
+
+inline CgExprPtr cgCol(const std::string& name) {
+    return std::make_shared<const CgColumnExpr>(name);
+}
+
+
+inline CgExprPtr cgConst(int64_t value) {
+    return std::make_shared<const CgConstantExpr>(value);
+}
+
+
+inline CgExprPtr cgOp(const std::string& op, CgExprPtr left, CgExprPtr right) {
+    return std::make_shared<const CgBinaryExpr>(op, std::move(left), std::move(right));
+}
+
+
+/**
+ * lo <= col <= hi
+ */
+inline CgExprPtr cgBetween(const std::string& col, int64_t lo, int64_t hi) {
+    return cgOp("&&", cgOp(">=", cgCol(col), cgConst(lo)), cgOp("<=", cgCol(col), cgConst(hi)));
+}
+
+
+/************************************************************************
+ *
+ * Plan nodes
+ *
+ **************************************************************************/
+
+
+class CgOperator {
+private:
+    CgOperator *parent_;
+
+protected:
+    /**
+     * Hands the current tuple to the parent.
+     */
+    void emit_(CodegenContext& ctx) {
+        if (parent_ == nullptr)
+            throw std::logic_error("a pipeline must end in CgMaterialize or CgAggregate");
+        parent_->consume(ctx);
+    }
+
+    static CgOperator* adopt_(CgOperator *parent, CgOperator *child) {
+        child->parent_ = parent;
+        return child;
+    }
+
+public:
+    CgOperator() : parent_(nullptr) {}
+    virtual ~CgOperator() = default;
+
+    CgOperator(const CgOperator&) = delete;
+    CgOperator& operator=(const CgOperator&) = delete;
+
+    /**
+     * Emits the code that yields the tuples of this node.
+     */
+    virtual void produce(CodegenContext& ctx) = 0;
+
+    /**
+     * Emits what this node does with a tuple of its child.
+     */
+    virtual void consume(CodegenContext& ctx) = 0;
+};
+
+
+/**
+ * The rows of a batch: columns are its attributes.
+ */
+class CgScan : public CgOperator {
+private:
+    std::vector<std::string> columns_;
+
+public:
+    explicit CgScan(std::vector<std::string> columns) : columns_(std::move(columns)) {}
+
+    void produce(CodegenContext& ctx) final {
+        for (const auto& name : columns_) {
+            uint32_t k = ctx.addInput(name);
+            ctx.setAttribute(name, "(int64_t) in" + std::to_string(k) + "[i]");
+        }
+        ctx.open("for (uint32_t j = 0; j < n; j++) {");
+        ctx.line("const uint32_t i = sel == nullptr ? j : sel[j];");
+        emit_(ctx);
+        ctx.close();
+    }
+
+    void consume(CodegenContext&) final {
+        throw std::logic_error("a scan has no child");
+    }
+};
+
+
+class CgSelect : public CgOperator {
+private:
+    std::unique_ptr<CgOperator> child_;
+    CgExprPtr cond_;
+
+public:
+    CgSelect(std::unique_ptr<CgOperator> child, CgExprPtr cond) :
+        child_(adopt_(this, child.release())), cond_(std::move(cond)) {}
+
+    void produce(CodegenContext& ctx) final {
+        child_->produce(ctx);
+    }
+
+    void consume(CodegenContext& ctx) final {
+        ctx.open("if (" + cond_->generate(ctx) + ") {");
+        emit_(ctx);
+        ctx.close();
+    }
+};
+
+
+/**
+ * Adds the attributes exprs (name, expression) to the tuples; the ones of
+ * the child stay.
+ */
+class CgProject : public CgOperator {
+private:
+    std::unique_ptr<CgOperator> child_;
+    std::vector<std::pair<std::string, CgExprPtr>> exprs_;
+
+public:
+    CgProject(std::unique_ptr<CgOperator> child, std::vector<std::pair<std::string, CgExprPtr>> exprs) :
+        child_(adopt_(this, child.release())), exprs_(std::move(exprs)) {}
+
+    void produce(CodegenContext& ctx) final {
+        child_->produce(ctx);
+    }
+
+    void consume(CodegenContext& ctx) final {
+        for (const auto& expr : exprs_) {
+            std::string var = ctx.newVar("p");
+            ctx.line("const int64_t " + var + " = " + expr.second->generate(ctx) + ";");
+            ctx.setAttribute(expr.first, var);
+        }
+        emit_(ctx);
+    }
+};
+
+
+/**
+ * Ends a pipeline: writes the attributes names of every tuple as int32
+ * output columns.
+ */
+class CgMaterialize : public CgOperator {
+private:
+    std::unique_ptr<CgOperator> child_;
+    std::vector<std::string> names_;
+
+public:
+    CgMaterialize(std::unique_ptr<CgOperator> child, std::vector<std::string> names) :
+        child_(adopt_(this, child.release())), names_(std::move(names)) {}
+
+    void produce(CodegenContext& ctx) final {
+        for (const auto& name : names_)
+            ctx.addOutput(name);
+        child_->produce(ctx);
+    }
+
+    void consume(CodegenContext& ctx) final {
+        for (uint32_t k = 0; k < names_.size(); k++)
+            ctx.line("out[" + std::to_string(k) + "][res] = (int32_t) " + ctx.getAttribute(names_[k]) + ";");
+        ctx.line("res++;");
+    }
+};
+
+
+/**
+ * func (CG_*) of expr; count ignores expr.
+ */
+struct CgAggregateSpec {
+    int func;
+    CgExprPtr expr;
+};
+
+
+/**
+ * Ends a pipeline: ungrouped aggregates, one state slot each. The
+ * accumulators are locals while a batch runs and go back to the state
+ * after it.
+ */
+class CgAggregate : public CgOperator {
+private:
+    std::unique_ptr<CgOperator> child_;
+    std::vector<CgAggregateSpec> specs_;
+    std::vector<std::string> vars_;
+
+public:
+    CgAggregate(std::unique_ptr<CgOperator> child, std::vector<CgAggregateSpec> specs) :
+        child_(adopt_(this, child.release())), specs_(std::move(specs)) {}
+
+    void produce(CodegenContext& ctx) final {
+        vars_.clear();
+        std::vector<uint32_t> slots{};
+        for (const auto& spec : specs_) {
+            int64_t initial = spec.func == CG_MIN ? INT64_MAX : (spec.func == CG_MAX ? INT64_MIN : 0);
+            slots.push_back(ctx.addState(initial));
+            vars_.push_back(ctx.newVar("a"));
+            ctx.line("int64_t " + vars_.back() + " = state[" + std::to_string(slots.back()) + "];");
+        }
+        child_->produce(ctx);
+        for (uint32_t a = 0; a < specs_.size(); a++)
+            ctx.line("state[" + std::to_string(slots[a]) + "] = " + vars_[a] + ";");
+    }
+
+    void consume(CodegenContext& ctx) final {
+        for (uint32_t a = 0; a < specs_.size(); a++) {
+            const std::string& var = vars_[a];
+            switch (specs_[a].func) {
+                case CG_COUNT:
+                    ctx.line(var + "++;");
+                    break;
+                case CG_SUM:
+                    ctx.line(var + " += " + specs_[a].expr->generate(ctx) + ";");
+                    break;
+                case CG_MIN:
+                case CG_MAX: {
+                    std::string value = ctx.newVar("v");
+                    ctx.line("const int64_t " + value + " = " + specs_[a].expr->generate(ctx) + ";");
+                    ctx.line(var + " = " + value + (specs_[a].func == CG_MIN ? " < " : " > ") + var + " ? " + value + " : " + var + ";");
+                    break;
+                }
+                default:
+                    throw std::invalid_argument("unknown aggregate " + std::to_string(specs_[a].func));
+            }
+        }
+    }
+};
+
+
+/************************************************************************
+ *
+ * Execution
+ *
+ **************************************************************************/
+
+
+/**
+ * The function generated from a pipeline, compiled in the background as
+ * soon as the object is made; immutable, so the instances of a
+ * CompiledPlan can share it.
+ */
+class CompiledPipeline {
+private:
+    std::string source_;
+    std::vector<std::string> inputs_;
+    std::vector<std::string> outputs_;
+    std::vector<int64_t> state_;
+    std::unique_ptr<BackgroundCompilation> kernel_;
+
+public:
+    CompiledPipeline(CgOperator& root, const std::string& symbol) {
+        CodegenContext ctx;
+        ctx.line("uint32_t res = 0;");
+        root.produce(ctx);
+        ctx.line("return res;");
+
+        source_ = "#include <cstdint>\n\n"
+                  "extern \"C\" uint32_t " + symbol + "(uint32_t n, const uint32_t *sel, int32_t **in, int32_t **out, int64_t *state) {\n";
+        for (uint32_t k = 0; k < ctx.getInputs().size(); k++)
+            source_ += "    const int32_t *in" + std::to_string(k) + " = in[" + std::to_string(k) + "];\n";
+        source_ += ctx.getCode() + "}\n";
+
+        inputs_ = ctx.getInputs();
+        outputs_ = ctx.getOutputs();
+        state_ = ctx.getState();
+        kernel_.reset(new BackgroundCompilation(source_, symbol));
+    }
+
+    /**
+     * The compiled function; waits for the compiler, throws if it failed.
+     */
+    PipelineKernel getKernel() const {
+        kernel_->wait();
+        auto function = kernel_->getFunction<PipelineKernel>();
+        if (function == nullptr)
+            throw std::runtime_error(kernel_->getError());
+        return function;
+    }
+
+    /**
+     * The compiled function, nullptr while the compiler runs (or if it
+     * failed); never waits.
+     */
+    PipelineKernel tryGetKernel() const {
+        return kernel_->getFunction<PipelineKernel>();
+    }
+
+    const std::string& getSource() const {
+        return source_;
+    }
+
+    const std::vector<std::string>& getInputs() const {
+        return inputs_;
+    }
+
+    const std::vector<std::string>& getOutputs() const {
+        return outputs_;
+    }
+
+    /**
+     * The initial values of the aggregates.
+     */
+    const std::vector<int64_t>& getState() const {
+        return state_;
+    }
+};
+
+
+/**
+ * Runs a compiled pipeline on every batch of next. A pipeline ending in
+ * CgMaterialize yields a batch of its output columns per batch with
+ * results; one ending in CgAggregate drains next on the first call,
+ * stores the aggregates in results and yields no batches. The input
+ * columns must not have NULLs.
+ */
+class PipelineJitOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    std::shared_ptr<const CompiledPipeline> pipeline_;
+    std::vector<int64_t>* results_;
+    PipelineKernel kernel_;
+    std::vector<int32_t*> in_;
+    std::vector<int32_t*> out_;
+    std::vector<int64_t> state_;
+    bool done_;
+
+    uint32_t run_(BatchResult *br) {
+        for (uint32_t k = 0; k < in_.size(); k++) {
+            const DbVector<int32_t> *vec = br->getCol(pipeline_->getInputs()[k]);
+            // the generated loop reads values only
+            if (vec->hasNulls())
+                throw std::invalid_argument("A compiled pipeline does not handle NULLs");
+            in_[k] = vec->col;
+        }
+        const DbVector<uint32_t> *sel = br->res_sel;
+        return kernel_(sel == nullptr ? br->getn() : sel->n, sel == nullptr ? nullptr : sel->col,
+                       in_.data(), out_.data(), state_.data());
+    }
+
+public:
+    PipelineJitOperator(BaseOperator *next, std::shared_ptr<const CompiledPipeline> pipeline,
+                        std::vector<int64_t> *results = nullptr) :
+            next_(next),
+            pipeline_(std::move(pipeline)),
+            results_(results),
+            kernel_(nullptr),
+            in_(pipeline_->getInputs().size()),
+            out_(pipeline_->getOutputs().size()),
+            state_(pipeline_->getState()),
+            done_(false) {
+        if (pipeline_->getOutputs().empty() && results == nullptr)
+            throw std::invalid_argument("an aggregating pipeline needs a result");
+    }
+
+    ~PipelineJitOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+        state_ = pipeline_->getState();
+        done_ = false;
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        if (kernel_ == nullptr)
+            kernel_ = pipeline_->getKernel();
+
+        if (!out_.empty()) {
+            while (true) {
+                std::unique_ptr<BatchResult> br(next_->next());
+                if (br == nullptr)
+                    return nullptr;
+
+                uint32_t n = br->res_sel == nullptr ? br->getn() : br->res_sel->n;
+                std::unique_ptr<BatchResult> res(new BatchResult(pipeline_->getOutputs(), n));
+                for (uint32_t k = 0; k < out_.size(); k++)
+                    out_[k] = res->getCol(pipeline_->getOutputs()[k])->col;
+                uint32_t m = run_(br.get());
+                if (m > 0) {
+                    for (const auto& elem : res->data)
+                        elem.second->n = m;
+                    return res.release();
+                }
+            }
+        }
+
+        if (done_)
+            return nullptr;
+        while (true) {
+            std::unique_ptr<BatchResult> br(next_->next());
+            if (br == nullptr)
+                break;
+            run_(br.get());
+        }
+        *results_ = state_;
+        done_ = true;
+        return nullptr;
+    }
+};
+
+
+#endif //PROJECT_CODEGEN_H
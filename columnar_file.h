@@ -0,0 +1,610 @@
+#ifndef PROJECT_COLUMNAR_FILE_H
+#define PROJECT_COLUMNAR_FILE_H
+
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <mutex>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "compression.h"
+
+
+/**
+ * A simple columnar table file.
+ *
+ *   page 0          FileHeader followed by one ColumnHeader per column
+ *   page aligned    column 0: num_of_rows int32 values
+ *   page aligned    column 1: ...
+ *
+ *   page aligned    stats of column 0: one BatchStats per batch
+ *   ...
+ *
+ * Every column is one contiguous segment starting on a page boundary, so
+ * batch b of a column starts at offset + b * batch_size * 4 and a scan can
+ * hand out pointers into the mapped file instead of copying. The min/max of
+ * every batch lets scans skip batches without reading them.
+ *
+ * A compressed column (see compression.h) has one block per batch instead:
+ *
+ *   uint64_t index[num_of_batches + 1]   block b is at index[b] .. index[b + 1]
+ *                                        relative to the segment
+ *   the blocks, then BLOCK_PADDING bytes
+ */
+
+
+const char COLUMNAR_MAGIC[8] = {'J', 'V', 'C', 'O', 'L', 'U', 'M', 'N'};
+const uint32_t COLUMNAR_VERSION = 1;
+const uint64_t COLUMNAR_PAGE_SIZE = 4096;
+
+#define COL_TYPE_INT32      1
+
+
+struct ColumnHeader {
+    char name[32];
+    uint32_t type;
+    uint32_t encoding;
+    uint64_t offset;
+    uint64_t length;
+    uint64_t stats_offset;
+};
+
+
+struct BatchStats {
+    int32_t min;
+    int32_t max;
+};
+
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_of_columns;
+    uint64_t num_of_rows;
+    uint32_t batch_size;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(ColumnHeader) == 64, "ColumnHeader must be 64 bytes");
+static_assert(sizeof(FileHeader) == 32, "FileHeader must be 32 bytes");
+
+const uint32_t COLUMNAR_MAX_COLUMNS = (COLUMNAR_PAGE_SIZE - sizeof(FileHeader)) / sizeof(ColumnHeader);
+
+
+inline uint64_t alignToPage(uint64_t offset) {
+    return (offset + COLUMNAR_PAGE_SIZE - 1) / COLUMNAR_PAGE_SIZE * COLUMNAR_PAGE_SIZE;
+}
+
+
+/**
+ * Writes a table whose row count is known upfront. The segments are laid out
+ * at construction and rows are written with pwrite, so writers of disjoint
+ * row ranges may run in parallel.
+ */
+class ColumnarFileWriter {
+private:
+    int fd_;
+    FileHeader header_;
+    std::vector<ColumnHeader> columns_;
+    std::vector<std::vector<BatchStats>> stats_;
+    std::mutex stats_mutex_;
+    uint64_t rows_written_;
+
+public:
+    ColumnarFileWriter(const std::string& path,
+                       const std::vector<std::string>& columns,
+                       uint64_t num_of_rows,
+                       uint32_t batch_size = DEFAULT_VECTOR_SIZE) :
+            fd_(-1), rows_written_(0) {
+        if (columns.empty() || columns.size() > COLUMNAR_MAX_COLUMNS)
+            throw std::invalid_argument("Unsupported number of columns");
+
+        memset(&header_, 0, sizeof(header_));
+        memcpy(header_.magic, COLUMNAR_MAGIC, sizeof(header_.magic));
+        header_.version = COLUMNAR_VERSION;
+        header_.num_of_columns = (uint32_t) columns.size();
+        header_.num_of_rows = num_of_rows;
+        header_.batch_size = batch_size;
+
+        uint64_t offset = COLUMNAR_PAGE_SIZE;
+        for (const auto& name : columns) {
+            if (name.size() >= sizeof(ColumnHeader::name))
+                throw std::invalid_argument("Column name too long: " + name);
+
+            ColumnHeader col;
+            memset(&col, 0, sizeof(col));
+            memcpy(col.name, name.data(), name.size());
+            col.type = COL_TYPE_INT32;
+            col.encoding = COL_ENCODING_PLAIN;
+            col.offset = offset;
+            col.length = num_of_rows * sizeof(int32_t);
+            columns_.push_back(col);
+            offset = alignToPage(offset + col.length);
+        }
+
+        uint32_t num_of_batches = numOfBatches(num_of_rows, batch_size);
+        for (auto& col : columns_) {
+            col.stats_offset = offset;
+            offset = alignToPage(offset + num_of_batches * sizeof(BatchStats));
+            stats_.emplace_back(num_of_batches, BatchStats{INT32_MAX, INT32_MIN});
+        }
+
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+            throw std::runtime_error("Cannot create " + path);
+        if (ftruncate(fd_, (off_t) offset) != 0) {
+            // the destructor does not run for a constructor that throws
+            ::close(fd_);
+            fd_ = -1;
+            throw std::runtime_error("Cannot resize " + path);
+        }
+    }
+
+    ~ColumnarFileWriter() {
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    uint32_t getNumOfColumns() const {
+        return header_.num_of_columns;
+    }
+
+    /**
+     * Write n values of column col_idx starting at row.
+     */
+    void writeColumn(uint32_t col_idx, uint64_t row, const int32_t *values, uint32_t n) {
+        const ColumnHeader& col = columns_[col_idx];
+        if (row + n > header_.num_of_rows)
+            throw std::invalid_argument("Write past the end of the column");
+
+        pwriteAll_(values, (size_t) n * sizeof(int32_t), col.offset + row * sizeof(int32_t));
+    }
+
+    /**
+     * Fold n values written at row into the stats of their batches.
+     * Thread-safe.
+     */
+    void updateStats(uint32_t col_idx, uint64_t row, const int32_t *values, uint32_t n) {
+        std::vector<BatchStats> local{};
+        uint32_t batch_size = header_.batch_size;
+        auto first_batch = (uint32_t) (row / batch_size);
+        for (uint32_t i = 0; i < n; ) {
+            uint64_t batch_end = (row + i) / batch_size * batch_size + batch_size;
+            auto m = (uint32_t) std::min<uint64_t>(n - i, batch_end - (row + i));
+            BatchStats bs{INT32_MAX, INT32_MIN};
+            for (uint32_t j = i; j < i + m; j++) {
+                bs.min = values[j] < bs.min ? values[j] : bs.min;
+                bs.max = values[j] > bs.max ? values[j] : bs.max;
+            }
+            local.push_back(bs);
+            i += m;
+        }
+
+        std::lock_guard<std::mutex> guard(stats_mutex_);
+        auto& stats = stats_[col_idx];
+        for (uint32_t b = 0; b < local.size(); b++) {
+            BatchStats& bs = stats[first_batch + b];
+            bs.min = std::min(bs.min, local[b].min);
+            bs.max = std::max(bs.max, local[b].max);
+        }
+    }
+
+    /**
+     * Append a batch; the columns are matched by name.
+     */
+    void append(BatchResult *br) {
+        uint32_t n = br->getn();
+        for (uint32_t i = 0; i < columns_.size(); i++) {
+            int32_t *values = br->getCol(columns_[i].name)->col;
+            writeColumn(i, rows_written_, values, n);
+            updateStats(i, rows_written_, values, n);
+        }
+        rows_written_ += n;
+    }
+
+    /**
+     * Write the stats and the headers. Call after all values are written.
+     */
+    void finish() {
+        for (uint32_t i = 0; i < columns_.size(); i++)
+            pwriteAll_(stats_[i].data(), stats_[i].size() * sizeof(BatchStats), columns_[i].stats_offset);
+
+        std::vector<char> page(COLUMNAR_PAGE_SIZE, 0);
+        memcpy(page.data(), &header_, sizeof(header_));
+        memcpy(page.data() + sizeof(header_), columns_.data(), columns_.size() * sizeof(ColumnHeader));
+        pwriteAll_(page.data(), page.size(), 0);
+        if (fsync(fd_) != 0)
+            throw std::runtime_error("fsync failed");
+    }
+
+private:
+    void pwriteAll_(const void *buf, size_t len, uint64_t offset) {
+        auto p = static_cast<const char*>(buf);
+        while (len > 0) {
+            ssize_t rc = pwrite(fd_, p, len, (off_t) offset);
+            if (rc <= 0)
+                throw std::runtime_error("pwrite failed");
+            p += rc;
+            len -= (size_t) rc;
+            offset += (uint64_t) rc;
+        }
+    }
+};
+
+
+/**
+ * A table file mapped read-only into memory.
+ */
+class ColumnarFile {
+private:
+    std::string path_;
+    int fd_;
+    char *base_;
+    size_t size_;
+    const FileHeader *header_;
+    const ColumnHeader *columns_;
+
+    void open_() {
+        fd_ = ::open(path_.c_str(), O_RDONLY);
+        if (fd_ < 0)
+            throw std::runtime_error("Cannot open " + path_);
+
+        struct stat stat_buf;
+        if (fstat(fd_, &stat_buf) != 0 || (uint64_t) stat_buf.st_size < COLUMNAR_PAGE_SIZE)
+            throw std::runtime_error("Not a columnar file: " + path_);
+        size_ = (size_t) stat_buf.st_size;
+
+        void *addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("mmap failed: " + path_);
+        base_ = static_cast<char*>(addr);
+        madvise(base_, size_, MADV_SEQUENTIAL);
+
+        header_ = reinterpret_cast<const FileHeader*>(base_);
+        columns_ = reinterpret_cast<const ColumnHeader*>(base_ + sizeof(FileHeader));
+        if (memcmp(header_->magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) != 0 ||
+            header_->version != COLUMNAR_VERSION ||
+            header_->num_of_columns > COLUMNAR_MAX_COLUMNS ||
+            header_->batch_size == 0)
+            throw std::runtime_error("Not a columnar file: " + path_);
+
+        for (uint32_t i = 0; i < header_->num_of_columns; i++) {
+            uint64_t stats_length = getNumOfBatches() * sizeof(BatchStats);
+            if (columns_[i].encoding > COL_ENCODING_DELTA)
+                throw std::runtime_error("Unknown encoding in " + path_);
+            if (columns_[i].offset > size_ || columns_[i].length > size_ - columns_[i].offset ||
+                (columns_[i].stats_offset != 0 &&
+                 (columns_[i].stats_offset > size_ || stats_length > size_ - columns_[i].stats_offset)))
+                throw std::runtime_error("Truncated columnar file: " + path_);
+            if (!segmentFits_(columns_[i]))
+                throw std::runtime_error("Corrupt columnar file: " + path_);
+        }
+    }
+
+    /**
+     * Whether the segment of col holds num_of_rows values: a plain one
+     * num_of_rows * 4 bytes, a compressed one an increasing block index
+     * whose blocks and padding end within length.
+     */
+    bool segmentFits_(const ColumnHeader& col) const {
+        if (col.encoding == COL_ENCODING_PLAIN)
+            return header_->num_of_rows <= col.length / sizeof(int32_t);
+
+        uint64_t num_of_batches = getNumOfBatches();
+        uint64_t index_length = (num_of_batches + 1) * sizeof(uint64_t);
+        if (col.length < index_length || col.offset % alignof(uint64_t) != 0)
+            return false;
+        const uint64_t *index = getBlockIndex(&col);
+        if (index[0] < index_length)
+            return false;
+        for (uint64_t b = 0; b < num_of_batches; b++) {
+            if (index[b + 1] < index[b])
+                return false;
+        }
+        return index[num_of_batches] <= col.length - BLOCK_PADDING;
+    }
+
+    void release_() {
+        if (base_ != nullptr)
+            munmap(base_, size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+        base_ = nullptr;
+        fd_ = -1;
+    }
+
+public:
+    explicit ColumnarFile(const std::string& path) :
+            path_(path), fd_(-1), base_(nullptr), size_(0), header_(nullptr), columns_(nullptr) {
+        // the destructor does not run for a constructor that throws
+        try {
+            open_();
+        }
+        catch (...) {
+            release_();
+            throw;
+        }
+    }
+
+    ColumnarFile(const ColumnarFile&) = delete;
+    ColumnarFile& operator=(const ColumnarFile&) = delete;
+
+    ~ColumnarFile() {
+        release_();
+    }
+
+    const std::string& getPath() const {
+        return path_;
+    }
+
+    uint64_t getNumOfRows() const {
+        return header_->num_of_rows;
+    }
+
+    uint32_t getBatchSize() const {
+        return header_->batch_size;
+    }
+
+    uint32_t getNumOfBatches() const {
+        return numOfBatches(header_->num_of_rows, header_->batch_size);
+    }
+
+    std::vector<std::string> getColumnNames() const {
+        std::vector<std::string> res{};
+        for (uint32_t i = 0; i < header_->num_of_columns; i++)
+            res.emplace_back(columns_[i].name);
+        return res;
+    }
+
+    const ColumnHeader* getColumnHeader(const std::string& name) const {
+        for (uint32_t i = 0; i < header_->num_of_columns; i++) {
+            if (name == columns_[i].name)
+                return &columns_[i];
+        }
+        throw std::invalid_argument("Unknown column " + name);
+    }
+
+    /**
+     * The values of a plain column.
+     */
+    const int32_t* getColumn(const std::string& name) const {
+        const ColumnHeader *col = getColumnHeader(name);
+        if (col->encoding != COL_ENCODING_PLAIN)
+            throw std::invalid_argument("Column " + name + " is compressed");
+        return reinterpret_cast<const int32_t*>(base_ + col->offset);
+    }
+
+    /**
+     * The block index of a compressed column (see the layout above).
+     */
+    const uint64_t* getBlockIndex(const ColumnHeader *col) const {
+        return reinterpret_cast<const uint64_t*>(base_ + col->offset);
+    }
+
+    /**
+     * Decode batch batch_idx of col into out, which has room for a batch.
+     */
+    void decodeBatch(const ColumnHeader *col, uint32_t batch_idx, int32_t *out) const {
+        uint64_t row = (uint64_t) batch_idx * header_->batch_size;
+        auto n = (uint32_t) std::min<uint64_t>(header_->batch_size, header_->num_of_rows - row);
+        if (col->encoding == COL_ENCODING_PLAIN) {
+            memcpy(out, base_ + col->offset + row * sizeof(int32_t), n * sizeof(int32_t));
+            return;
+        }
+        const uint64_t *index = getBlockIndex(col);
+        auto block = reinterpret_cast<const uint8_t*>(base_ + col->offset) + index[batch_idx];
+        decodeBlock(col->encoding, block, index[batch_idx + 1] - index[batch_idx], n, out);
+    }
+
+    /**
+     * One BatchStats per batch, or nullptr if the file has none.
+     */
+    const BatchStats* getStats(const std::string& name) const {
+        const ColumnHeader *col = getColumnHeader(name);
+        if (col->stats_offset == 0)
+            return nullptr;
+        return reinterpret_cast<const BatchStats*>(base_ + col->stats_offset);
+    }
+};
+
+
+/**
+ * Write a copy of in to path with column i stored in encodings[i]; with
+ * COL_ENCODING_AUTO the smallest encoding of the column is picked. The batch
+ * statistics are carried over.
+ */
+inline void compressColumnarFile(const ColumnarFile& in, const std::string& path, const std::vector<uint32_t>& encodings) {
+    std::vector<std::string> names = in.getColumnNames();
+    if (encodings.size() != names.size())
+        throw std::invalid_argument("One encoding per column is needed");
+
+    uint32_t batch_size = in.getBatchSize();
+    uint32_t num_of_batches = in.getNumOfBatches();
+    std::vector<int32_t> values(batch_size);
+
+    // encode every column in full, the segments are laid out afterwards
+    std::vector<ColumnHeader> headers{};
+    std::vector<std::vector<uint8_t>> segments{};
+    for (uint32_t c = 0; c < names.size(); c++) {
+        const ColumnHeader *col = in.getColumnHeader(names[c]);
+        std::vector<uint32_t> candidates{encodings[c]};
+        if (encodings[c] == COL_ENCODING_AUTO)
+            candidates = {COL_ENCODING_PLAIN, COL_ENCODING_BITPACK, COL_ENCODING_RLE, COL_ENCODING_DELTA};
+
+        std::vector<uint8_t> best{};
+        uint32_t best_encoding = COL_ENCODING_PLAIN;
+        for (uint32_t encoding : candidates) {
+            std::vector<uint8_t> segment{};
+            if (encoding != COL_ENCODING_PLAIN)
+                segment.resize((num_of_batches + 1) * sizeof(uint64_t));
+            for (uint32_t b = 0; b < num_of_batches; b++) {
+                uint64_t row = (uint64_t) b * batch_size;
+                auto n = (uint32_t) std::min<uint64_t>(batch_size, in.getNumOfRows() - row);
+                if (encoding != COL_ENCODING_PLAIN)
+                    reinterpret_cast<uint64_t*>(segment.data())[b] = segment.size();
+                in.decodeBatch(col, b, values.data());
+                encodeBlock(encoding, values.data(), n, &segment);
+            }
+            if (encoding != COL_ENCODING_PLAIN) {
+                reinterpret_cast<uint64_t*>(segment.data())[num_of_batches] = segment.size();
+                segment.resize(segment.size() + BLOCK_PADDING, 0);
+            }
+
+            if (best.empty() || segment.size() < best.size()) {
+                best.swap(segment);
+                best_encoding = encoding;
+            }
+        }
+
+        ColumnHeader header = *col;
+        header.encoding = best_encoding;
+        header.length = best.size();
+        headers.push_back(header);
+        segments.push_back(std::move(best));
+    }
+
+    uint64_t offset = COLUMNAR_PAGE_SIZE;
+    for (auto& header : headers) {
+        header.offset = offset;
+        offset = alignToPage(offset + header.length);
+    }
+    for (auto& header : headers) {
+        header.stats_offset = in.getStats(header.name) == nullptr ? 0 : offset;
+        offset = alignToPage(offset + num_of_batches * sizeof(BatchStats));
+    }
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Cannot create " + path);
+    auto write_at = [&](const void *buf, size_t len, uint64_t at) {
+        auto p = static_cast<const char*>(buf);
+        while (len > 0) {
+            ssize_t rc = pwrite(fd, p, len, (off_t) at);
+            if (rc <= 0) {
+                ::close(fd);
+                throw std::runtime_error("pwrite failed");
+            }
+            p += rc;
+            len -= (size_t) rc;
+            at += (uint64_t) rc;
+        }
+    };
+
+    if (ftruncate(fd, (off_t) offset) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot resize " + path);
+    }
+    for (uint32_t c = 0; c < headers.size(); c++) {
+        write_at(segments[c].data(), segments[c].size(), headers[c].offset);
+        const BatchStats *stats = in.getStats(headers[c].name);
+        if (stats != nullptr)
+            write_at(stats, num_of_batches * sizeof(BatchStats), headers[c].stats_offset);
+    }
+
+    FileHeader file_header;
+    memset(&file_header, 0, sizeof(file_header));
+    memcpy(file_header.magic, COLUMNAR_MAGIC, sizeof(file_header.magic));
+    file_header.version = COLUMNAR_VERSION;
+    file_header.num_of_columns = (uint32_t) headers.size();
+    file_header.num_of_rows = in.getNumOfRows();
+    file_header.batch_size = batch_size;
+
+    std::vector<char> page(COLUMNAR_PAGE_SIZE, 0);
+    memcpy(page.data(), &file_header, sizeof(file_header));
+    memcpy(page.data() + sizeof(file_header), headers.data(), headers.size() * sizeof(ColumnHeader));
+    write_at(page.data(), page.size(), 0);
+    if (fsync(fd) != 0) {
+        ::close(fd);
+        throw std::runtime_error("fsync failed");
+    }
+    ::close(fd);
+}
+
+
+/**
+ * Scans a columnar file without copying: the DbVectors of each batch point
+ * into the mapped pages. The batches follow the batch size of the file.
+ *
+ * Compressed columns are decoded into a buffer per column that is reused by
+ * every batch, so their vectors are only valid until the following next().
+ */
+class MmapScanOperator : public BaseOperator {
+private:
+    ColumnarFile *file_;
+    std::vector<std::string> columns_;
+    std::vector<const ColumnHeader*> headers_;
+    std::vector<const int32_t*> data_;
+    std::vector<std::vector<int32_t>> decoded_;
+    uint32_t batch_size_;
+    uint64_t num_of_rows_;
+    uint64_t row_;
+
+public:
+    MmapScanOperator(ColumnarFile *file, std::vector<std::string> columns) :
+            file_(file),
+            columns_(std::move(columns)),
+            batch_size_(file->getBatchSize()),
+            num_of_rows_(file->getNumOfRows()),
+            row_(0) {
+    }
+
+    ~MmapScanOperator() final = default;
+
+    void open() final {
+        headers_.clear();
+        data_.clear();
+        decoded_.clear();
+        for (const auto& name : columns_) {
+            const ColumnHeader *col = file_->getColumnHeader(name);
+            headers_.push_back(col);
+            bool plain = col->encoding == COL_ENCODING_PLAIN;
+            data_.push_back(plain ? file_->getColumn(name) : nullptr);
+            decoded_.emplace_back(plain ? 0 : batch_size_);
+        }
+        row_ = 0;
+    }
+
+    void close() final {
+        // do nothing
+    }
+
+    bool reusesBatches() const final {
+        // compressed columns are decoded into the same buffers every batch
+        for (const auto& buffer : decoded_) {
+            if (!buffer.empty())
+                return true;
+        }
+        return false;
+    }
+
+    BatchResult* next() final {
+        if (row_ >= num_of_rows_)
+            return nullptr;
+
+        auto n = (uint32_t) std::min<uint64_t>(batch_size_, num_of_rows_ - row_);
+        BatchResult *br = new BatchResult();
+        for (uint32_t i = 0; i < columns_.size(); i++) {
+            if (data_[i] != nullptr) {
+                br->add(columns_[i], new DbVector<int32_t>(n, const_cast<int32_t*>(data_[i] + row_)));
+            }
+            else {
+                file_->decodeBatch(headers_[i], (uint32_t) (row_ / batch_size_), decoded_[i].data());
+                br->add(columns_[i], new DbVector<int32_t>(n, decoded_[i].data()));
+            }
+        }
+
+        row_ += n;
+        return br;
+    }
+};
+
+
+#endif //PROJECT_COLUMNAR_FILE_H
@@ -2,59 +2,200 @@
 #define PROJECT_COMMON_H
 
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 #include <map>
 #include <string>
 #include <iostream>
-
-
+#include <memory>
+#include <functional>
+#include "string_vector.h"
+#include "datagen.h"
+
+
+/**
+ * Default number of values per batch. Plans take the vector size as a
+ * parameter (see ScanOperator), vector_size.h can pick one for the machine.
+ */
+const uint32_t DEFAULT_VECTOR_SIZE = 1024;
+
+
+/**
+ * Number of batches of vector_size values needed to cover num_of_rows.
+ */
+inline uint32_t numOfBatches(uint64_t num_of_rows, uint32_t vector_size) {
+    return (uint32_t) ((num_of_rows + vector_size - 1) / vector_size);
+}
+
+
+/**
+ * Number of 64-bit words of a validity bitmap covering n values.
+ */
+inline uint32_t validityWords(uint32_t n) {
+    return (n + 63) / 64;
+}
+
+
+/**
+ * A column of a batch.
+ *
+ * validity is an optional bitmap with one bit per value (bit i of word i/64,
+ * set = not NULL). nullptr means the vector has no NULLs, which is the fast
+ * path every primitive checks first.
+ *
+ * DbVector(n, col) wraps memory owned by someone else (e.g. a mapped file),
+ * which is not freed with the vector.
+ */
 template<class T>
 struct DbVector {
     uint32_t n;
     uint32_t capacity;
     T *col;
+    uint64_t *validity;
+    bool owns_col;
 
     DbVector(uint32_t n, T *col) :
-            n(n), capacity(n), col(col) {}
+            n(n), capacity(n), col(col), validity(nullptr), owns_col(false) {}
 
-    DbVector(uint32_t n) : n(n), capacity(n) {
+    DbVector(uint32_t n) : n(n), capacity(n), validity(nullptr), owns_col(true) {
         col = new T[n];
     }
 
-    DbVector(const DbVector& vec) : n(vec.n), capacity(vec.capacity), col(nullptr) {
+    DbVector(const DbVector& vec) : n(vec.n), capacity(vec.capacity), col(nullptr), validity(nullptr), owns_col(true) {
         col = new T[n];
-        memcpy(col, vec.col, sizeof(uint32_t)*n);
+        memcpy(col, vec.col, sizeof(T)*n);
+        if (vec.validity != nullptr) {
+            validity = new uint64_t[validityWords(n)];
+            memcpy(validity, vec.validity, sizeof(uint64_t)*validityWords(n));
+        }
     }
 
     ~DbVector() {
         // std::cout << (uint64_t)col << " deleted\n";
-        delete col;
+        if (owns_col)
+            delete[] col;
+        delete[] validity;
+    }
+
+    bool hasNulls() const {
+        return validity != nullptr;
+    }
+
+    bool isNull(uint32_t i) const {
+        return validity != nullptr && ((validity[i >> 6] >> (i & 63)) & 1) == 0;
+    }
+
+    void setNull(uint32_t i) {
+        if (validity == nullptr) {
+            validity = new uint64_t[validityWords(capacity)];
+            memset(validity, 0xff, sizeof(uint64_t)*validityWords(capacity));
+        }
+        validity[i >> 6] &= ~(1ull << (i & 63));
+    }
+
+    /**
+     * Take ownership of a bitmap (or drop the current one with nullptr).
+     */
+    void setValidity(uint64_t *bitmap) {
+        delete[] validity;
+        validity = bitmap;
     }
 };
 
 
+/**
+ * Bit i of a validity bitmap, 1 if value i is not NULL.
+ */
+inline uint64_t validBit(const uint64_t *validity, uint32_t i) {
+    return (validity[i >> 6] >> (i & 63)) & 1;
+}
+
+
+/**
+ * res = v1 AND v2, word by word. Either input may be nullptr (no NULLs);
+ * the result is nullptr when both are, so the no-NULL fast path survives
+ * a whole expression.
+ */
+inline uint64_t* validity_and(uint32_t n, const uint64_t *v1, const uint64_t *v2) {
+    if (v1 == nullptr && v2 == nullptr)
+        return nullptr;
+
+    uint32_t words = validityWords(n);
+    auto res = new uint64_t[words];
+    if (v1 == nullptr) {
+        memcpy(res, v2, sizeof(uint64_t)*words);
+    }
+    else if (v2 == nullptr) {
+        memcpy(res, v1, sizeof(uint64_t)*words);
+    }
+    else {
+        for (uint32_t i = 0; i < words; i++)
+            res[i] = v1[i] & v2[i];
+    }
+    return res;
+}
+
+
+/**
+ * Validity of the values picked by a selection vector, as a dense bitmap of
+ * n bits. Returns nullptr if the source has no NULLs.
+ */
+inline uint64_t* validity_gather(uint32_t n, const uint64_t *validity, const uint32_t *sel) {
+    if (validity == nullptr)
+        return nullptr;
+
+    auto res = new uint64_t[validityWords(n)];
+    memset(res, 0, sizeof(uint64_t)*validityWords(n));
+    for (uint32_t i = 0; i < n; i++) {
+        res[i >> 6] |= validBit(validity, sel[i]) << (i & 63);
+    }
+    return res;
+}
+
+
+/**
+ * res[t] = col[idx[t]]
+ */
+inline uint32_t gather_int32_col(uint32_t n, int32_t *res, const int32_t *col, const uint32_t *idx) {
+    for (uint32_t t = 0; t < n; t++)
+        res[t] = col[idx[t]];
+    return n;
+}
+
+
+/**
+ * A batch of columns. String columns live in str_data and the bytes of their
+ * long values in heap, which is created by the first string column.
+ */
 struct BatchResult {
     std::map<std::string, DbVector<int32_t>*> data;
+    std::map<std::string, DbVector<DbString>*> str_data;
     DbVector<uint32_t> *res_sel;
+    StringHeap *heap;
 
-    BatchResult(const std::vector<std::string>& col_names, uint32_t n) : res_sel(nullptr) {
+    BatchResult(const std::vector<std::string>& col_names, uint32_t n) : res_sel(nullptr), heap(nullptr) {
         for (const auto& name : col_names) {
             DbVector<int32_t>* v = new DbVector<int32_t>(n);
             data[name] = v;
         }
     }
 
-    BatchResult() : data() {
+    BatchResult() : data(), res_sel(nullptr), heap(nullptr) {
     }
 
     ~BatchResult() {
         for (auto& elem : data) {
             delete elem.second;
         }
+        for (auto& elem : str_data) {
+            delete elem.second;
+        }
         delete res_sel;
+        delete heap;
     }
 
 
@@ -63,6 +204,13 @@ struct BatchResult {
     }
 
 
+    void addStr(const std::string& col_name, DbVector<DbString>* vec) {
+        str_data[col_name] = vec;
+        if (heap == nullptr)
+            heap = new StringHeap();
+    }
+
+
     void remove(const std::string& col_name) {
         auto vec = data[col_name];
         data.erase(col_name);
@@ -75,41 +223,44 @@ struct BatchResult {
     }
 
 
+    DbVector<DbString>* getStrCol(const std::string& col_name) {
+        return str_data[col_name];
+    }
+
+
     uint32_t getn() {
+        if (data.empty())
+            return str_data.begin()->second->n;
         const auto& itr = data.begin();
         return itr->second->n;
     }
 
 
     void print() {
-        std::vector<std::string> col_names{};
-        for (const auto& elem : data) {
-            col_names.push_back(elem.first);
+        for (const auto& elem : data)
+            std::cout << elem.first << "\t\t";
+        for (const auto& elem : str_data)
             std::cout << elem.first << "\t\t";
-        }
         std::cout << "\n=========================================================\n";
 
-        if (res_sel == nullptr) {
-            uint32_t n = data[col_names[0]]->n;
-            for (uint32_t i = 0; i < n; i++) {
-                for (const auto &key : col_names) {
-                    DbVector<int32_t> *v = data[key];
-                    int32_t val;
-                    val = v->col[i];
-                    std::cout << val << "\t\t";
-                }
-                std::cout << "\n";
+        uint32_t n = res_sel == nullptr ? getn() : res_sel->n;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t idx = res_sel == nullptr ? i : res_sel->col[i];
+            for (const auto& elem : data) {
+                DbVector<int32_t> *v = elem.second;
+                if (v->isNull(idx))
+                    std::cout << "NULL\t\t";
+                else
+                    std::cout << v->col[idx] << "\t\t";
             }
-        }
-        else {
-            uint32_t n = res_sel->n;
-            for (uint32_t i = 0; i < n; i++) {
-                for (const auto &key : col_names) {
-                    DbVector<int32_t> *v = data[key];
-                    std::cout << v->col[res_sel->col[i]] << "\t\t";
-                }
-                std::cout << "\n";
+            for (const auto& elem : str_data) {
+                DbVector<DbString> *v = elem.second;
+                if (v->isNull(idx))
+                    std::cout << "NULL\t\t";
+                else
+                    std::cout << v->col[idx] << "\t\t";
             }
+            std::cout << "\n";
         }
     }
 };
@@ -131,27 +282,111 @@ public:
     virtual BatchResult* next() {
         throw std::invalid_argument("Not supported");
     }
+
+    /**
+     * Whether the batches of next() point into buffers the operator reuses,
+     * so that they are only valid until the following next(). An operator
+     * that keeps such a batch longer must copy it.
+     */
+    virtual bool reusesBatches() const {
+        return false;
+    }
 };
 
 
+/**
+ * A predicate an operator learns while running and pushes down into a scan
+ * (sideways information passing), e.g. the keys of a join build side; see
+ * runtime_filter.h. It may let rows through that the operator drops
+ * anyway, but never drops one the operator keeps.
+ */
+class RuntimeFilter {
+public:
+    virtual ~RuntimeFilter() = default;
+
+    virtual const std::string& getColName() const = 0;
+
+    /**
+     * res_sel = the rows sel[j] (j without sel), j < n, whose col value may
+     * pass; returns their number. res_sel may be sel.
+     */
+    virtual uint32_t filter(uint32_t n, uint32_t *res_sel, const int32_t *col, const uint32_t *sel) const = 0;
+};
+
+
+// A pushed filter pruning less than RUNTIME_FILTER_MIN_PRUNING_PERCENT of
+// the rows of RUNTIME_FILTER_SAMPLE_BATCHES batches is switched off for
+// RUNTIME_FILTER_RETRY_BATCHES batches, then sampled again.
+#define RUNTIME_FILTER_SAMPLE_BATCHES       16
+#define RUNTIME_FILTER_MIN_PRUNING_PERCENT  10
+#define RUNTIME_FILTER_RETRY_BATCHES        1024
+
+
+/**
+ * Generates num_of_rows rows in batches of vector_size, the last one
+ * shorter if vector_size does not divide num_of_rows. The values come from a DataGenerator
+ * (datagen.h); the short constructor draws every column uniformly from
+ * [0, value_range). With initialize == false the vectors are left as
+ * allocated, which measures the operators without the generation cost.
+ *
+ * Filters pushed by pushFilter() run on every batch right after it is
+ * generated and leave the rows passing all of them in res_sel; batches
+ * without such rows are skipped. A filter that does not prune enough to pay
+ * for itself is switched off for a while (see above).
+ */
 class ScanOperator : public BaseOperator {
 private:
-    uint32_t num_of_batches_;
+    struct PushedFilter {
+        std::shared_ptr<const RuntimeFilter> filter;
+        bool enabled;
+        uint32_t batches;   // sampled while enabled, skipped while not
+        uint64_t rows_in;
+        uint64_t rows_out;
+    };
+
+    uint64_t num_of_rows_;
     std::vector<std::string> columns_;
     bool initialize_;
-    int32_t value_range_;
+    uint32_t vector_size_;
+    DataGenerator generator_;
+    uint32_t batch_idx_;
+    std::vector<PushedFilter> filters_;
+
+    static std::vector<ColumnSpec> uniformSpecs_(const std::vector<std::string>& columns, int32_t value_range) {
+        std::vector<ColumnSpec> specs{};
+        for (const auto& name : columns)
+            specs.emplace_back(name, DIST_UNIFORM, value_range);
+        return specs;
+    }
 
 public:
-    ScanOperator(uint32_t num_of_batches,
+    static const uint64_t DEFAULT_SEED = 42;
+
+    ScanOperator(uint64_t num_of_rows,
                  std::vector<std::string> columns,
                  bool initialize,
-                 int32_t value_range) :
-            num_of_batches_(num_of_batches),
+                 int32_t value_range,
+                 uint32_t vector_size = DEFAULT_VECTOR_SIZE) :
+            num_of_rows_(num_of_rows),
             columns_(std::move(columns)),
             initialize_(initialize),
-            value_range_(value_range)
+            vector_size_(vector_size),
+            generator_(uniformSpecs_(columns_, value_range), DEFAULT_SEED, num_of_rows),
+            batch_idx_(0)
     {}
 
+    ScanOperator(uint64_t num_of_rows,
+                 const DataGenerator& generator,
+                 uint32_t vector_size = DEFAULT_VECTOR_SIZE) :
+            num_of_rows_(num_of_rows),
+            initialize_(true),
+            vector_size_(vector_size),
+            generator_(generator),
+            batch_idx_(0) {
+        for (const auto& spec : generator_.getSpecs())
+            columns_.push_back(spec.name);
+    }
+
     ~ScanOperator() final = default;
 
     void open() final {
@@ -163,29 +398,112 @@ public:
     }
 
     BatchResult* next() final {
-        if (num_of_batches_ == 0)
-            return nullptr;
-
-        uint32_t n = 1024;
-        BatchResult *br = new BatchResult(columns_, n);
-        // fill each col using a random numbers
-        for (const auto& name : columns_) {
-            DbVector<int32_t>* v = br->data[name];
+        while ((uint64_t) batch_idx_ * vector_size_ < num_of_rows_) {
+            auto n = (uint32_t) std::min<uint64_t>(vector_size_, num_of_rows_ - (uint64_t) batch_idx_ * vector_size_);
+            BatchResult *br = new BatchResult(columns_, n);
             if (initialize_) {
-                for (uint32_t i = 0; i < n; i++) {
-                    v->col[i] = (int32_t) (rand() % value_range_);
-                }
+                std::vector<int32_t*> cols{};
+                for (const auto& name : columns_)
+                    cols.push_back(br->data[name]->col);
+                generator_.fillRows((uint64_t) batch_idx_ * vector_size_, n, cols.data());
             }
+
+            batch_idx_++;
+
+            if (filters_.empty() || applyFilters_(br) > 0)
+                return br;
+            delete br;
         }
+        return nullptr;
+    }
 
-        num_of_batches_--;
+    /**
+     * Filters the batches from the next one on by filter, after the filters
+     * pushed before it.
+     */
+    void pushFilter(std::shared_ptr<const RuntimeFilter> filter) {
+        if (std::find(columns_.begin(), columns_.end(), filter->getColName()) == columns_.end())
+            throw std::invalid_argument("no column " + filter->getColName() + " to filter");
+        filters_.push_back({std::move(filter), true, 0, 0, 0});
+    }
 
-        // printf("%d batch\n", BATCHES-num_of_batches_);
-        return br;
+    /**
+     * The number of pushed filters switched off for not pruning enough.
+     */
+    uint32_t getNumOfDisabledFilters() const {
+        uint32_t count = 0;
+        for (const auto& f : filters_)
+            count += !f.enabled;
+        return count;
+    }
+
+private:
+    uint32_t applyFilters_(BatchResult *br) {
+        uint32_t n = br->getn();
+        br->res_sel = new DbVector<uint32_t>(n);
+        uint32_t *sel = nullptr;
+        for (auto& f : filters_) {
+            if (!f.enabled) {
+                if (++f.batches < RUNTIME_FILTER_RETRY_BATCHES)
+                    continue;
+                f.enabled = true;
+                f.batches = 0;
+            }
+
+            uint32_t m = f.filter->filter(n, br->res_sel->col, br->data[f.filter->getColName()]->col, sel);
+            f.rows_in += n;
+            f.rows_out += m;
+            if (++f.batches == RUNTIME_FILTER_SAMPLE_BATCHES) {
+                // pruned (rows_in - rows_out) / rows_in
+                f.enabled = (f.rows_in - f.rows_out) * 100 >= f.rows_in * RUNTIME_FILTER_MIN_PRUNING_PERCENT;
+                f.batches = 0;
+                f.rows_in = 0;
+                f.rows_out = 0;
+            }
+            sel = br->res_sel->col;
+            n = m;
+        }
+
+        if (sel == nullptr) {
+            // every filter is switched off
+            delete br->res_sel;
+            br->res_sel = nullptr;
+            return n;
+        }
+        br->res_sel->n = n;
+        return n;
     }
 };
 
 
+/**
+ * A scan of num_of_rows rows drawn from specs (see DataGenerator).
+ */
+inline ScanOperator *makeScan(std::vector<ColumnSpec> specs, uint64_t num_of_rows,
+                              uint32_t vector_size = DEFAULT_VECTOR_SIZE,
+                              uint64_t seed = ScanOperator::DEFAULT_SEED) {
+    DataGenerator generator(std::move(specs), seed, num_of_rows);
+    return new ScanOperator(num_of_rows, generator, vector_size);
+}
+
+
+
+/**
+ * Consumer of the batches of a plan (see result_sink.h). consume() must not
+ * keep br, which is deleted right after.
+ */
+class ResultSink {
+public:
+    virtual ~ResultSink() = default;
+
+    virtual void consume(BatchResult *br) = 0;
+
+    /**
+     * Called once after the last batch.
+     */
+    virtual void finish() {}
+};
+
 
 class QueryPlan {
 private:
@@ -197,7 +515,9 @@ public:
         head_(head), print_result_(print_result) {
     }
 
-    ~QueryPlan() = default;
+    ~QueryPlan() {
+        delete head_;
+    }
 
     void open() {
         head_->open();
@@ -219,6 +539,58 @@ public:
             delete rs;
         }
     }
+
+    /**
+     * Pull all batches into sink.
+     */
+    void execute(ResultSink *sink) {
+        while (true) {
+            BatchResult *rs = head_->next();
+            if (rs == nullptr)
+                break;
+
+            sink->consume(rs);
+            delete rs;
+        }
+        sink->finish();
+    }
+};
+
+
+class MorselQueue;
+
+
+/**
+ * The per-execution bindings of a CompiledPlan: the morsels a parallel
+ * execution scans (see morsel.h, nullptr for a sequential one) and the worker
+ * that claims them.
+ */
+struct ExecutionContext {
+    MorselQueue *morsels = nullptr;
+    uint32_t worker = 0;
+};
+
+
+/**
+ * A compiled query, immutable once built. Expression nodes and generated code
+ * are created once and held by shared_ptr to const; every execution calls
+ * instantiate() for its own operator tree, which owns the cursors and buffers.
+ * Any number of threads or sessions can instantiate and run one CompiledPlan
+ * at the same time, so the compile cost is paid once per query, not once per
+ * execution.
+ */
+class CompiledPlan {
+private:
+    std::function<QueryPlan*(const ExecutionContext&)> instantiate_;
+
+public:
+    explicit CompiledPlan(std::function<QueryPlan*(const ExecutionContext&)> instantiate) :
+        instantiate_(std::move(instantiate)) {
+    }
+
+    QueryPlan* instantiate(const ExecutionContext& ctx = ExecutionContext()) const {
+        return instantiate_(ctx);
+    }
 };
 
 
@@ -0,0 +1,300 @@
+#ifndef PROJECT_COMPRESSION_H
+#define PROJECT_COMPRESSION_H
+
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+
+/**
+ * Lightweight compression of int32 columns, one block per batch so that a
+ * scan can decode any batch on its own straight into its vector.
+ *
+ *   COL_ENCODING_BITPACK  frame of reference: the batch minimum, then every
+ *                         value minus the minimum in width bits
+ *                         (small ranges such as discount and tax)
+ *   COL_ENCODING_RLE      runs of equal values as (value, end) pairs
+ *                         (sorted or clustered keys)
+ *   COL_ENCODING_DELTA    the first value, then the differences to the
+ *                         previous value bit-packed like BITPACK
+ *                         (increasing values such as dates and timestamps)
+ *
+ * Blocks are padded to 4 bytes and a decoder may read up to 8 bytes past the
+ * end of a block, so the buffer holding the last block needs that slack.
+ *
+ * The unpack loops are instantiated per bit width and 8 values at a time,
+ * with every shift and mask a constant, so the compiler unrolls and
+ * vectorizes them.
+ */
+
+
+#define COL_ENCODING_PLAIN      0
+#define COL_ENCODING_BITPACK    1
+#define COL_ENCODING_RLE        2
+#define COL_ENCODING_DELTA      3
+#define COL_ENCODING_AUTO       255     // the smallest of the above, writers only
+
+const uint32_t BLOCK_PADDING = 8;
+
+
+inline std::string encodingName(uint32_t encoding) {
+    switch (encoding)
+    {
+        case COL_ENCODING_PLAIN:    return "plain";
+        case COL_ENCODING_BITPACK:  return "bitpack";
+        case COL_ENCODING_RLE:      return "rle";
+        case COL_ENCODING_DELTA:    return "delta";
+        case COL_ENCODING_AUTO:     return "auto";
+        default:                    return "unknown";
+    }
+}
+
+
+inline uint32_t parseEncoding(const std::string& name) {
+    for (uint32_t encoding : {COL_ENCODING_PLAIN, COL_ENCODING_BITPACK, COL_ENCODING_RLE,
+                              COL_ENCODING_DELTA, COL_ENCODING_AUTO}) {
+        if (encodingName(encoding) == name)
+            return encoding;
+    }
+    throw std::invalid_argument("Unknown encoding " + name);
+}
+
+
+inline uint32_t bitWidth(uint32_t range) {
+    return range == 0 ? 0 : 32 - (uint32_t) __builtin_clz(range);
+}
+
+
+/**
+ * Pack n values in width bits each, LSB first, and append them to out.
+ */
+inline void pack(const uint32_t *values, uint32_t n, uint32_t width, std::vector<uint8_t> *out) {
+    size_t start = out->size();
+    out->resize(start + ((uint64_t) n * width + 7) / 8, 0);
+    uint8_t *p = out->data() + start;
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t bit = (uint64_t) i * width;
+        uint64_t v = (uint64_t) values[i] << (bit % 8);
+        for (uint64_t b = bit / 8; v != 0; b++, v >>= 8)
+            p[b] |= (uint8_t) v;
+    }
+}
+
+
+template<uint32_t W>
+inline void unpackWidth(const uint8_t *in, uint32_t n, uint32_t base, int32_t *out) {
+    const uint64_t mask = W == 0 ? 0 : (~0ull >> (64 - W));
+    uint32_t i = 0;
+    // 8 values take exactly W bytes
+    for (; i + 8 <= n; i += 8, in += W) {
+        for (uint32_t j = 0; j < 8; j++) {
+            uint64_t word;
+            memcpy(&word, in + j * W / 8, sizeof(word));
+            out[i + j] = (int32_t) (base + (uint32_t) ((word >> (j * W % 8)) & mask));
+        }
+    }
+    for (uint32_t j = 0; i < n; i++, j++) {
+        uint64_t word;
+        memcpy(&word, in + j * W / 8, sizeof(word));
+        out[i] = (int32_t) (base + (uint32_t) ((word >> (j * W % 8)) & mask));
+    }
+}
+
+
+typedef void (*UnpackFunc)(const uint8_t*, uint32_t, uint32_t, int32_t*);
+
+template<size_t... W>
+inline const UnpackFunc* unpackTable(std::index_sequence<W...>) {
+    static const UnpackFunc table[] = {&unpackWidth<W>...};
+    return table;
+}
+
+
+/**
+ * out[i] = base + the i-th width-bit value of in.
+ */
+inline void unpack(const uint8_t *in, uint32_t n, uint32_t width, uint32_t base, int32_t *out) {
+    static const UnpackFunc *table = unpackTable(std::make_index_sequence<33>());
+    table[width](in, n, base, out);
+}
+
+
+struct BitpackHeader {
+    int32_t base;
+    uint32_t width;
+};
+
+
+struct DeltaHeader {
+    int32_t first;
+    int32_t min_delta;
+    uint32_t width;
+};
+
+
+template<class T>
+inline void appendPod(const T& value, std::vector<uint8_t> *out) {
+    auto p = reinterpret_cast<const uint8_t*>(&value);
+    out->insert(out->end(), p, p + sizeof(T));
+}
+
+
+inline void encodeBitpack(const int32_t *values, uint32_t n, std::vector<uint8_t> *out) {
+    int32_t min = n > 0 ? values[0] : 0;
+    int32_t max = min;
+    for (uint32_t i = 0; i < n; i++) {
+        min = values[i] < min ? values[i] : min;
+        max = values[i] > max ? values[i] : max;
+    }
+
+    BitpackHeader header{min, bitWidth((uint32_t) max - (uint32_t) min)};
+    appendPod(header, out);
+    std::vector<uint32_t> offsets(n);
+    for (uint32_t i = 0; i < n; i++)
+        offsets[i] = (uint32_t) values[i] - (uint32_t) min;
+    pack(offsets.data(), n, header.width, out);
+}
+
+
+inline void encodeRle(const int32_t *values, uint32_t n, std::vector<uint8_t> *out) {
+    std::vector<int32_t> run_values{};
+    std::vector<uint32_t> run_ends{};
+    for (uint32_t i = 0; i < n; i++) {
+        if (i == 0 || values[i] != run_values.back()) {
+            run_values.push_back(values[i]);
+            run_ends.push_back(i + 1);
+        }
+        else {
+            run_ends.back() = i + 1;
+        }
+    }
+
+    appendPod((uint32_t) run_values.size(), out);
+    for (auto v : run_values)
+        appendPod(v, out);
+    for (auto e : run_ends)
+        appendPod(e, out);
+}
+
+
+inline void encodeDelta(const int32_t *values, uint32_t n, std::vector<uint8_t> *out) {
+    std::vector<uint32_t> deltas(n > 0 ? n - 1 : 0);
+    int32_t min_delta = 0;
+    int32_t max_delta = 0;
+    for (uint32_t i = 1; i < n; i++) {
+        auto d = (int32_t) ((uint32_t) values[i] - (uint32_t) values[i - 1]);
+        deltas[i - 1] = (uint32_t) d;
+        min_delta = i == 1 || d < min_delta ? d : min_delta;
+        max_delta = i == 1 || d > max_delta ? d : max_delta;
+    }
+
+    DeltaHeader header{n > 0 ? values[0] : 0, min_delta, bitWidth((uint32_t) max_delta - (uint32_t) min_delta)};
+    appendPod(header, out);
+    for (auto& d : deltas)
+        d -= (uint32_t) min_delta;
+    pack(deltas.data(), (uint32_t) deltas.size(), header.width, out);
+}
+
+
+/**
+ * Append the block of n values in encoding to out, padded to 4 bytes.
+ */
+inline void encodeBlock(uint32_t encoding, const int32_t *values, uint32_t n, std::vector<uint8_t> *out) {
+    switch (encoding)
+    {
+        case COL_ENCODING_PLAIN:
+            out->insert(out->end(), reinterpret_cast<const uint8_t*>(values),
+                        reinterpret_cast<const uint8_t*>(values + n));
+            break;
+        case COL_ENCODING_BITPACK:
+            encodeBitpack(values, n, out);
+            break;
+        case COL_ENCODING_RLE:
+            encodeRle(values, n, out);
+            break;
+        case COL_ENCODING_DELTA:
+            encodeDelta(values, n, out);
+            break;
+        default:
+            throw std::invalid_argument("Cannot encode " + encodingName(encoding));
+    }
+    out->resize((out->size() + 3) / 4 * 4, 0);
+}
+
+
+/**
+ * Decode the block of n values at block, length bytes long (plus the
+ * padding), into out. Throws if the block does not hold n values.
+ */
+inline void decodeBlock(uint32_t encoding, const uint8_t *block, uint64_t length, uint32_t n, int32_t *out) {
+    switch (encoding)
+    {
+        case COL_ENCODING_PLAIN:
+            if ((uint64_t) n * sizeof(int32_t) > length)
+                throw std::runtime_error("Corrupt plain block");
+            memcpy(out, block, n * sizeof(int32_t));
+            break;
+
+        case COL_ENCODING_BITPACK: {
+            BitpackHeader header;
+            if (length < sizeof(header))
+                throw std::runtime_error("Corrupt bitpack block");
+            memcpy(&header, block, sizeof(header));
+            if (header.width > 32 || ((uint64_t) n * header.width + 7) / 8 > length - sizeof(header))
+                throw std::runtime_error("Corrupt bitpack block");
+            unpack(block + sizeof(header), n, header.width, (uint32_t) header.base, out);
+            break;
+        }
+
+        case COL_ENCODING_RLE: {
+            uint32_t num_of_runs;
+            if (length < sizeof(num_of_runs))
+                throw std::runtime_error("Corrupt rle block");
+            memcpy(&num_of_runs, block, sizeof(num_of_runs));
+            if (num_of_runs > n || (uint64_t) num_of_runs * 2 * sizeof(int32_t) > length - sizeof(num_of_runs))
+                throw std::runtime_error("Corrupt rle block");
+            auto run_values = reinterpret_cast<const int32_t*>(block + sizeof(num_of_runs));
+            auto run_ends = reinterpret_cast<const uint32_t*>(run_values + num_of_runs);
+            uint32_t i = 0;
+            for (uint32_t r = 0; r < num_of_runs; r++) {
+                int32_t v = run_values[r];
+                uint32_t end = run_ends[r];
+                if (end > n)
+                    throw std::runtime_error("Corrupt rle block");
+                for (; i < end; i++)
+                    out[i] = v;
+            }
+            break;
+        }
+
+        case COL_ENCODING_DELTA: {
+            DeltaHeader header;
+            if (length < sizeof(header))
+                throw std::runtime_error("Corrupt delta block");
+            memcpy(&header, block, sizeof(header));
+            if (n == 0)
+                break;
+            if (header.width > 32 || ((uint64_t) (n - 1) * header.width + 7) / 8 > length - sizeof(header))
+                throw std::runtime_error("Corrupt delta block");
+            // the deltas land one slot to the right, then a running sum
+            unpack(block + sizeof(header), n - 1, header.width, (uint32_t) header.min_delta, out + 1);
+            auto acc = (uint32_t) header.first;
+            out[0] = header.first;
+            for (uint32_t i = 1; i < n; i++) {
+                acc += (uint32_t) out[i];
+                out[i] = (int32_t) acc;
+            }
+            break;
+        }
+
+        default:
+            throw std::invalid_argument("Cannot decode " + encodingName(encoding));
+    }
+}
+
+
+#endif //PROJECT_COMPRESSION_H
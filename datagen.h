@@ -0,0 +1,272 @@
+#ifndef PROJECT_DATAGEN_H
+#define PROJECT_DATAGEN_H
+
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+
+/**
+ * Deterministic synthetic data.
+ *
+ * Every (block, column) pair seeds its own random stream from the global
+ * seed, a block being DATAGEN_BLOCK_ROWS rows. A row gets the same values
+ * whichever batch it falls into, so plans with different vector sizes (or
+ * one batch for the whole table) see the same table, and batches can be
+ * generated by any thread in any order. The stream is xoshiro128+ run over 8 independent
+ * lanes, written so that the compiler turns the lane loop into SIMD code;
+ * it replaces the serialized rand() call per value.
+ *
+ * distributions:
+ *   DIST_UNIFORM     uniform in [0, range)
+ *   DIST_ZIPF        Zipf-skewed in [0, range), 0 is the most frequent value,
+ *                    param is the exponent s
+ *   DIST_SORTED      increasing with the row number over [0, range)
+ *   DIST_CLUSTERED   DIST_SORTED plus uniform noise of +-param
+ *   DIST_CORRELATED  the value of the column base plus uniform noise of
+ *                    +-param, clamped to [0, range)
+ */
+
+
+#define DIST_UNIFORM        1
+#define DIST_ZIPF           2
+#define DIST_SORTED         3
+#define DIST_CLUSTERED      4
+#define DIST_CORRELATED     5
+
+
+// the smallest vector size the tuner tries, so its batches generate no
+// random words they do not use
+#define DATAGEN_BLOCK_ROWS  64
+
+
+struct ColumnSpec {
+    std::string name;
+    int dist;
+    int32_t range;
+    double param;
+    std::string base;
+
+    ColumnSpec(std::string name, int dist, int32_t range, double param = 0, std::string base = "") :
+        name(std::move(name)), dist(dist), range(range), param(param), base(std::move(base)) {}
+};
+
+
+inline uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+
+/**
+ * 8 lanes of xoshiro128+.
+ */
+class Xoshiro128x8 {
+public:
+    static const uint32_t LANES = 8;
+
+private:
+    uint32_t s0_[LANES];
+    uint32_t s1_[LANES];
+    uint32_t s2_[LANES];
+    uint32_t s3_[LANES];
+
+    static inline uint32_t rotl_(uint32_t x, int k) {
+        return (x << k) | (x >> (32 - k));
+    }
+
+public:
+    explicit Xoshiro128x8(uint64_t seed) {
+        for (uint32_t lane = 0; lane < LANES; lane++) {
+            uint64_t a = splitmix64(&seed);
+            uint64_t b = splitmix64(&seed);
+            s0_[lane] = (uint32_t) a;
+            s1_[lane] = (uint32_t) (a >> 32);
+            s2_[lane] = (uint32_t) b;
+            s3_[lane] = (uint32_t) (b >> 32) | 1;
+        }
+    }
+
+    /**
+     * n random words; n is rounded up to a multiple of LANES, so out must
+     * have room for that.
+     */
+    void fill(uint32_t *out, uint32_t n) {
+        for (uint32_t i = 0; i < n; i += LANES) {
+            for (uint32_t lane = 0; lane < LANES; lane++) {
+                out[i + lane] = s0_[lane] + s3_[lane];
+                uint32_t t = s1_[lane] << 9;
+                s2_[lane] ^= s0_[lane];
+                s3_[lane] ^= s1_[lane];
+                s1_[lane] ^= s2_[lane];
+                s0_[lane] ^= s3_[lane];
+                s2_[lane] ^= t;
+                s3_[lane] = rotl_(s3_[lane], 11);
+            }
+        }
+    }
+};
+
+
+class DataGenerator {
+private:
+    static const uint32_t ZIPF_BUCKETS = 1u << 16;
+
+    std::vector<ColumnSpec> specs_;
+    std::vector<int32_t> bases_;
+    std::vector<std::vector<int32_t>> zipf_tables_;
+    uint64_t seed_;
+    uint64_t num_of_rows_;
+
+public:
+    DataGenerator(std::vector<ColumnSpec> specs, uint64_t seed, uint64_t num_of_rows) :
+            specs_(std::move(specs)),
+            seed_(seed),
+            num_of_rows_(num_of_rows == 0 ? 1 : num_of_rows) {
+        for (uint32_t c = 0; c < specs_.size(); c++) {
+            const ColumnSpec& spec = specs_[c];
+            if (spec.range <= 0)
+                throw std::invalid_argument("Empty range for column " + spec.name);
+
+            int32_t base = -1;
+            if (spec.dist == DIST_CORRELATED) {
+                for (uint32_t b = 0; b < c; b++) {
+                    if (specs_[b].name == spec.base)
+                        base = (int32_t) b;
+                }
+                if (base < 0)
+                    throw std::invalid_argument("Correlated column " + spec.name + " needs an earlier base column");
+            }
+            bases_.push_back(base);
+
+            zipf_tables_.emplace_back();
+            if (spec.dist == DIST_ZIPF)
+                buildZipfTable_(spec, &zipf_tables_.back());
+        }
+    }
+
+    const std::vector<ColumnSpec>& getSpecs() const {
+        return specs_;
+    }
+
+    /**
+     * Generate the n rows from first_row on; cols[c] receives column c of
+     * the specs. Thread-safe.
+     */
+    void fillRows(uint64_t first_row, uint32_t n, int32_t **cols) const {
+        std::vector<uint32_t> random(n);
+        std::vector<uint32_t> block(DATAGEN_BLOCK_ROWS);
+
+        for (uint32_t c = 0; c < specs_.size(); c++) {
+            const ColumnSpec& spec = specs_[c];
+            int32_t *out = cols[c];
+            fillRandom_(first_row, n, c, random.data(), block.data());
+            auto range = (uint64_t) spec.range;
+
+            switch (spec.dist)
+            {
+                case DIST_UNIFORM:
+                    for (uint32_t i = 0; i < n; i++)
+                        out[i] = (int32_t) ((random[i] * range) >> 32);
+                    break;
+
+                case DIST_ZIPF: {
+                    const int32_t *table = zipf_tables_[c].data();
+                    for (uint32_t i = 0; i < n; i++) {
+                        uint32_t bucket = random[i] >> 16;
+                        int32_t lo = table[bucket];
+                        int32_t hi = table[bucket + 1];
+                        out[i] = lo + (int32_t) (((uint64_t) (random[i] & 0xffff) * (uint32_t) (hi - lo)) >> 16);
+                    }
+                    break;
+                }
+
+                case DIST_SORTED:
+                    for (uint32_t i = 0; i < n; i++)
+                        out[i] = (int32_t) ((first_row + i) * range / num_of_rows_);
+                    break;
+
+                case DIST_CLUSTERED: {
+                    auto window = (int64_t) spec.param;
+                    for (uint32_t i = 0; i < n; i++) {
+                        auto v = (int64_t) ((first_row + i) * range / num_of_rows_);
+                        v += (int64_t) ((random[i] * (uint64_t) (2 * window + 1)) >> 32) - window;
+                        out[i] = (int32_t) (v < 0 ? 0 : (v >= spec.range ? spec.range - 1 : v));
+                    }
+                    break;
+                }
+
+                case DIST_CORRELATED: {
+                    const int32_t *base = cols[bases_[c]];
+                    auto noise = (int64_t) spec.param;
+                    for (uint32_t i = 0; i < n; i++) {
+                        int64_t v = base[i] + (int64_t) ((random[i] * (uint64_t) (2 * noise + 1)) >> 32) - noise;
+                        out[i] = (int32_t) (v < 0 ? 0 : (v >= spec.range ? spec.range - 1 : v));
+                    }
+                    break;
+                }
+
+                default:
+                    throw std::invalid_argument("Unknown distribution");
+            }
+        }
+    }
+
+private:
+    /**
+     * The random words of rows first_row ... first_row + n - 1 of column c
+     * into random: whole blocks straight from their streams, the blocks the
+     * rows cut through via scratch (DATAGEN_BLOCK_ROWS words).
+     */
+    void fillRandom_(uint64_t first_row, uint32_t n, uint32_t c, uint32_t *random, uint32_t *scratch) const {
+        static_assert(DATAGEN_BLOCK_ROWS % Xoshiro128x8::LANES == 0, "blocks must be whole rounds of the lanes");
+        uint64_t row = first_row;
+        uint64_t end = first_row + n;
+        while (row < end) {
+            uint64_t block = row / DATAGEN_BLOCK_ROWS;
+            auto begin = (uint32_t) (row % DATAGEN_BLOCK_ROWS);
+            auto len = (uint32_t) std::min<uint64_t>(DATAGEN_BLOCK_ROWS - begin, end - row);
+            Xoshiro128x8 rng(seed_ ^ ((block << 16) | c) * 0xD6E8FEB86659FD93ull);
+            if (len == DATAGEN_BLOCK_ROWS) {
+                rng.fill(random + (row - first_row), DATAGEN_BLOCK_ROWS);
+            }
+            else {
+                rng.fill(scratch, begin + len);
+                memcpy(random + (row - first_row), scratch + begin, sizeof(uint32_t) * len);
+            }
+            row += len;
+        }
+    }
+
+    /**
+     * Inverse CDF of the continuous Zipf approximation on [1, range + 1),
+     * sampled at ZIPF_BUCKETS + 1 quantiles. A value is drawn uniformly
+     * between the bounds of its bucket, which is exact for the heavy head
+     * (lo == hi) and fills in the sparse tail.
+     */
+    static void buildZipfTable_(const ColumnSpec& spec, std::vector<int32_t> *table) {
+        double s = spec.param;
+        double n = (double) spec.range + 1;
+        table->resize(ZIPF_BUCKETS + 1);
+        for (uint32_t k = 0; k <= ZIPF_BUCKETS; k++) {
+            double u = (double) k / ZIPF_BUCKETS;
+            double x;
+            if (std::fabs(s - 1.0) < 1e-9)
+                x = std::pow(n, u);
+            else
+                x = std::pow(1 + u * (std::pow(n, 1 - s) - 1), 1 / (1 - s));
+            auto v = (int64_t) x - 1;
+            (*table)[k] = (int32_t) (v < 0 ? 0 : (v >= spec.range ? spec.range - 1 : v));
+        }
+    }
+};
+
+
+#endif //PROJECT_DATAGEN_H
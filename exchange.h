@@ -0,0 +1,323 @@
+#ifndef PROJECT_EXCHANGE_H
+#define PROJECT_EXCHANGE_H
+
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "common.h"
+
+
+/**
+ * Pipeline parallelism: an ExchangeOperator runs the subtree below it on a
+ * thread of its own, so an expensive stage (scan, decompression) overlaps
+ * with the operators above it (selection, projection) even when the query
+ * does not split into morsels.
+ *
+ * The batches go up to the consumer through a single-producer
+ * single-consumer ring of at most depth batches; the producer stalls while
+ * it is full, which is the backpressure. A side that finds the ring empty
+ * (or full) spins for a while, as the other side is usually about to catch
+ * up, then sleeps until it is woken.
+ */
+
+
+#define EXCHANGE_SPINS  1024
+
+
+template<class T>
+class SpscRing {
+private:
+    std::vector<T> items_;
+    uint64_t mask_;
+
+    // next pop, written by the consumer only
+    alignas(64) std::atomic<uint64_t> head_;
+    uint64_t cached_tail_;
+
+    // next push, written by the producer only
+    alignas(64) std::atomic<uint64_t> tail_;
+    uint64_t cached_head_;
+
+public:
+    /**
+     * A ring of at least capacity items.
+     */
+    explicit SpscRing(uint32_t capacity) : head_(0), cached_tail_(0), tail_(0), cached_head_(0) {
+        uint64_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        items_.resize(size);
+        mask_ = size - 1;
+    }
+
+    /**
+     * Producer side; false if the ring is full.
+     */
+    bool push(const T& item) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == items_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == items_.size())
+                return false;
+        }
+        items_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer side; false if the ring is empty.
+     */
+    bool pop(T *item) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_)
+                return false;
+        }
+        *item = items_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+
+/**
+ * Where one side of a ring waits for the other: wait() returns once ready()
+ * is true, spinning EXCHANGE_SPINS times before it sleeps until notify().
+ * The other side calls notify() after every change that may make ready()
+ * true; it only pays for a lock while a waiter sleeps.
+ */
+class RingWaiter {
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<bool> sleeping_;
+
+public:
+    RingWaiter() : sleeping_(false) {}
+
+    template<class Ready>
+    void wait(Ready ready) {
+        for (uint32_t i = 0; i < EXCHANGE_SPINS; i++) {
+            if (ready())
+                return;
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleeping_.store(true, std::memory_order_relaxed);
+        // either ready() sees the change or notify() sees sleeping_
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv_.wait(lock, ready);
+        sleeping_.store(false, std::memory_order_relaxed);
+    }
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!sleeping_.load(std::memory_order_relaxed))
+            return;
+        // the waiter holds the lock from its last ready() until it sleeps
+        std::lock_guard<std::mutex> guard(mutex_);
+        cv_.notify_one();
+    }
+};
+
+
+/**
+ * Runs next on a producer thread between open() and close().
+ *
+ * The batches of next are handed up as they are. Those of a child that
+ * reusesBatches() (MmapScanOperator on compressed columns,
+ * ReadAheadScanOperator) would change under the consumer while the producer
+ * runs ahead, so their borrowed vectors are copied into one of depth
+ * buffers first and pointed there. A buffer goes back to the producer when
+ * next() is called again, so like the child's, such a batch is only valid
+ * until the following next(); batches with string columns cannot be copied.
+ *
+ * An exception of the producer is rethrown by next() once the batches before
+ * it are consumed.
+ */
+class ExchangeOperator : public BaseOperator {
+private:
+    struct Buffer {
+        std::vector<std::vector<int32_t>> cols;
+        std::vector<uint32_t> sel;
+    };
+
+    BaseOperator *next_;
+    uint32_t depth_;
+    std::vector<Buffer> buffers_;
+    // nullptr ends the batches
+    std::unique_ptr<SpscRing<BatchResult*>> full_;
+    std::unique_ptr<SpscRing<Buffer*>> free_;
+    RingWaiter consumer_waiter_;
+    RingWaiter producer_waiter_;
+    std::thread producer_;
+    std::atomic<bool> stop_;
+    std::exception_ptr error_;
+    bool copy_;
+    uint64_t consumed_;
+    bool done_;
+
+public:
+    explicit ExchangeOperator(BaseOperator *next, uint32_t depth = 4) :
+            next_(next),
+            depth_(depth == 0 ? 1 : depth),
+            stop_(false),
+            error_(nullptr),
+            copy_(false),
+            consumed_(0),
+            done_(true) {
+    }
+
+    ~ExchangeOperator() final {
+        join_();
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+
+        copy_ = next_->reusesBatches();
+        // the batches in flight and the end
+        full_.reset(new SpscRing<BatchResult*>(depth_ + 1));
+        free_.reset(new SpscRing<Buffer*>(depth_));
+        buffers_.assign(copy_ ? depth_ : 0, Buffer());
+        for (auto& buffer : buffers_)
+            free_->push(&buffer);
+        stop_.store(false, std::memory_order_relaxed);
+        error_ = nullptr;
+        consumed_ = 0;
+        done_ = false;
+        producer_ = std::thread(&ExchangeOperator::produce_, this);
+    }
+
+    void close() final {
+        join_();
+        next_->close();
+    }
+
+    bool reusesBatches() const final {
+        return copy_;
+    }
+
+    BatchResult* next() final {
+        if (done_)
+            return nullptr;
+
+        // the buffers are taken and handed up in the same order, so the
+        // buffer of the previous batch is the next one in line
+        if (copy_ && consumed_ > 0) {
+            free_->push(&buffers_[(consumed_ - 1) % depth_]);
+            producer_waiter_.notify();
+        }
+
+        BatchResult *br = nullptr;
+        consumer_waiter_.wait([&]() { return full_->pop(&br); });
+        producer_waiter_.notify();
+
+        if (br == nullptr) {
+            done_ = true;
+            if (error_ != nullptr)
+                std::rethrow_exception(error_);
+            return nullptr;
+        }
+        consumed_++;
+        return br;
+    }
+
+private:
+    bool stopped_() const {
+        return stop_.load(std::memory_order_relaxed);
+    }
+
+    void join_() {
+        if (!producer_.joinable())
+            return;
+        stop_.store(true, std::memory_order_relaxed);
+        producer_waiter_.notify();
+        producer_.join();
+        done_ = true;
+
+        // the batches nobody asked for
+        BatchResult *br = nullptr;
+        while (full_->pop(&br))
+            delete br;
+    }
+
+    /**
+     * Pushes br (nullptr for the end) unless the consumer stopped first;
+     * false then.
+     */
+    bool push_(BatchResult *br) {
+        bool pushed = false;
+        producer_waiter_.wait([&]() { return stopped_() || (pushed = full_->push(br)); });
+        if (pushed)
+            consumer_waiter_.notify();
+        return pushed;
+    }
+
+    void produce_() {
+        try {
+            while (!stopped_()) {
+                Buffer *buffer = nullptr;
+                if (copy_) {
+                    producer_waiter_.wait([&]() { return stopped_() || free_->pop(&buffer); });
+                    if (buffer == nullptr)
+                        break;
+                }
+
+                std::unique_ptr<BatchResult> br(next_->next());
+                if (br == nullptr)
+                    break;
+                if (copy_)
+                    copyBatch_(br.get(), buffer);
+                if (!push_(br.get()))
+                    break;
+                br.release();
+            }
+        }
+        catch (...) {
+            error_ = std::current_exception();
+        }
+        push_(nullptr);
+    }
+
+    /**
+     * Points the borrowed vectors of br into buffer.
+     */
+    static void copyBatch_(BatchResult *br, Buffer *buffer) {
+        if (!br->str_data.empty())
+            throw std::invalid_argument("ExchangeOperator cannot copy string columns");
+
+        buffer->cols.resize(br->data.size());
+        uint32_t i = 0;
+        for (auto& elem : br->data) {
+            DbVector<int32_t> *vec = elem.second;
+            std::vector<int32_t>& col = buffer->cols[i++];
+            if (vec->owns_col)
+                continue;
+            col.assign(vec->col, vec->col + vec->n);
+            vec->col = col.data();
+        }
+
+        DbVector<uint32_t> *sel = br->res_sel;
+        if (sel != nullptr && !sel->owns_col) {
+            buffer->sel.assign(sel->col, sel->col + sel->n);
+            sel->col = buffer->sel.data();
+        }
+    }
+};
+
+
+#endif //PROJECT_EXCHANGE_H
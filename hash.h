@@ -0,0 +1,43 @@
+#ifndef PROJECT_HASH_H
+#define PROJECT_HASH_H
+
+
+#include <cstdint>
+
+
+/**
+ * Hashing of int32 keys for hash tables: the finalizer of MurmurHash3. It
+ * takes only multiplies, shifts and xors, so the column primitive
+ * vectorizes, and every bit of the key affects the low bits a table masks
+ * with.
+ */
+
+
+inline uint32_t hashInt32(int32_t key) {
+    auto h = (uint32_t) key;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+
+/**
+ * res[j] = hash of col[sel[j]] (col[j] without sel), dense in j.
+ */
+inline uint32_t hash_int32_col(uint32_t n, uint32_t *res, const int32_t *col, const uint32_t *sel) {
+    if (sel != nullptr) {
+        for (uint32_t j = 0; j < n; j++)
+            res[j] = hashInt32(col[sel[j]]);
+    }
+    else {
+        for (uint32_t j = 0; j < n; j++)
+            res[j] = hashInt32(col[j]);
+    }
+    return n;
+}
+
+
+#endif //PROJECT_HASH_H
@@ -0,0 +1,518 @@
+#ifndef PROJECT_JIT_H
+#define PROJECT_JIT_H
+
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+/**
+ * Generated code: C++ source is compiled into a shared object by the system
+ * compiler and loaded with dlopen, as bfjit/bytecodejit.cpp does.
+ *
+ * Compiling takes hundreds of milliseconds, longer than many queries, so a
+ * BackgroundCompilation does it on a thread of its own. The query starts on
+ * the vectorized primitives and polls the compilation at every batch
+ * boundary; once the function is there it switches over. Short queries never
+ * wait for the compiler (it is killed when the query is over first) and long
+ * ones still end up on the generated code.
+ *
+ * The compiler is $JIT_CXX, c++ by default.
+ *
+ * Compiled kernels are cached by a KernelCache, in memory and in the
+ * directory $JIT_CACHE_DIR, so a query shape seen before (in this process
+ * or an earlier one) costs a dlopen instead of a compilation.
+ */
+
+
+const char* const JIT_FLAGS = "-O3 -march=native -shared -fPIC";
+
+
+inline std::string jitCompiler() {
+    const char *cxx = getenv("JIT_CXX");
+    return cxx != nullptr && cxx[0] != '\0' ? cxx : "c++";
+}
+
+
+/**
+ * Lets another thread stop a compilation: the compiler runs in a process
+ * group of its own, which cancel() kills.
+ */
+class CompileCancellation {
+private:
+    std::mutex mutex_;
+    pid_t compiler_ = 0;
+    bool cancelled_ = false;
+
+public:
+    void cancel() {
+        std::lock_guard<std::mutex> guard(mutex_);
+        cancelled_ = true;
+        if (compiler_ > 0)
+            kill(-compiler_, SIGKILL);
+    }
+
+    /**
+     * Run cmdline through the shell, its stdout and stderr into output; the
+     * exit status, -1 if it could not run or was cancelled before.
+     */
+    int run(const std::string& cmdline, std::string *output) {
+        int fds[2];
+        if (pipe(fds) != 0)
+            return -1;
+
+        pid_t pid;
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            pid = cancelled_ ? -1 : fork();
+            if (pid == 0) {
+                setpgid(0, 0);
+                dup2(fds[1], STDOUT_FILENO);
+                dup2(fds[1], STDERR_FILENO);
+                close(fds[0]);
+                close(fds[1]);
+                execl("/bin/sh", "sh", "-c", cmdline.c_str(), (char*) nullptr);
+                _exit(127);
+            }
+            if (pid > 0) {
+                // the group exists before anyone kills it
+                setpgid(pid, pid);
+                compiler_ = pid;
+            }
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            return -1;
+        }
+
+        char buffer[256];
+        ssize_t n;
+        while ((n = read(fds[0], buffer, sizeof(buffer))) > 0 || (n < 0 && errno == EINTR)) {
+            if (n > 0)
+                output->append(buffer, (size_t) n);
+        }
+        close(fds[0]);
+
+        {
+            // until it is reaped the pid (and the group) cannot be reused
+            std::lock_guard<std::mutex> guard(mutex_);
+            compiler_ = 0;
+        }
+        int status;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR)
+                return -1;
+        }
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+};
+
+
+/**
+ * A shared object compiled from source, unloaded with the object.
+ *
+ * With a keep_as path the object is moved there once it compiled (by a
+ * rename, so others see either no file or a whole one) instead of being
+ * deleted. The temporary directory is created next to it, on the same
+ * file system.
+ */
+class JitLibrary {
+private:
+    void *handle_;
+
+    explicit JitLibrary(void *handle) : handle_(handle) {}
+
+public:
+    JitLibrary(const std::string& source,
+               const std::string& flags = JIT_FLAGS,
+               CompileCancellation *cancellation = nullptr,
+               const std::string& keep_as = "") : handle_(nullptr) {
+        std::string pattern = keep_as.empty() ? "/tmp/jitXXXXXX" : keep_as + ".XXXXXX";
+        std::vector<char> dir(pattern.begin(), pattern.end());
+        dir.push_back('\0');
+        if (mkdtemp(dir.data()) == nullptr)
+            throw std::runtime_error("Cannot create a directory for generated code");
+        std::string src_path = std::string(dir.data()) + "/kernel.cpp";
+        std::string so_path = std::string(dir.data()) + "/kernel.so";
+
+        {
+            std::ofstream out(src_path);
+            out << source;
+        }
+        std::string cmdline = jitCompiler() + " " + flags + " " + src_path + " -o " + so_path;
+        std::string output;
+        CompileCancellation own;
+        int status = (cancellation != nullptr ? cancellation : &own)->run(cmdline, &output);
+
+        // the mapping stays valid once the file is gone
+        if (status == 0)
+            handle_ = dlopen(so_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        const char *dl_error = handle_ == nullptr && status == 0 ? dlerror() : nullptr;
+        unlink(src_path.c_str());
+        if (handle_ == nullptr || keep_as.empty() || rename(so_path.c_str(), keep_as.c_str()) != 0)
+            unlink(so_path.c_str());
+        rmdir(dir.data());
+
+        if (status != 0)
+            throw std::runtime_error("Cannot compile generated code: " + cmdline + "\n" + output);
+        if (handle_ == nullptr)
+            throw std::runtime_error(std::string("Cannot load generated code: ") + (dl_error != nullptr ? dl_error : ""));
+    }
+
+    /**
+     * The shared object at path, compiled before; nullptr if it cannot be
+     * loaded.
+     */
+    static std::unique_ptr<JitLibrary> load(const std::string& path) {
+        void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        return std::unique_ptr<JitLibrary>(handle != nullptr ? new JitLibrary(handle) : nullptr);
+    }
+
+    JitLibrary(const JitLibrary&) = delete;
+    JitLibrary& operator=(const JitLibrary&) = delete;
+
+    ~JitLibrary() {
+        if (handle_ != nullptr)
+            dlclose(handle_);
+    }
+
+    void* getSymbol(const std::string& name) const {
+        void *symbol = dlsym(handle_, name.c_str());
+        if (symbol == nullptr)
+            throw std::runtime_error("No symbol " + name + " in generated code");
+        return symbol;
+    }
+};
+
+
+/**
+ * Compiled kernels by a fingerprint of everything that decides their
+ * machine code: the source with its comments and layout normalized away,
+ * the compiler and its flags, and the CPU (for -march=native). A library
+ * stays loaded for the rest of the process once it was asked for, and is
+ * kept as <fingerprint>.so in the directory $JIT_CACHE_DIR
+ * ($HOME/.cache/jit_vectorize by default, empty for no disk cache), where
+ * the next process finds it. The disk cache is off when the directory is
+ * not a private directory of the user (see isPrivateDir_).
+ *
+ * The version of the compiler is not part of the fingerprint, as asking it
+ * would cost a process per lookup: clear the directory after upgrading it.
+ */
+class KernelCache {
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<const JitLibrary>> libraries_;
+    std::string dir_;
+
+    static std::string defaultDir_() {
+        const char *dir = getenv("JIT_CACHE_DIR");
+        if (dir != nullptr)
+            return dir;
+        const char *home = getenv("HOME");
+        if (home != nullptr && home[0] != '\0')
+            return std::string(home) + "/.cache/jit_vectorize";
+        return "/tmp/jit_vectorize-" + std::to_string(getuid());
+    }
+
+    /**
+     * Creates dir (private to the user) and its parents; false if it is not
+     * there afterwards.
+     */
+    static bool makeDirs_(const std::string& dir) {
+        for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+            std::string prefix = dir.substr(0, pos);
+            if (mkdir(prefix.c_str(), pos == std::string::npos ? 0700 : 0755) != 0 && errno != EEXIST)
+                return false;
+            if (pos == std::string::npos)
+                return true;
+        }
+    }
+
+    /**
+     * Whether only the user can put libraries into dir: the process loads
+     * whatever it finds there, so a directory that another user owns or can
+     * write to (e.g. one planted in /tmp) must not be trusted. A symlink is
+     * refused as well, since its target may change after the check.
+     */
+    static bool isPrivateDir_(const std::string& dir) {
+        struct stat stat_buf;
+        if (lstat(dir.c_str(), &stat_buf) != 0)
+            return false;
+        return S_ISDIR(stat_buf.st_mode) && stat_buf.st_uid == getuid() &&
+               (stat_buf.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+    }
+
+    /**
+     * The lines of /proc/cpuinfo describing the first CPU that -march=native
+     * looks at (x86 and ARM names).
+     */
+    static const std::string& cpuDescription_() {
+        static const std::string description = []() {
+            static const char* const KEYS[] = {"vendor_id", "cpu family", "model", "flags",
+                                               "CPU implementer", "CPU architecture", "CPU variant", "CPU part", "Features"};
+            std::string res;
+            std::ifstream in("/proc/cpuinfo");
+            std::string line;
+            while (std::getline(in, line) && !line.empty()) {
+                std::string key = line.substr(0, line.find_last_not_of(" \t", line.find(':') - 1) + 1);
+                for (const char *k : KEYS) {
+                    if (key == k)
+                        res += line + "\n";
+                }
+            }
+            return res;
+        }();
+        return description;
+    }
+
+    static uint64_t fnv1a_(const std::string& s, uint64_t hash) {
+        for (unsigned char c : s) {
+            hash ^= c;
+            hash *= 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+public:
+    explicit KernelCache(std::string dir) : dir_(std::move(dir)) {
+        if (!dir_.empty() && (!makeDirs_(dir_) || !isPrivateDir_(dir_)))
+            dir_.clear();
+    }
+
+    KernelCache(const KernelCache&) = delete;
+    KernelCache& operator=(const KernelCache&) = delete;
+
+    /**
+     * The cache of the process, in the directory from $JIT_CACHE_DIR.
+     */
+    static KernelCache& instance() {
+        static KernelCache cache(defaultDir_());
+        return cache;
+    }
+
+    /**
+     * source without comments, every run of blanks one space and none at
+     * either end. Only the line breaks around preprocessor directives stay,
+     * as they end them; string and character literals stay as they are (raw
+     * strings are not recognized).
+     */
+    static std::string normalize(const std::string& source) {
+        std::string res;
+        // blanks seen since the last character: 0 none, 1 spaces, 2 a line break
+        int blank = 0;
+        bool directive = false;
+        size_t i = 0;
+        while (i < source.size()) {
+            char c = source[i];
+            if (c == '/' && i + 1 < source.size() && source[i + 1] == '/') {
+                i = source.find('\n', i);
+                if (i == std::string::npos)
+                    break;
+                continue;
+            }
+            if (c == '/' && i + 1 < source.size() && source[i + 1] == '*') {
+                size_t end = source.find("*/", i + 2);
+                end = end == std::string::npos ? source.size() : end + 2;
+                blank = source.find('\n', i) < end ? 2 : std::max(blank, 1);
+                i = end;
+                continue;
+            }
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v') {
+                blank = c == '\n' ? 2 : std::max(blank, 1);
+                i++;
+                continue;
+            }
+
+            if (!res.empty() && blank == 2 && (directive || c == '#')) {
+                // a directive goes on after a line ending with a backslash
+                directive = c == '#' || (directive && res.back() == '\\');
+                res += '\n';
+            }
+            else if (!res.empty() && blank > 0) {
+                res += ' ';
+            }
+            else if (res.empty()) {
+                directive = c == '#';
+            }
+            blank = 0;
+
+            if (c == '"' || c == '\'') {
+                // up to the closing quote, escapes included
+                size_t end = i + 1;
+                while (end < source.size() && source[end] != c && source[end] != '\n')
+                    end += source[end] == '\\' ? 2 : 1;
+                end = std::min(end + 1, source.size());
+                res.append(source, i, end - i);
+                i = end;
+                continue;
+            }
+            res += c;
+            i++;
+        }
+        return res;
+    }
+
+    /**
+     * 32 hex digits identifying the code compiled from source with flags on
+     * this machine.
+     */
+    static std::string fingerprint(const std::string& source, const std::string& flags) {
+        std::string key = normalize(source);
+        key += '\0';
+        key += jitCompiler();
+        key += '\0';
+        key += flags;
+        key += '\0';
+        key += cpuDescription_();
+
+        // two FNV-1a hashes with different offset bases
+        char hex[33];
+        snprintf(hex, sizeof(hex), "%016llx%016llx",
+                 (unsigned long long) fnv1a_(key, 0xCBF29CE484222325ull),
+                 (unsigned long long) fnv1a_(key, 0x84222325CBF29CE4ull));
+        return hex;
+    }
+
+    /**
+     * The library compiled from source with flags: from memory, from the
+     * disk, or compiled (and kept) now. Concurrent misses on one fingerprint
+     * may each compile; the first library to be done is the one kept.
+     */
+    std::shared_ptr<const JitLibrary> get(const std::string& source,
+                                          const std::string& flags = JIT_FLAGS,
+                                          CompileCancellation *cancellation = nullptr) {
+        std::string key = fingerprint(source, flags);
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            auto it = libraries_.find(key);
+            if (it != libraries_.end())
+                return it->second;
+        }
+
+        std::string path = dir_.empty() ? "" : dir_ + "/" + key + ".so";
+        std::shared_ptr<const JitLibrary> library;
+        if (!path.empty() && access(path.c_str(), R_OK) == 0)
+            library = JitLibrary::load(path);
+        if (library == nullptr)
+            library = std::make_shared<const JitLibrary>(source, flags, cancellation, path);
+
+        std::lock_guard<std::mutex> guard(mutex_);
+        return libraries_.emplace(key, library).first->second;
+    }
+
+    /**
+     * The directory of the disk cache, empty if there is none.
+     */
+    const std::string& getDir() const {
+        return dir_;
+    }
+};
+
+
+/**
+ * Compiles source on a background thread and exposes the extern "C" function
+ * symbol once it is loaded. Every method can be called from any thread, so
+ * the instances of a CompiledPlan share one compilation.
+ *
+ * The library comes from the KernelCache, so a kernel compiled before is
+ * there after a dlopen.
+ *
+ * If compiling fails the function never shows up and getError() tells why;
+ * callers keep running their interpreted path. Destroying the object kills
+ * a compiler that is still running.
+ */
+class BackgroundCompilation {
+private:
+    std::shared_ptr<const JitLibrary> library_;
+    CompileCancellation cancellation_;
+    std::atomic<void*> function_;
+    std::atomic<bool> done_;
+    std::string error_;
+    double compile_ms_;
+    std::thread thread_;
+
+public:
+    BackgroundCompilation(std::string source, std::string symbol, std::string flags = JIT_FLAGS) :
+            function_(nullptr), done_(false), compile_ms_(0) {
+        thread_ = std::thread([this, source, symbol, flags]() {
+            auto start = std::chrono::steady_clock::now();
+            try {
+                library_ = KernelCache::instance().get(source, flags, &cancellation_);
+                void *function = library_->getSymbol(symbol);
+                compile_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                function_.store(function, std::memory_order_release);
+            }
+            catch (const std::exception& e) {
+                error_ = e.what();
+            }
+            done_.store(true, std::memory_order_release);
+        });
+    }
+
+    BackgroundCompilation(const BackgroundCompilation&) = delete;
+    BackgroundCompilation& operator=(const BackgroundCompilation&) = delete;
+
+    ~BackgroundCompilation() {
+        // nobody runs the plan anymore, so nobody waits for the compiler
+        cancellation_.cancel();
+        thread_.join();
+    }
+
+    /**
+     * The compiled function, nullptr while it is not ready (or failed).
+     */
+    template<class F>
+    F getFunction() const {
+        return reinterpret_cast<F>(function_.load(std::memory_order_acquire));
+    }
+
+    bool isDone() const {
+        return done_.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Block until the compilation is over, for callers that want the
+     * generated code from the first batch on.
+     */
+    void wait() const {
+        while (!isDone())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    /**
+     * Why compiling failed; only meaningful once isDone().
+     */
+    const std::string& getError() const {
+        return error_;
+    }
+
+    /**
+     * Milliseconds from the start to the loaded function (a cache hit
+     * included); only meaningful once the function is there.
+     */
+    double getCompileMillis() const {
+        return compile_ms_;
+    }
+};
+
+
+#endif //PROJECT_JIT_H
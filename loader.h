@@ -0,0 +1,338 @@
+#ifndef PROJECT_LOADER_H
+#define PROJECT_LOADER_H
+
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "columnar_file.h"
+
+
+/**
+ * Parallel bulk loader from delimited text (CSV, TPC-H .tbl) into a columnar file.
+ *
+ *   1. the input is mapped and cut into chunks that end on line boundaries
+ *   2. all threads count the lines of the chunks, which gives every chunk its
+ *      first row in the output
+ *   3. all threads parse their chunks block by block and pwrite the values
+ *      at their rows, folding every block into the batch statistics
+ *
+ * Numbers are parsed 8 digits at a time (SWAR) instead of digit by digit.
+ */
+
+
+#define FIELD_INT       1
+#define FIELD_DECIMAL   2   // fixed point, scale digits after the dot are kept
+#define FIELD_DATE      3   // yyyy-mm-dd as yyyymmdd
+
+
+struct LoaderColumn {
+    std::string name;
+    uint32_t field;
+    uint32_t type;
+    uint32_t scale;
+};
+
+
+/**
+ * The up to 8 leading digits of p (which must have 8 readable bytes) and
+ * their count in *len.
+ */
+inline uint32_t parseEightDigits(const char *p, uint32_t *len) {
+    uint64_t chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+
+    // bytes that are not '0'..'9' get their high bit set
+    uint64_t t = chunk - 0x3030303030303030ull;
+    uint64_t non_digits = (t | (t + 0x7676767676767676ull)) & 0x8080808080808080ull;
+    uint32_t n = non_digits == 0 ? 8 : (uint32_t) __builtin_ctzll(non_digits) / 8;
+    *len = n;
+    if (n == 0)
+        return 0;
+
+    // right-align the digits, the shifted-in zero bytes are leading zeros
+    chunk <<= (8 - n) * 8;
+    chunk = (chunk & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+    chunk = (chunk & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+    return (uint32_t) ((chunk & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32);
+}
+
+
+/**
+ * Parse an unsigned run of digits starting at p and ending before end. The
+ * 8-byte loads may read up to limit (the end of the buffer); the byte at end
+ * is a delimiter, so they never take digits from the next field.
+ */
+inline uint64_t parseDigits(const char *p, const char *end, const char *limit, const char **out) {
+    uint64_t val = 0;
+    while (limit - p >= 8) {
+        uint32_t len;
+        uint32_t v = parseEightDigits(p, &len);
+        static const uint32_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+        val = val * POW10[len] + v;
+        p += len;
+        if (len < 8) {
+            *out = p;
+            return val;
+        }
+    }
+    while (p < end && *p >= '0' && *p <= '9')
+        val = val * 10 + (uint64_t) (*p++ - '0');
+    *out = p;
+    return val;
+}
+
+
+inline int32_t parseField(const char *p, const char *end, const char *limit, const LoaderColumn& col) {
+    const char *q = p;
+    bool negative = false;
+    if (q < end && *q == '-') {
+        negative = true;
+        q++;
+    }
+
+    int64_t val;
+    if (col.type == FIELD_DATE) {
+        uint64_t year = parseDigits(q, end, limit, &q);
+        uint64_t month = q < end ? parseDigits(q + 1, end, limit, &q) : 0;
+        uint64_t day = q < end ? parseDigits(q + 1, end, limit, &q) : 0;
+        return (int32_t) (year * 10000 + month * 100 + day);
+    }
+
+    val = (int64_t) parseDigits(q, end, limit, &q);
+    if (col.type == FIELD_DECIMAL) {
+        uint32_t digits = 0;
+        if (q < end && *q == '.') {
+            q++;
+            while (q < end && *q >= '0' && *q <= '9' && digits < col.scale) {
+                val = val * 10 + (*q++ - '0');
+                digits++;
+            }
+        }
+        for (; digits < col.scale; digits++)
+            val *= 10;
+    }
+
+    return (int32_t) (negative ? -val : val);
+}
+
+
+class BulkLoader {
+private:
+    static constexpr uint64_t CHUNK_SIZE = 16 * 1024 * 1024;
+    static const uint32_t BLOCK_ROWS = 64 * 1024;
+
+    std::vector<LoaderColumn> columns_;
+    char delimiter_;
+    bool skip_header_;
+    uint32_t num_of_threads_;
+    uint32_t batch_size_;
+
+    struct Chunk {
+        const char *begin;
+        const char *end;
+        uint64_t num_of_rows;
+        uint64_t first_row;
+    };
+
+public:
+    BulkLoader(std::vector<LoaderColumn> columns,
+               char delimiter = '|',
+               bool skip_header = false,
+               uint32_t num_of_threads = std::thread::hardware_concurrency(),
+               uint32_t batch_size = DEFAULT_VECTOR_SIZE) :
+            columns_(std::move(columns)),
+            delimiter_(delimiter),
+            skip_header_(skip_header),
+            num_of_threads_(num_of_threads == 0 ? 1 : num_of_threads),
+            batch_size_(batch_size) {
+    }
+
+    /**
+     * Load input into a new columnar file at output and return the row count.
+     */
+    uint64_t load(const std::string& input, const std::string& output) {
+        int fd = ::open(input.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open " + input);
+
+        struct stat stat_buf;
+        if (fstat(fd, &stat_buf) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat " + input);
+        }
+
+        auto size = (size_t) stat_buf.st_size;
+        const char *data = nullptr;
+        if (size > 0) {
+            void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("mmap failed: " + input);
+            }
+            data = static_cast<const char*>(addr);
+            madvise(addr, size, MADV_SEQUENTIAL);
+        }
+
+        const char *begin = data;
+        if (skip_header_ && size > 0) {
+            auto nl = static_cast<const char*>(memchr(data, '\n', size));
+            begin = nl == nullptr ? data + size : nl + 1;
+        }
+
+        std::vector<Chunk> chunks = split_(begin, size - (size_t) (begin - data));
+        runParallel_([&](uint32_t i) { countRows_(&chunks[i]); }, (uint32_t) chunks.size());
+
+        uint64_t num_of_rows = 0;
+        for (auto& chunk : chunks) {
+            chunk.first_row = num_of_rows;
+            num_of_rows += chunk.num_of_rows;
+        }
+
+        std::vector<std::string> names{};
+        for (const auto& col : columns_)
+            names.push_back(col.name);
+        ColumnarFileWriter writer(output, names, num_of_rows, batch_size_);
+        runParallel_([&](uint32_t i) { parse_(chunks[i], &writer); }, (uint32_t) chunks.size());
+        writer.finish();
+
+        if (data != nullptr)
+            munmap(const_cast<char*>(data), size);
+        ::close(fd);
+        return num_of_rows;
+    }
+
+private:
+    std::vector<Chunk> split_(const char *data, size_t size) {
+        std::vector<Chunk> chunks{};
+        const char *end = data + size;
+        const char *p = data;
+        while (p < end) {
+            const char *q = p + std::min<size_t>(CHUNK_SIZE, (size_t) (end - p));
+            if (q < end) {
+                auto nl = static_cast<const char*>(memchr(q, '\n', (size_t) (end - q)));
+                q = nl == nullptr ? end : nl + 1;
+            }
+            chunks.push_back(Chunk{p, q, 0, 0});
+            p = q;
+        }
+        return chunks;
+    }
+
+    /**
+     * Run func(0..num_of_tasks-1) on the threads; the first exception of any
+     * task is rethrown once all threads are done.
+     */
+    template<class F>
+    void runParallel_(F func, uint32_t num_of_tasks) {
+        std::atomic<uint32_t> next_task(0);
+        std::vector<std::thread> threads{};
+        std::mutex error_mutex;
+        std::exception_ptr error = nullptr;
+        auto worker = [&]() {
+            try {
+                for (uint32_t i = next_task++; i < num_of_tasks; i = next_task++)
+                    func(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> guard(error_mutex);
+                if (error == nullptr)
+                    error = std::current_exception();
+                next_task = num_of_tasks;
+            }
+        };
+
+        uint32_t num_of_threads = std::min(num_of_threads_, num_of_tasks);
+        for (uint32_t t = 1; t < num_of_threads; t++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto& thread : threads)
+            thread.join();
+
+        if (error != nullptr)
+            std::rethrow_exception(error);
+    }
+
+    static bool isBlankLine_(const char *p, const char *eol) {
+        return eol == p || (eol - p == 1 && *p == '\r');
+    }
+
+    void countRows_(Chunk *chunk) {
+        uint64_t rows = 0;
+        const char *p = chunk->begin;
+        while (p < chunk->end) {
+            auto nl = static_cast<const char*>(memchr(p, '\n', (size_t) (chunk->end - p)));
+            const char *eol = nl == nullptr ? chunk->end : nl;
+            if (!isBlankLine_(p, eol))
+                rows++;
+            p = eol + 1;
+        }
+        chunk->num_of_rows = rows;
+    }
+
+    void parse_(const Chunk& chunk, ColumnarFileWriter *writer) {
+        uint32_t max_field = 0;
+        for (const auto& col : columns_)
+            max_field = std::max(max_field, col.field);
+
+        // column index per field, -1 for skipped fields
+        std::vector<int32_t> targets(max_field + 1, -1);
+        for (uint32_t c = 0; c < columns_.size(); c++)
+            targets[columns_[c].field] = (int32_t) c;
+
+        std::vector<std::vector<int32_t>> blocks(columns_.size(), std::vector<int32_t>(BLOCK_ROWS));
+        uint64_t row = chunk.first_row;
+        uint32_t n = 0;
+
+        const char *p = chunk.begin;
+        while (p < chunk.end) {
+            auto nl = static_cast<const char*>(memchr(p, '\n', (size_t) (chunk.end - p)));
+            const char *eol = nl == nullptr ? chunk.end : nl;
+            if (isBlankLine_(p, eol)) {
+                p = eol + 1;
+                continue;
+            }
+
+            const char *field = p;
+            for (uint32_t f = 0; f <= max_field; f++) {
+                auto delim = static_cast<const char*>(memchr(field, delimiter_, (size_t) (eol - field)));
+                const char *field_end = delim == nullptr ? eol : delim;
+                if (targets[f] >= 0)
+                    blocks[targets[f]][n] = parseField(field, field_end, chunk.end, columns_[targets[f]]);
+                if (delim == nullptr && f < max_field)
+                    throw std::runtime_error("Line with too few fields at row " + std::to_string(row + n));
+                field = field_end + 1;
+            }
+
+            p = eol + 1;
+            if (++n == BLOCK_ROWS) {
+                flush_(writer, blocks, row, n);
+                row += n;
+                n = 0;
+            }
+        }
+
+        if (n > 0)
+            flush_(writer, blocks, row, n);
+    }
+
+    void flush_(ColumnarFileWriter *writer, const std::vector<std::vector<int32_t>>& blocks, uint64_t row, uint32_t n) {
+        for (uint32_t c = 0; c < blocks.size(); c++) {
+            writer->writeColumn(c, row, blocks[c].data(), n);
+            writer->updateStats(c, row, blocks[c].data(), n);
+        }
+    }
+};
+
+
+#endif //PROJECT_LOADER_H
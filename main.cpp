@@ -5,9 +5,13 @@
 #include <cstdlib>
 #include <memory>
 #include <cstring>
+#include <algorithm>
+#include "vector_size.h"
 
 
 const uint32_t BATCHES = 100000;
+const uint32_t DEFAULT_VECTOR_SIZE = 1000;
+const uint64_t NUM_OF_ROWS = (uint64_t) BATCHES * DEFAULT_VECTOR_SIZE;
 
 
 /**
@@ -145,36 +149,32 @@ struct DbVector {
 
 
 
+/**
+ * An expression node. Nodes are immutable: the input vectors are passed to
+ * compute(), so one expression can be evaluated by several operators at once.
+ */
 class DAGNode {
 public:
     DAGNode() = default;
     virtual ~DAGNode() = default;
 
-    virtual uint32_t compute(DbVector** res) = 0;
-    virtual int getLeftChildType() = 0;
-    virtual int getRightChildType() = 0;
-
-    virtual void setLeftVector(DbVector* v) {
-        throw std::invalid_argument("not support");
-    }
-
-    virtual void setRightVector(DbVector* v) {
-        throw std::invalid_argument("not support");
-    }
+    virtual uint32_t compute(DbVector** res, const DbVector* left_vec, const DbVector* right_vec) const = 0;
+    virtual int getLeftChildType() const = 0;
+    virtual int getRightChildType() const = 0;
 
-    virtual std::string getLeftChildColName() {
+    virtual std::string getLeftChildColName() const {
         throw std::invalid_argument("not support");
     }
 
-    virtual std::string getRightChildColName() {
+    virtual std::string getRightChildColName() const {
         throw std::invalid_argument("not support");
     }
 
-    virtual DAGNode* getLeftChildDagNode() {
+    virtual const DAGNode* getLeftChildDagNode() const {
         throw std::invalid_argument("not support");
     }
 
-    virtual DAGNode* getRightChildDagNode() {
+    virtual const DAGNode* getRightChildDagNode() const {
         throw std::invalid_argument("not support");
     }
 };
@@ -193,8 +193,6 @@ private:
     DAGNode *right_;
     std::string col_name_;
 
-    DbVector *right_vec_;
-
 private:
     void assignPrimitive_() {
         switch (op_)
@@ -218,46 +216,40 @@ private:
 
 public:
     ValColDAGNode(int op, int32_t left_val, DAGNode *right) :
-        op_(op), right_(right), col_name_(""), left_val_(left_val), right_vec_(nullptr) {
+        op_(op), right_(right), col_name_(""), left_val_(left_val) {
         assignPrimitive_();
     }
 
     ValColDAGNode(int op, int32_t left_val, std::string col_name) :
-        op_(op), left_val_(left_val), right_(nullptr), col_name_(std::move(col_name)), right_vec_(nullptr) {
+        op_(op), left_val_(left_val), right_(nullptr), col_name_(std::move(col_name)) {
         assignPrimitive_();
     }
 
     virtual ~ValColDAGNode() {
         delete right_;
-        delete right_vec_;
     }
 
-    int getLeftChildType() final {
+    int getLeftChildType() const final {
         return CHILD_TYPE_VAL;
     }
 
-    int getRightChildType() final {
+    int getRightChildType() const final {
         if (right_ != nullptr)
             return CHILD_TYPE_DAG;
         return CHILD_TYPE_COL;
     }
 
-    void setRightVector(DbVector* v) final {
-        delete right_vec_;
-        right_vec_ = v;
-    }
-
-    std::string getRightChildColName() final {
+    std::string getRightChildColName() const final {
         return col_name_;
     }
 
-    DAGNode* getRightChildDagNode() final {
+    const DAGNode* getRightChildDagNode() const final {
         return right_;
     }
 
-    uint32_t compute(DbVector** res) final {
-        *res = new DbVector(right_vec_->n);
-        return primitive(right_vec_->n, (*res)->col, left_val_, right_vec_->col, nullptr);
+    uint32_t compute(DbVector** res, const DbVector* /*left_vec*/, const DbVector* right_vec) const final {
+        *res = new DbVector(right_vec->n);
+        return primitive(right_vec->n, (*res)->col, left_val_, right_vec->col, nullptr);
     }
 };
 
@@ -271,10 +263,6 @@ private:
     DAGNode *left_;
     std::string left_col_name_;
 
-    DbVector* left_vec_;
-    DbVector* right_vec_;
-
-
 private:
     void assignPrimitive_() {
         switch (op_)
@@ -299,75 +287,62 @@ private:
 
 public:
     ColColDAGNode(int op, DAGNode* left, DAGNode* right) :
-        op_(op), right_(right), left_(left), left_vec_(nullptr), right_vec_(nullptr) {
+        op_(op), right_(right), left_(left) {
         assignPrimitive_();
     }
 
     ColColDAGNode(int op, std::string left_col_name, DAGNode* right) :
-        op_(op), left_col_name_(std::move(left_col_name)), right_(right), left_(nullptr), left_vec_(nullptr), right_vec_(nullptr) {
+        op_(op), left_col_name_(std::move(left_col_name)), right_(right), left_(nullptr) {
         assignPrimitive_();
     }
 
     ColColDAGNode(int op, DAGNode* left, std::string right_col_name) :
-        op_(op), left_(left), right_(nullptr), right_col_name_(std::move(right_col_name)), left_vec_(nullptr), right_vec_(nullptr) {
+        op_(op), left_(left), right_(nullptr), right_col_name_(std::move(right_col_name)) {
         assignPrimitive_();
     }
 
     ColColDAGNode(int op, std::string left_col_name, std::string right_col_name) :
-        op_(op), left_col_name_(std::move(left_col_name)), right_col_name_(std::move(right_col_name)), left_(nullptr), right_(nullptr), left_vec_(nullptr), right_vec_(nullptr) {
+        op_(op), left_col_name_(std::move(left_col_name)), right_col_name_(std::move(right_col_name)), left_(nullptr), right_(nullptr) {
         assignPrimitive_();
     }
 
     virtual ~ColColDAGNode() {
         delete left_;
         delete right_;
-        delete left_vec_;
-        delete right_vec_;
     }
 
-    int getLeftChildType() final {
+    int getLeftChildType() const final {
         if (left_ != nullptr)
             return CHILD_TYPE_DAG;
         return CHILD_TYPE_COL;
     }
 
-    int getRightChildType() final {
+    int getRightChildType() const final {
         if (right_ != nullptr)
             return CHILD_TYPE_DAG;
         return CHILD_TYPE_COL;
     }
 
 
-    void setLeftVector(DbVector* v) final {
-        delete left_vec_;
-        left_vec_ = v;
-    }
-
-    void setRightVector(DbVector* v) final {
-        delete right_vec_;
-        right_vec_ = v;
-    }
-
-
-    std::string getLeftChildColName() final {
+    std::string getLeftChildColName() const final {
         return left_col_name_;
     }
 
-    std::string getRightChildColName() final {
+    std::string getRightChildColName() const final {
         return right_col_name_;
     }
 
-    DAGNode* getLeftChildDagNode() final {
+    const DAGNode* getLeftChildDagNode() const final {
         return left_;
     }
 
-    virtual DAGNode* getRightChildDagNode() {
+    const DAGNode* getRightChildDagNode() const final {
         return right_;
     }
 
-    uint32_t compute(DbVector** res) {
-        *res = new DbVector(left_vec_->n);
-        return primitive(left_vec_->n, (*res)->col, left_vec_->col, right_vec_->col, nullptr);
+    uint32_t compute(DbVector** res, const DbVector* left_vec, const DbVector* right_vec) const final {
+        *res = new DbVector(left_vec->n);
+        return primitive(left_vec->n, (*res)->col, left_vec->col, right_vec->col, nullptr);
     }
 };
 
@@ -500,11 +475,11 @@ public:
     }
 
 private:
-    // evaluate the expression -
-    uint32_t evaluateExpr_(DbVector** res, DAGNode *expr, BatchResult* input) {
-        uint32_t n = input->getn();
-        DbVector *lres = nullptr, *rres = nullptr;
-        DAGNode *tmp_node = nullptr;
+    // evaluate the expression - the intermediates of the children are owned
+    // here and the input columns are bound as they are, the nodes keep no state
+    uint32_t evaluateExpr_(DbVector** res, const DAGNode *expr, BatchResult* input) {
+        std::unique_ptr<DbVector> lres, rres;
+        const DbVector *left_vec = nullptr, *right_vec = nullptr;
         DbVector *tmp_vec = nullptr;
 
         switch (expr->getLeftChildType())
@@ -512,34 +487,30 @@ private:
             case CHILD_TYPE_VAL:
                 break;
             case CHILD_TYPE_DAG:
-                tmp_node = expr->getLeftChildDagNode();
-                evaluateExpr_(&lres, tmp_node, input);
+                evaluateExpr_(&tmp_vec, expr->getLeftChildDagNode(), input);
+                lres.reset(tmp_vec);
+                left_vec = tmp_vec;
                 break;
             case CHILD_TYPE_COL:
-                tmp_vec = input->getCol(expr->getLeftChildColName());
-                lres = new DbVector(*tmp_vec);
+                left_vec = input->getCol(expr->getLeftChildColName());
                 break;
         }
-        if (lres != nullptr)
-            expr->setLeftVector(lres);
 
         switch (expr->getRightChildType())
         {
             case CHILD_TYPE_VAL:
                 break;
-            case CHILD_TYPE_COL:
-                tmp_vec = input->getCol(expr->getRightChildColName());
-                rres = new DbVector(*tmp_vec);
-                break;
             case CHILD_TYPE_DAG:
-                DAGNode* tmp_node = expr->getRightChildDagNode();
-                evaluateExpr_(&rres, tmp_node, input);
+                evaluateExpr_(&tmp_vec, expr->getRightChildDagNode(), input);
+                rres.reset(tmp_vec);
+                right_vec = tmp_vec;
+                break;
+            case CHILD_TYPE_COL:
+                right_vec = input->getCol(expr->getRightChildColName());
                 break;
         }
-        if (rres != nullptr)
-            expr->setRightVector(rres);
 
-        return expr->compute(res);
+        return expr->compute(res, left_vec, right_vec);
     }
 };
 
@@ -601,13 +572,15 @@ private:
 
 class ScanOperator : public BaseOperator {
 private:
-    uint32_t num_of_batches_;
+    uint64_t num_of_rows_;
     std::vector<std::string> columns_;
+    uint32_t vector_size_;
 
 public:
-    ScanOperator(uint32_t num_of_batches, const std::vector<std::string>& columns) :
-        num_of_batches_(num_of_batches),
-        columns_(columns)
+    ScanOperator(uint64_t num_of_rows, const std::vector<std::string>& columns, uint32_t vector_size) :
+        num_of_rows_(num_of_rows),
+        columns_(columns),
+        vector_size_(vector_size)
     {}
 
      ~ScanOperator() final = default;
@@ -621,10 +594,11 @@ public:
     }
 
     BatchResult* next() final {
-        if (num_of_batches_ == 0)
+        if (num_of_rows_ == 0)
             return nullptr;
 
-        uint32_t n = 1000;
+        // the last batch takes the rows that are left
+        auto n = (uint32_t) std::min<uint64_t>(vector_size_, num_of_rows_);
         BatchResult *br = new BatchResult(columns_, n);
         // fill each col using a random numbers
         for (const auto& name : columns_) {
@@ -636,7 +610,7 @@ public:
             */
         }
 
-        num_of_batches_--;
+        num_of_rows_ -= n;
 
         // printf("%d batch\n", BATCHES-num_of_batches_);
         return br;
@@ -685,9 +659,9 @@ public:
 };
 
 
-QueryPlan *compileQuery() {
+QueryPlan *compileQuery(uint32_t vector_size = DEFAULT_VECTOR_SIZE, uint64_t num_of_rows = NUM_OF_ROWS) {
     std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names);
+    ScanOperator *scan_op = new ScanOperator(num_of_rows, col_names, vector_size);
 
     ValColDAGNode *oneMinusDiscount = new ValColDAGNode(OP_SUB, 1, "discount");
     ColColDAGNode *extpriceMul = new ColColDAGNode(OP_MUL, "extprice", oneMinusDiscount);
@@ -699,20 +673,54 @@ QueryPlan *compileQuery() {
 }
 
 
-QueryPlan *compileQueryWithJit() {
+QueryPlan *compileQueryWithJit(uint32_t vector_size = DEFAULT_VECTOR_SIZE, uint64_t num_of_rows = NUM_OF_ROWS) {
     std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names);
+    ScanOperator *scan_op = new ScanOperator(num_of_rows, col_names, vector_size);
 
     CompiledProjectOperator *proj_op = new CompiledProjectOperator(scan_op, "bonus");
     return new QueryPlan(proj_op);
 }
 
 
+const std::vector<std::pair<std::string, QueryPlan *(*)(uint32_t, uint64_t)>> STRATEGIES{
+    {"vectorized", compileQuery},
+    {"jit", compileQueryWithJit},
+};
+
+
 int main(int argc, char*argv[]) {
-    QueryPlan *query_plan = compileQuery();
-    // QueryPlan *query_plan = compileQueryWithJit();
+    const char *usage = "usage: project [vector_size|auto|column] [num_of_rows] [vectorized|jit]";
+    //   column - column-at-a-time: the whole table is a single batch, so every
+    //            primitive runs once over the full column and materializes
+    //            full-size intermediates (MonetDB's BAT algebra)
+    uint64_t num_of_rows = argc > 2 ? strtoull(argv[2], nullptr, 10) : NUM_OF_ROWS;
+    std::string strategy = argc > 3 ? argv[3] : "vectorized";
+
+    QueryPlan *(*compile)(uint32_t, uint64_t) = nullptr;
+    for (const auto& elem : STRATEGIES) {
+        if (strategy == elem.first)
+            compile = elem.second;
+    }
+    if (compile == nullptr) {
+        std::cout << "Unknown strategy " << strategy << "\n";
+        return 1;
+    }
+
+    // 3 columns and the 4 intermediates of the expression
+    uint32_t vector_size = parseVectorSizeArg(argc, argv, num_of_rows, DEFAULT_VECTOR_SIZE, usage, 7,
+                                              [compile](uint32_t n, uint32_t num_of_batches) {
+        QueryPlan *plan = compile(n, (uint64_t) num_of_batches * n);
+        plan->open();
+        plan->printResultSet();
+        plan->close();
+        delete plan;
+    });
+    if (vector_size == 0)
+        return 1;
+
+    QueryPlan *query_plan = compile(vector_size, num_of_rows);
     query_plan->open();
     query_plan->printResultSet();
     query_plan->close();
     delete query_plan;
-}
\ No newline at end of file
+}
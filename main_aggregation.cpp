@@ -0,0 +1,546 @@
+#include <iostream>
+#include <climits>
+#include "common.h"
+#include "vector_size.h"
+#include "result_sink.h"
+#include "hash.h"
+#include "partition.h"
+
+/**
+ * This program evaluates hash aggregation.
+ *
+ *   select k, count(*), sum(v), min(v), max(v)
+ *   from t
+ *   group by k
+ *
+ * k is uniform (or Zipf-skewed) over num_of_groups values and v is uniform
+ * in [0, 100).
+ *
+ * Both strategies share one open-addressing table: a power-of-two array of
+ * 8-byte slots (the hash as a tag, the group id) probed linearly, with the
+ * keys and the aggregates of the groups in arrays of their own indexed by
+ * group id. A probe mostly touches one slot, and only reads a key when the
+ * tag matches.
+ *
+ *   vectorized - a batch goes through separate primitives: hash the keys,
+ *       fetch the candidate slots, insert the new groups, compare the keys
+ *       (the mismatches move on to the next slot and go around again), then
+ *       one pass per aggregate
+ *   jit - one fused loop hashes, probes and updates all aggregates row by row
+ *
+ * The _partitioned variants radix partition the input first (partition.h),
+ * with enough partitions for the groups of one to fit half the L2, and
+ * aggregate a partition at a time into a fresh table.
+ */
+
+
+const uint32_t BATCHES = 100000;
+const uint64_t NUM_OF_ROWS = (uint64_t) BATCHES * DEFAULT_VECTOR_SIZE;
+
+
+/************************************************************************
+ *
+ * Aggregation primitives
+ *
+ **************************************************************************/
+
+
+static uint32_t aggr_count_grouped_int64(uint32_t n, int64_t *counts, const uint32_t *gids) {
+    for (uint32_t j = 0; j < n; j++)
+        counts[gids[j]]++;
+    return n;
+}
+
+
+static uint32_t aggr_sum_grouped_int64_int32_col(uint32_t n, int64_t *sums, const uint32_t *gids,
+                                         const int32_t *col, const uint32_t *sel) {
+    if (sel != nullptr) {
+        for (uint32_t j = 0; j < n; j++)
+            sums[gids[j]] += col[sel[j]];
+    }
+    else {
+        for (uint32_t j = 0; j < n; j++)
+            sums[gids[j]] += col[j];
+    }
+    return n;
+}
+
+
+static uint32_t aggr_min_grouped_int32_col(uint32_t n, int32_t *mins, const uint32_t *gids,
+                                   const int32_t *col, const uint32_t *sel) {
+    for (uint32_t j = 0; j < n; j++) {
+        int32_t v = col[sel != nullptr ? sel[j] : j];
+        int32_t& m = mins[gids[j]];
+        m = v < m ? v : m;
+    }
+    return n;
+}
+
+
+static uint32_t aggr_max_grouped_int32_col(uint32_t n, int32_t *maxs, const uint32_t *gids,
+                                   const int32_t *col, const uint32_t *sel) {
+    for (uint32_t j = 0; j < n; j++) {
+        int32_t v = col[sel != nullptr ? sel[j] : j];
+        int32_t& m = maxs[gids[j]];
+        m = v > m ? v : m;
+    }
+    return n;
+}
+
+
+/************************************************************************
+ *
+ * Hash table
+ *
+ **************************************************************************/
+
+
+/**
+ * The groups of a hash aggregation: linear probing over slots of (hash, group
+ * id + 1), 0 being an empty slot, kept at most half full.
+ */
+class AggregationTable {
+public:
+    struct Slot {
+        uint32_t hash;
+        uint32_t gid;
+    };
+
+    std::vector<Slot> slots;
+    uint32_t mask;
+
+    std::vector<int32_t> keys;
+    std::vector<uint32_t> hashes;
+    std::vector<int64_t> counts;
+    std::vector<int64_t> sums;
+    std::vector<int32_t> mins;
+    std::vector<int32_t> maxs;
+
+    explicit AggregationTable(uint32_t capacity = 1024) {
+        uint32_t size = 16;
+        while (size < capacity)
+            size <<= 1;
+        slots.assign(size, Slot{0, 0});
+        mask = size - 1;
+    }
+
+    uint32_t getNumOfGroups() const {
+        return (uint32_t) keys.size();
+    }
+
+    bool isFull() const {
+        return (uint64_t) (keys.size() + 1) * 2 > slots.size();
+    }
+
+    /**
+     * A new group for key; the caller links it into a slot.
+     */
+    uint32_t addGroup(int32_t key, uint32_t hash) {
+        keys.push_back(key);
+        hashes.push_back(hash);
+        counts.push_back(0);
+        sums.push_back(0);
+        mins.push_back(INT32_MAX);
+        maxs.push_back(INT32_MIN);
+        return (uint32_t) keys.size() - 1;
+    }
+
+    /**
+     * Double the slots and reinsert every group by its stored hash.
+     */
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2, Slot{0, 0});
+        slots.swap(old);
+        mask = (uint32_t) slots.size() - 1;
+        for (uint32_t gid = 0; gid < keys.size(); gid++) {
+            uint32_t pos = hashes[gid] & mask;
+            while (slots[pos].gid != 0)
+                pos = (pos + 1) & mask;
+            slots[pos] = Slot{hashes[gid], gid + 1};
+        }
+    }
+};
+
+
+/**
+ * A pipeline breaker: the first next() consumes the whole input, then the
+ * groups come out vector_size at a time as columns k, count_hi, count_lo,
+ * sum_hi, sum_lo, min and max. Counts and sums are computed in 64 bits and
+ * a BatchResult only carries int32 columns, so each one is split into its
+ * upper and lower 32 bits (see splitInt64_); (hi << 32) | (uint32_t) lo
+ * gives it back.
+ *
+ * With partition_bits, the input is radix partitioned on the key instead,
+ * and the partitions are aggregated and emitted one after the other; no two
+ * share a group.
+ */
+class AggregateOperator : public BaseOperator {
+protected:
+    BaseOperator* next_;
+    std::string key_col_;
+    std::string value_col_;
+    uint32_t vector_size_;
+    uint32_t partition_bits_;
+    AggregationTable table_;
+    bool built_;
+    uint32_t emitted_;
+    std::unique_ptr<RadixPartitioner> partitions_;
+    uint32_t partition_;
+
+public:
+    AggregateOperator(BaseOperator *next, std::string key_col, std::string value_col, uint32_t vector_size,
+                      uint32_t partition_bits) :
+        next_(next),
+        key_col_(std::move(key_col)),
+        value_col_(std::move(value_col)),
+        vector_size_(vector_size),
+        partition_bits_(partition_bits),
+        built_(false),
+        emitted_(0),
+        partition_(0) {
+    }
+
+    ~AggregateOperator() override {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+        table_ = AggregationTable();
+        built_ = false;
+        emitted_ = 0;
+        partitions_.reset();
+        partition_ = 0;
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        if (!built_) {
+            if (partition_bits_ > 0)
+                partitions_.reset(new RadixPartitioner({key_col_, value_col_}, key_col_, partition_bits_));
+            while (true) {
+                std::unique_ptr<BatchResult> br(next_->next());
+                if (br == nullptr)
+                    break;
+                if (partitions_ != nullptr) {
+                    partitions_->append(br.get());
+                    continue;
+                }
+                const DbVector<uint32_t> *sel = br->res_sel;
+                consume_(sel == nullptr ? br->getn() : sel->n,
+                         br->getCol(key_col_)->col,
+                         br->getCol(value_col_)->col,
+                         sel == nullptr ? nullptr : sel->col);
+            }
+            if (partitions_ != nullptr)
+                partitions_->partition();
+            built_ = true;
+        }
+
+        while (emitted_ >= table_.getNumOfGroups()) {
+            if (partitions_ == nullptr || partition_ == partitions_->getNumOfPartitions())
+                return nullptr;
+            aggregatePartition_(partition_++);
+        }
+
+        uint32_t num_of_groups = table_.getNumOfGroups();
+
+        uint32_t n = std::min(vector_size_, num_of_groups - emitted_);
+        BatchResult *br = new BatchResult({key_col_, "count_hi", "count_lo", "sum_hi", "sum_lo", "min", "max"}, n);
+        int32_t *keys = br->getCol(key_col_)->col;
+        int32_t *counts_hi = br->getCol("count_hi")->col;
+        int32_t *counts_lo = br->getCol("count_lo")->col;
+        int32_t *sums_hi = br->getCol("sum_hi")->col;
+        int32_t *sums_lo = br->getCol("sum_lo")->col;
+        int32_t *mins = br->getCol("min")->col;
+        int32_t *maxs = br->getCol("max")->col;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t gid = emitted_ + i;
+            keys[i] = table_.keys[gid];
+            splitInt64_(table_.counts[gid], counts_hi + i, counts_lo + i);
+            splitInt64_(table_.sums[gid], sums_hi + i, sums_lo + i);
+            mins[i] = table_.mins[gid];
+            maxs[i] = table_.maxs[gid];
+        }
+        emitted_ += n;
+        return br;
+    }
+
+protected:
+    /**
+     * Aggregate n rows, row j being keys[sel[j]] and values[sel[j]] (index j
+     * without sel).
+     */
+    virtual void consume_(uint32_t n, const int32_t *keys, const int32_t *values, const uint32_t *sel) = 0;
+
+private:
+    void aggregatePartition_(uint32_t partition) {
+        table_ = AggregationTable();
+        emitted_ = 0;
+        const int32_t *keys = partitions_->getCol(0);
+        const int32_t *values = partitions_->getCol(1);
+        uint64_t end = partitions_->getEnd(partition);
+        for (uint64_t begin = partitions_->getBegin(partition); begin < end; begin += vector_size_) {
+            auto n = (uint32_t) std::min<uint64_t>(vector_size_, end - begin);
+            consume_(n, keys + begin, values + begin, nullptr);
+        }
+    }
+
+    static void splitInt64_(int64_t v, int32_t *hi, int32_t *lo) {
+        *hi = (int32_t) (v >> 32);
+        *lo = (int32_t) (uint32_t) v;
+    }
+};
+
+
+class AggregateVectorizedOperator : public AggregateOperator {
+private:
+    // per row of the batch
+    std::vector<uint32_t> hashes_;
+    std::vector<uint32_t> pos_;
+    std::vector<uint32_t> cands_;
+    std::vector<uint32_t> gids_;
+    // the rows still probing
+    std::vector<uint32_t> active_;
+    std::vector<uint32_t> misses_;
+
+public:
+    AggregateVectorizedOperator(BaseOperator *next, std::string key_col, std::string value_col, uint32_t vector_size,
+                                uint32_t partition_bits = 0) :
+        AggregateOperator(next, std::move(key_col), std::move(value_col), vector_size, partition_bits) {
+    }
+
+protected:
+    void consume_(uint32_t n, const int32_t *keys, const int32_t *values, const uint32_t *sel) final {
+        if (hashes_.size() < n) {
+            for (auto v : {&hashes_, &pos_, &cands_, &gids_, &active_, &misses_})
+                v->resize(n);
+        }
+
+        hash_int32_col(n, hashes_.data(), keys, sel);
+        findGroups_(n, keys, sel);
+
+        aggr_count_grouped_int64(n, table_.counts.data(), gids_.data());
+        aggr_sum_grouped_int64_int32_col(n, table_.sums.data(), gids_.data(), values, sel);
+        aggr_min_grouped_int32_col(n, table_.mins.data(), gids_.data(), values, sel);
+        aggr_max_grouped_int32_col(n, table_.maxs.data(), gids_.data(), values, sel);
+    }
+
+private:
+    /**
+     * gids_[j] = the group of row j, adding the groups not seen yet.
+     */
+    void findGroups_(uint32_t n, const int32_t *keys, const uint32_t *sel) {
+        uint32_t *hashes = hashes_.data();
+        uint32_t *pos = pos_.data();
+        uint32_t *cands = cands_.data();
+        uint32_t *gids = gids_.data();
+        uint32_t *active = active_.data();
+        uint32_t *misses = misses_.data();
+
+        for (uint32_t j = 0; j < n; j++) {
+            pos[j] = hashes[j] & table_.mask;
+            active[j] = j;
+        }
+
+        uint32_t m = n;
+        while (m > 0) {
+            const AggregationTable::Slot *slots = table_.slots.data();
+
+            // candidate slots
+            for (uint32_t t = 0; t < m; t++) {
+                uint32_t j = active[t];
+                cands[j] = slots[pos[j]].gid;
+            }
+
+            // new groups, one at a time: a later row may land in the slot an
+            // earlier one just took
+            bool grown = false;
+            for (uint32_t t = 0; t < m; t++) {
+                uint32_t j = active[t];
+                if (cands[j] != 0)
+                    continue;
+                if (table_.isFull()) {
+                    table_.grow();
+                    grown = true;
+                    break;
+                }
+                AggregationTable::Slot& slot = table_.slots[pos[j]];
+                if (slot.gid == 0) {
+                    uint32_t gid = table_.addGroup(keys[sel != nullptr ? sel[j] : j], hashes[j]);
+                    slot = AggregationTable::Slot{hashes[j], gid + 1};
+                }
+                cands[j] = slot.gid;
+            }
+            if (grown) {
+                for (uint32_t t = 0; t < m; t++)
+                    pos[active[t]] = hashes[active[t]] & table_.mask;
+                continue;
+            }
+
+            // compare tags and keys, the misses probe the next slot
+            const int32_t *group_keys = table_.keys.data();
+            const uint32_t *group_hashes = table_.hashes.data();
+            uint32_t k = 0;
+            for (uint32_t t = 0; t < m; t++) {
+                uint32_t j = active[t];
+                uint32_t gid = cands[j] - 1;
+                bool match = group_hashes[gid] == hashes[j] && group_keys[gid] == keys[sel != nullptr ? sel[j] : j];
+                gids[j] = gid;
+                misses[k] = j;
+                k += !match;
+            }
+            for (uint32_t t = 0; t < k; t++)
+                pos[misses[t]] = (pos[misses[t]] + 1) & table_.mask;
+
+            std::swap(active, misses);
+            m = k;
+        }
+    }
+};
+
+
+class AggregateJitOperator : public AggregateOperator {
+public:
+    AggregateJitOperator(BaseOperator *next, std::string key_col, std::string value_col, uint32_t vector_size,
+                         uint32_t partition_bits = 0) :
+        AggregateOperator(next, std::move(key_col), std::move(value_col), vector_size, partition_bits) {
+    }
+
+protected:
+    void consume_(uint32_t n, const int32_t *keys, const int32_t *values, const uint32_t *sel) final {
+        for (uint32_t j = 0; j < n; j++) {
+            uint32_t i = sel != nullptr ? sel[j] : j;
+            int32_t key = keys[i];
+            uint32_t hash = hashInt32(key);
+
+            uint32_t pos = hash & table_.mask;
+            uint32_t gid;
+            while (true) {
+                AggregationTable::Slot slot = table_.slots[pos];
+                if (slot.gid == 0) {
+                    if (table_.isFull()) {
+                        table_.grow();
+                        pos = hash & table_.mask;
+                        continue;
+                    }
+                    gid = table_.addGroup(key, hash);
+                    table_.slots[pos] = AggregationTable::Slot{hash, gid + 1};
+                    break;
+                }
+                if (slot.hash == hash && table_.keys[slot.gid - 1] == key) {
+                    gid = slot.gid - 1;
+                    break;
+                }
+                pos = (pos + 1) & table_.mask;
+            }
+
+            int32_t v = values[i];
+            table_.counts[gid]++;
+            table_.sums[gid] += v;
+            table_.mins[gid] = v < table_.mins[gid] ? v : table_.mins[gid];
+            table_.maxs[gid] = v > table_.maxs[gid] ? v : table_.maxs[gid];
+        }
+    }
+};
+
+
+
+/************************************************************************
+ *
+ * Query compiler
+ *
+ **************************************************************************/
+
+
+static std::vector<ColumnSpec> tableSpecs(uint32_t num_of_groups, bool zipf) {
+    std::vector<ColumnSpec> specs{};
+    if (zipf)
+        specs.emplace_back("k", DIST_ZIPF, (int32_t) num_of_groups, 1.0);
+    else
+        specs.emplace_back("k", DIST_UNIFORM, (int32_t) num_of_groups);
+    specs.emplace_back("v", DIST_UNIFORM, 100);
+    return specs;
+}
+
+
+QueryPlan *compileQuery_Baseline(uint32_t vector_size, uint64_t num_of_rows, uint32_t num_of_groups, bool zipf) {
+    return new QueryPlan(makeScan(tableSpecs(num_of_groups, zipf), num_of_rows, vector_size), false);
+}
+
+
+/**
+ * The radix bits that make the groups of a partition fit half the L2: a
+ * group takes its key, hash and aggregates plus two slots.
+ */
+static uint32_t partitionBits(uint32_t num_of_groups) {
+    const uint64_t bytes_per_group = 2 * sizeof(AggregationTable::Slot) + 2 * sizeof(int32_t) +
+                                     2 * sizeof(int64_t) + 2 * sizeof(int32_t);
+    return radixBitsFor(num_of_groups * bytes_per_group, detectCacheInfo().l2);
+}
+
+
+template<class Aggregate, bool partitioned>
+QueryPlan *compileQuery_Aggregate(uint32_t vector_size, uint64_t num_of_rows, uint32_t num_of_groups, bool zipf) {
+    auto scan_op = makeScan(tableSpecs(num_of_groups, zipf), num_of_rows, vector_size);
+    auto aggr_op = new Aggregate(scan_op, "k", "v", DEFAULT_VECTOR_SIZE,
+                                 partitioned ? partitionBits(num_of_groups) : 0);
+    return new QueryPlan(aggr_op, false);
+}
+
+
+const std::vector<std::pair<std::string, QueryPlan *(*)(uint32_t, uint64_t, uint32_t, bool)>> STRATEGIES{
+    {"baseline", compileQuery_Baseline},
+    {"vectorized", compileQuery_Aggregate<AggregateVectorizedOperator, false>},
+    {"jit", compileQuery_Aggregate<AggregateJitOperator, false>},
+    {"vectorized_partitioned", compileQuery_Aggregate<AggregateVectorizedOperator, true>},
+    {"jit_partitioned", compileQuery_Aggregate<AggregateJitOperator, true>},
+};
+
+
+int main(int argc, char **argv) {
+    const char *usage = "usage: aggregation [vector_size|auto|column] [num_of_rows] [baseline|vectorized|jit|vectorized_partitioned|jit_partitioned] [num_of_groups] [uniform|zipf]";
+    //   column - column-at-a-time: the whole table is a single batch
+    //   prints the number of result rows (groups) and a checksum of them
+    uint64_t num_of_rows = argc > 2 ? strtoull(argv[2], nullptr, 10) : NUM_OF_ROWS;
+    std::string strategy = argc > 3 ? argv[3] : "vectorized";
+    uint32_t num_of_groups = argc > 4 ? parseCount(argv[4], INT32_MAX) : 1024;
+    bool zipf = argc > 5 && strcmp(argv[5], "zipf") == 0;
+    if (num_of_groups == 0) {
+        std::cout << "num_of_groups must be 1 to " << INT32_MAX << "\n" << usage << "\n";
+        return 1;
+    }
+
+    QueryPlan *(*compile)(uint32_t, uint64_t, uint32_t, bool) = nullptr;
+    for (const auto& elem : STRATEGIES) {
+        if (strategy == elem.first)
+            compile = elem.second;
+    }
+    if (compile == nullptr) {
+        std::cout << "Unknown strategy " << strategy << "\n";
+        return 1;
+    }
+
+    // 2 columns + hashes, positions, candidates, group ids and 2 probe lists
+    uint32_t vector_size = parseVectorSizeArg(argc, argv, num_of_rows, DEFAULT_VECTOR_SIZE, usage, 8,
+                                              [compile, num_of_groups, zipf](uint32_t n, uint32_t num_of_batches) {
+        QueryPlan *plan = compile(n, (uint64_t) num_of_batches * n, num_of_groups, zipf);
+        plan->open();
+        plan->printResultSet();
+        plan->close();
+        delete plan;
+    });
+    if (vector_size == 0)
+        return 1;
+
+    QueryPlan *query_plan = compile(vector_size, num_of_rows, num_of_groups, zipf);
+    query_plan->open();
+    ChecksumSink sink;
+    query_plan->execute(&sink);
+    query_plan->close();
+    delete query_plan;
+    std::cout << sink.getCount() << " rows, checksum " << std::hex << sink.getChecksum() << std::dec << "\n";
+}
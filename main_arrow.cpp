@@ -0,0 +1,177 @@
+#include <iostream>
+#include <chrono>
+#include "common.h"
+#include "arrow_c.h"
+
+/**
+ * This program hands the result of a selection to an Arrow consumer through
+ * the Arrow C stream interface, without a serialization step.
+ *
+ *   select * from lineitem
+ *   where discount < 50 and extprice < 50
+ *
+ *   arrow [export|roundtrip] [num_of_rows]
+ *
+ *   export    - the consumer reads the exported record batches and sums
+ *               every column straight from the Arrow buffers
+ *   roundtrip - the exported stream is scanned again by ArrowScanOperator
+ *               and filtered on tax < 50, as an engine embedded behind an
+ *               Arrow producer would
+ */
+
+
+const uint64_t NUM_OF_ROWS = 100000ull * DEFAULT_VECTOR_SIZE;
+
+
+/**
+ * Ross, Kenneth A. "Conjunctive selection conditions in main memory." Proceedings of
+ * the twenty-first ACM SIGMOD-SIGACT-SIGART symposium on Principles of database systems. 2002.
+ **/
+static uint32_t sel_lt_int32_col_int32_val_nonbranching(uint32_t n,
+                                                        uint32_t *res_sel,
+                                                        int32_t *col,
+                                                        int32_t val,
+                                                        uint32_t *sel) {
+    uint32_t res = 0;
+
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = sel[i];
+            res += (col[sel[i]] < val);
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = i;
+            res += (col[i] < val);
+        }
+    }
+
+    return res;
+}
+
+
+class SelectLessThanOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    std::vector<std::pair<std::string, int32_t>> conds_;
+
+public:
+    SelectLessThanOperator(BaseOperator *next, std::vector<std::pair<std::string, int32_t>> conds) :
+        next_(next), conds_(std::move(conds)) {
+    }
+
+    ~SelectLessThanOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        DbVector<uint32_t> *res_sel = new DbVector<uint32_t>(br->getn());
+        bool first = true;
+        for (const auto& cond : conds_) {
+            DbVector<int32_t> *vec = br->getCol(cond.first);
+            if (first) {
+                res_sel->n = sel_lt_int32_col_int32_val_nonbranching(vec->n, res_sel->col, vec->col, cond.second, nullptr);
+                first = false;
+            }
+            else {
+                res_sel->n = sel_lt_int32_col_int32_val_nonbranching(res_sel->n, res_sel->col, vec->col, cond.second, res_sel->col);
+            }
+        }
+
+        br->res_sel = res_sel;
+        return br;
+    }
+};
+
+
+static BaseOperator *compileSelection(uint64_t num_of_rows) {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    auto scan_op = new ScanOperator(num_of_rows, col_names, true, 100);
+    std::vector<std::pair<std::string, int32_t>> conds{{"extprice", 50}, {"discount", 50}};
+    return new SelectLessThanOperator(scan_op, conds);
+}
+
+
+/**
+ * A stand-in for an Arrow consumer: sums the int32 columns of every record
+ * batch, honoring offsets and validity bitmaps.
+ */
+static void consumeStream(ArrowArrayStream *stream) {
+    ArrowSchema schema;
+    if (stream->get_schema(stream, &schema) != 0)
+        throw std::runtime_error(stream->get_last_error(stream));
+
+    std::vector<int64_t> sums(schema.n_children, 0);
+    uint64_t rows = 0;
+    while (true) {
+        ArrowArray array;
+        if (stream->get_next(stream, &array) != 0)
+            throw std::runtime_error(stream->get_last_error(stream));
+        if (array.release == nullptr)
+            break;
+
+        for (int64_t c = 0; c < array.n_children; c++) {
+            const ArrowArray *child = array.children[c];
+            if (strcmp(schema.children[c]->format, "i") != 0)
+                continue;
+            auto validity = static_cast<const uint8_t*>(child->buffers[0]);
+            auto values = static_cast<const int32_t*>(child->buffers[1]) + child->offset;
+            for (int64_t i = 0; i < child->length; i++) {
+                int64_t bit = child->offset + i;
+                if (validity == nullptr || ((validity[bit >> 3] >> (bit & 7)) & 1))
+                    sums[c] += values[i];
+            }
+        }
+        rows += (uint64_t) array.length;
+        array.release(&array);
+    }
+
+    std::cout << rows << " rows\n";
+    for (int64_t c = 0; c < schema.n_children; c++)
+        std::cout << "sum(" << schema.children[c]->name << ") = " << sums[c] << "\n";
+    schema.release(&schema);
+}
+
+
+int main(int argc, char **argv) {
+    std::string mode = argc > 1 ? argv[1] : "export";
+    uint64_t num_of_rows = argc > 2 ? strtoull(argv[2], nullptr, 10) : NUM_OF_ROWS;
+
+    auto start = std::chrono::steady_clock::now();
+    ArrowArrayStream stream;
+    exportStream(compileSelection(num_of_rows), &stream);
+
+    if (mode == "export") {
+        consumeStream(&stream);
+        stream.release(&stream);
+    }
+    else if (mode == "roundtrip") {
+        std::vector<std::pair<std::string, int32_t>> conds{{"tax", 50}};
+        auto sel_op = new SelectLessThanOperator(new ArrowScanOperator(&stream), conds);
+        QueryPlan query_plan(sel_op, false);
+        query_plan.open();
+        query_plan.printResultSet();
+        query_plan.close();
+    }
+    else {
+        std::cout << "Usage: arrow [export|roundtrip] [num_of_rows]\n";
+        stream.release(&stream);
+        return 1;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    std::cout << std::chrono::duration<double, std::milli>(end - start).count() << "ms\n";
+}
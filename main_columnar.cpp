@@ -0,0 +1,298 @@
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <sstream>
+#include "common.h"
+#include "columnar_file.h"
+#include "async_io.h"
+#include "exchange.h"
+
+/**
+ * This program runs the conjunctive query on a table stored in a columnar file.
+ *
+ *   select * from lineitem
+ *   where discount < 50 and tax < 50 and extprice < 50
+ *
+ *   columnar write <file> [num_of_rows] [distribution] [num_of_threads]
+ *                                           generate lineitem into <file>
+ *   columnar compress <file> <out> [encodings]
+ *                                           compress <file> into <out>
+ *   columnar scan <file> [mmap|copy|uring|threads] [depth] [direct] [exchange]
+ *                                           run the query on <file>
+ *
+ * distribution shapes extprice (uniform, zipf, sorted, clustered); discount
+ * is uniform and tax is correlated with discount. The batches are generated
+ * in parallel, each one from its own deterministic random stream.
+ *
+ * encodings is one of auto (default), plain, bitpack, rle or delta for all
+ * columns, or a comma separated list with one per column. The scans decode
+ * compressed columns batch by batch.
+ *
+ * the scan strategies:
+ *   mmap - the vectors point into the mapped pages (zero-copy)
+ *   copy - every batch is copied out of the mapping first, as a read()
+ *          based scan into private buffers would do
+ *   uring - asynchronous read-ahead of depth batches through io_uring (falls
+ *          back to threads if io_uring is not available)
+ *   threads - the same read-ahead with a pool of threads doing pread()
+ *
+ * direct reads with O_DIRECT, so uring and threads always go to the disk.
+ * exchange runs the scan on a thread of its own (see exchange.h).
+ */
+
+
+const uint64_t NUM_OF_ROWS = 100000ull * DEFAULT_VECTOR_SIZE;
+
+
+/**
+ * Ross, Kenneth A. "Conjunctive selection conditions in main memory." Proceedings of
+ * the twenty-first ACM SIGMOD-SIGACT-SIGART symposium on Principles of database systems. 2002.
+ **/
+static uint32_t sel_lt_int32_col_int32_val_nonbranching(uint32_t n,
+                                                        uint32_t *res_sel,
+                                                        int32_t *col,
+                                                        int32_t val,
+                                                        uint32_t *sel) {
+    uint32_t res = 0;
+
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = sel[i];
+            res += (col[sel[i]] < val);
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = i;
+            res += (col[i] < val);
+        }
+    }
+
+    return res;
+}
+
+
+/**
+ * Copies every vector of the child's batches into memory owned by the batch.
+ */
+class CopyOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+
+public:
+    CopyOperator(BaseOperator *next) : next_(next) {}
+
+    ~CopyOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        for (auto& elem : br->data) {
+            auto copy = new DbVector<int32_t>(*elem.second);
+            delete elem.second;
+            elem.second = copy;
+        }
+        return br;
+    }
+};
+
+
+class SelectLessThanOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    std::vector<std::pair<std::string, int32_t>> conds_;
+
+public:
+    SelectLessThanOperator(BaseOperator *next, std::vector<std::pair<std::string, int32_t>> conds) :
+        next_(next), conds_(std::move(conds)) {
+    }
+
+    ~SelectLessThanOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        DbVector<uint32_t> *res_sel = new DbVector<uint32_t>(br->getn());
+        bool first = true;
+        for (const auto& cond : conds_) {
+            DbVector<int32_t> *vec = br->getCol(cond.first);
+            if (first) {
+                res_sel->n = sel_lt_int32_col_int32_val_nonbranching(vec->n, res_sel->col, vec->col, cond.second, nullptr);
+                first = false;
+            }
+            else {
+                res_sel->n = sel_lt_int32_col_int32_val_nonbranching(res_sel->n, res_sel->col, vec->col, cond.second, res_sel->col);
+            }
+        }
+
+        br->res_sel = res_sel;
+        return br;
+    }
+};
+
+
+static ColumnSpec extpriceSpec(const std::string& distribution) {
+    if (distribution == "zipf")
+        return ColumnSpec("extprice", DIST_ZIPF, 100, 1.0);
+    if (distribution == "sorted")
+        return ColumnSpec("extprice", DIST_SORTED, 100);
+    if (distribution == "clustered")
+        return ColumnSpec("extprice", DIST_CLUSTERED, 100, 10);
+    if (distribution == "uniform")
+        return ColumnSpec("extprice", DIST_UNIFORM, 100);
+    throw std::invalid_argument("Unknown distribution " + distribution);
+}
+
+
+static void writeTable(const std::string& path, uint64_t num_of_rows, const std::string& distribution, uint32_t num_of_threads) {
+    std::vector<ColumnSpec> specs{
+        extpriceSpec(distribution),
+        ColumnSpec("discount", DIST_UNIFORM, 100),
+        ColumnSpec("tax", DIST_CORRELATED, 100, 10, "discount"),
+    };
+    DataGenerator generator(specs, ScanOperator::DEFAULT_SEED, num_of_rows);
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    ColumnarFileWriter writer(path, col_names, num_of_rows);
+
+    uint32_t num_of_batches = numOfBatches(num_of_rows, DEFAULT_VECTOR_SIZE);
+    std::atomic<uint32_t> next_batch(0);
+    auto worker = [&]() {
+        std::vector<std::vector<int32_t>> buffers(col_names.size(), std::vector<int32_t>(DEFAULT_VECTOR_SIZE));
+        std::vector<int32_t*> cols{};
+        for (auto& buffer : buffers)
+            cols.push_back(buffer.data());
+
+        for (uint32_t b = next_batch++; b < num_of_batches; b = next_batch++) {
+            uint64_t row = (uint64_t) b * DEFAULT_VECTOR_SIZE;
+            auto n = (uint32_t) std::min<uint64_t>(DEFAULT_VECTOR_SIZE, num_of_rows - row);
+            generator.fillRows(row, n, cols.data());
+            for (uint32_t c = 0; c < cols.size(); c++) {
+                writer.writeColumn(c, row, cols[c], n);
+                writer.updateStats(c, row, cols[c], n);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads{};
+    for (uint32_t t = 1; t < num_of_threads; t++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    writer.finish();
+}
+
+
+static void compressTable(const std::string& path, const std::string& out, const std::string& spec) {
+    ColumnarFile in(path);
+    std::vector<std::string> names = in.getColumnNames();
+    std::vector<uint32_t> encodings{};
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        encodings.push_back(parseEncoding(item));
+    if (encodings.size() == 1)
+        encodings.resize(names.size(), encodings[0]);
+
+    compressColumnarFile(in, out, encodings);
+
+    ColumnarFile res(out);
+    for (const auto& name : names) {
+        const ColumnHeader *before = in.getColumnHeader(name);
+        const ColumnHeader *after = res.getColumnHeader(name);
+        std::cout << name << ": " << encodingName(after->encoding) << ", "
+                  << before->length << " -> " << after->length << " bytes\n";
+    }
+}
+
+
+QueryPlan *compileQuery(ColumnarFile *file, const std::string& strategy, uint32_t depth, bool direct, bool exchange) {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    BaseOperator *scan_op;
+    if (strategy == "mmap")
+        scan_op = new MmapScanOperator(file, col_names);
+    else if (strategy == "copy")
+        scan_op = new CopyOperator(new MmapScanOperator(file, col_names));
+    else if (strategy == "uring")
+        scan_op = new ReadAheadScanOperator(file, col_names, depth, IO_MODE_AUTO, direct);
+    else if (strategy == "threads")
+        scan_op = new ReadAheadScanOperator(file, col_names, depth, IO_MODE_THREADS, direct);
+    else
+        throw std::invalid_argument("Unknown scan strategy " + strategy);
+
+    // the scan (and decompression) on a thread of its own, overlapping with the selection
+    if (exchange)
+        scan_op = new ExchangeOperator(scan_op);
+
+    std::vector<std::pair<std::string, int32_t>> conds{{"extprice", 50}, {"discount", 50}, {"tax", 50}};
+    auto sel_op = new SelectLessThanOperator(scan_op, conds);
+    return new QueryPlan(sel_op, false);
+}
+
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cout << "Usage: columnar write <file> [num_of_rows] [uniform|zipf|sorted|clustered] [num_of_threads]\n"
+                     "       columnar compress <file> <out> [auto|plain|bitpack|rle|delta|<e1,e2,...>]\n"
+                     "       columnar scan <file> [mmap|copy|uring|threads] [depth] [direct] [exchange]\n";
+        return 1;
+    }
+
+    std::string cmd = argv[1];
+    if (cmd == "write") {
+        uint64_t num_of_rows = argc > 3 ? strtoull(argv[3], nullptr, 10) : NUM_OF_ROWS;
+        std::string distribution = argc > 4 ? argv[4] : "uniform";
+        uint32_t num_of_threads = argc > 5 ? (uint32_t) atoi(argv[5]) : std::thread::hardware_concurrency();
+        writeTable(argv[2], num_of_rows, distribution, num_of_threads == 0 ? 1 : num_of_threads);
+        return 0;
+    }
+
+    if (cmd == "compress") {
+        if (argc < 4) {
+            std::cout << "Usage: columnar compress <file> <out> [encodings]\n";
+            return 1;
+        }
+        compressTable(argv[2], argv[3], argc > 4 ? argv[4] : "auto");
+        return 0;
+    }
+
+    std::string strategy = argc > 3 ? argv[3] : "mmap";
+    uint32_t depth = argc > 4 ? (uint32_t) atoi(argv[4]) : 16;
+    bool direct = false;
+    bool exchange = false;
+    for (int i = 5; i < argc; i++) {
+        direct |= strcmp(argv[i], "direct") == 0;
+        exchange |= strcmp(argv[i], "exchange") == 0;
+    }
+    ColumnarFile file(argv[2]);
+    QueryPlan *query_plan = compileQuery(&file, strategy, depth, direct, exchange);
+    query_plan->open();
+    query_plan->printResultSet();
+    query_plan->close();
+    delete query_plan;
+}
@@ -1,5 +1,9 @@
 #include <iostream>
 #include "common.h"
+#include "vector_size.h"
+#include "result_sink.h"
+#include "morsel.h"
+#include "jit.h"
 
 /**
  * This program evaluates the performance of a pure conjunctive selection query.
@@ -29,20 +33,35 @@
  *   jit, branching
  *   jit, non-branching
  *   jit, if (1 && 2), 3 non-branching
+ *   adaptive - starts on the vectorized primitives while the fused loop is
+ *       generated from the predicate and compiled in the background (jit.h),
+ *       then switches to it at the next batch
  *
  */
 
 
 const uint32_t BATCHES = 100000;
+const uint64_t NUM_OF_ROWS = (uint64_t) BATCHES * DEFAULT_VECTOR_SIZE;
 
 
 static uint32_t sel_lt_int32_col_int32_val_branching(uint32_t n,
                                                      uint32_t *res_sel,
                                                      int32_t *col,
                                                      int32_t val,
+                                                     const uint64_t *validity,
                                                      uint32_t *sel) {
     uint32_t res = 0;
 
+    if (validity != nullptr) {
+        // a NULL makes the condition unknown, which drops the row
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t idx = sel == nullptr ? i : sel[i];
+            if (col[idx] < val && validBit(validity, idx))
+                res_sel[res++] = idx;
+        }
+        return res;
+    }
+
     if (sel != nullptr) {
         for (uint32_t i = 0; i < n; i++) {
             if (col[sel[i]] < val)
@@ -68,9 +87,20 @@ static uint32_t sel_lt_int32_col_int32_val_nonbranching(uint32_t n,
                                                         uint32_t *res_sel,
                                                         int32_t *col,
                                                         int32_t val,
+                                                        const uint64_t *validity,
                                                         uint32_t *sel) {
     uint32_t res = 0;
 
+    if (validity != nullptr) {
+        // a NULL makes the condition unknown: its bit clears the mask
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t idx = sel == nullptr ? i : sel[i];
+            res_sel[res] = idx;
+            res += (col[idx] < val) & validBit(validity, idx);
+        }
+        return res;
+    }
+
     if (sel != nullptr) {
         for (uint32_t i = 0; i < n; i++) {
             res_sel[res] = sel[i];
@@ -91,6 +121,11 @@ static uint32_t sel_lt_int32_col_int32_val_nonbranching(uint32_t n,
 #define COND_LT     1
 
 
+/**
+ * A predicate of the compiled plan. Nodes are immutable: the vector a node
+ * reads is bound per call, so one node serves every execution of the plan at
+ * once.
+ */
 class CondDAGNode {
 private:
     int cond_;
@@ -99,21 +134,25 @@ public:
     CondDAGNode(int cond) : cond_(cond) {}
     virtual ~CondDAGNode() = default;
 
-    virtual uint32_t compute(DbVector<uint32_t>* res_sel) = 0;
-    virtual uint32_t compute(DbVector<uint32_t>* res_sel, DbVector<uint32_t>* src_sel) = 0;
+    virtual uint32_t compute(const DbVector<int32_t> *left_vec, DbVector<uint32_t>* res_sel) const = 0;
+    virtual uint32_t compute(const DbVector<int32_t> *left_vec, DbVector<uint32_t>* res_sel,
+                             const DbVector<uint32_t>* src_sel) const = 0;
 
-    virtual void setLeftVector(DbVector<int32_t> *vec) = 0;
-    virtual std::string getLeftColName() = 0;
+    virtual const std::string& getLeftColName() const = 0;
+
+    /**
+     * The condition as a C++ expression on value left of the left column.
+     */
+    virtual std::string generate(const std::string& left) const = 0;
 };
 
 
 class ColValCondDAGNode : public CondDAGNode {
 private:
     bool branching_;
-    uint32_t (*primitive_)(uint32_t, uint32_t*, int32_t*, int32_t, uint32_t*);
+    uint32_t (*primitive_)(uint32_t, uint32_t*, int32_t*, int32_t, const uint64_t*, uint32_t*);
     int32_t right_val_;
 
-    DbVector<int32_t> *left_vec_;
     std::string left_col_name_;
 
 public:
@@ -121,7 +160,6 @@ public:
         CondDAGNode(cond),
         left_col_name_(std::move(left_col_name)),
         branching_(branching),
-        left_vec_(nullptr),
         right_val_(right_val) {
         assignPrimitive_();
     }
@@ -129,22 +167,23 @@ public:
     ~ColValCondDAGNode() final {
     }
 
-    void setLeftVector(DbVector<int32_t> *vec) final {
-        left_vec_ = vec;
+    const std::string& getLeftColName() const final {
+        return left_col_name_;
     }
 
-    std::string getLeftColName() final {
-        return left_col_name_;
+    std::string generate(const std::string& left) const final {
+        return "(" + left + " < " + std::to_string(right_val_) + ")";
     }
 
-    uint32_t compute(DbVector<uint32_t>* res_sel) final {
-        auto n = primitive_(left_vec_->n, res_sel->col, left_vec_->col, right_val_, nullptr);
+    uint32_t compute(const DbVector<int32_t> *left_vec, DbVector<uint32_t>* res_sel) const final {
+        auto n = primitive_(left_vec->n, res_sel->col, left_vec->col, right_val_, left_vec->validity, nullptr);
         res_sel->n = n;
         return n;
     }
 
-    uint32_t compute(DbVector<uint32_t>* res_sel, DbVector<uint32_t>* src_sel) final {
-        auto n = primitive_(src_sel->n, res_sel->col, left_vec_->col, right_val_, src_sel->col);
+    uint32_t compute(const DbVector<int32_t> *left_vec, DbVector<uint32_t>* res_sel,
+                     const DbVector<uint32_t>* src_sel) const final {
+        auto n = primitive_(src_sel->n, res_sel->col, left_vec->col, right_val_, left_vec->validity, src_sel->col);
         res_sel->n = n;
         return n;
     }
@@ -161,23 +200,39 @@ private:
 };
 
 
+typedef std::vector<std::unique_ptr<const CondDAGNode>> CondExpr;
+
+
+/**
+ * Evaluate the conjunction expr on br into res_sel, one primitive per node.
+ */
+static void evaluateCondExpr(const CondExpr& expr, BatchResult *br, DbVector<uint32_t> *res_sel) {
+    bool first = true;
+    for (const auto& node : expr) {
+        DbVector<int32_t> *dbVector = br->getCol(node->getLeftColName());
+        if (first) {
+            node->compute(dbVector, res_sel);
+            first = false;
+        }
+        else {
+            node->compute(dbVector, res_sel, res_sel);
+        }
+    }
+}
+
 
 class SelectVectorizationOnlyBranchingOperator : public BaseOperator {
 private:
     BaseOperator* next_;
-    std::vector<CondDAGNode*> expr_;
+    std::shared_ptr<const CondExpr> expr_;
 
 public:
-    SelectVectorizationOnlyBranchingOperator(BaseOperator *next, std::vector<CondDAGNode*> expr) :
+    SelectVectorizationOnlyBranchingOperator(BaseOperator *next, std::shared_ptr<const CondExpr> expr) :
         next_(next), expr_(std::move(expr)) {
     }
 
     ~SelectVectorizationOnlyBranchingOperator() final {
         delete next_;
-        for (auto node : expr_) {
-            delete node;
-        }
-        expr_.clear();
     }
 
     void open() {
@@ -194,17 +249,106 @@ public:
             return br;
 
         DbVector<uint32_t> *res_sel = new DbVector<uint32_t>(br->getn());
-        bool first = true;
-        for (auto node : expr_) {
-            DbVector<int32_t> *dbVector = br->getCol(node->getLeftColName());
-            node->setLeftVector(dbVector);
-            if (first) {
-                node->compute(res_sel);
-                first = false;
-            }
-            else {
-                node->compute(res_sel, res_sel);
-            }
+        evaluateCondExpr(*expr_, br, res_sel);
+        br->res_sel = res_sel;
+        return br;
+    }
+};
+
+
+/**
+ * The generated selection: the columns of the nodes in expression order.
+ */
+typedef uint32_t (*SelectKernel)(uint32_t n, uint32_t *res_sel, int32_t **cols);
+
+
+/**
+ * The fused loop of SelectJitOperator for any conjunction, as the source of
+ * an extern "C" SelectKernel named symbol.
+ */
+static std::string generateSelectKernel(const CondExpr& expr, bool branching, const std::string& symbol) {
+    std::string cond{};
+    std::string loads{};
+    for (uint32_t k = 0; k < expr.size(); k++) {
+        std::string col = "c" + std::to_string(k);
+        loads += "    const int32_t *" + col + " = cols[" + std::to_string(k) + "];\n";
+        cond += (k == 0 ? "" : (branching ? " && " : " & ")) + expr[k]->generate(col + "[i]");
+    }
+
+    std::string src = "#include <cstdint>\n\n"
+                      "extern \"C\" uint32_t " + symbol + "(uint32_t n, uint32_t *res_sel, int32_t **cols) {\n"
+                      + loads +
+                      "    uint32_t res = 0;\n"
+                      "    for (uint32_t i = 0; i < n; i++) {\n";
+    if (branching) {
+        src += "        if (" + cond + ")\n"
+               "            res_sel[res++] = i;\n";
+    }
+    else {
+        src += "        res_sel[res] = i;\n"
+               "        res += " + cond + ";\n";
+    }
+    src += "    }\n"
+           "    return res;\n"
+           "}\n";
+    return src;
+}
+
+
+/**
+ * Runs expr with the vectorized primitives until kernel is compiled, then
+ * with the generated code; the switch happens at a batch boundary. Batches
+ * with NULLs always take the primitives, the generated code reads values
+ * only.
+ */
+class SelectAdaptiveOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    std::shared_ptr<const CondExpr> expr_;
+    std::shared_ptr<const BackgroundCompilation> kernel_;
+    SelectKernel function_;
+    std::vector<int32_t*> cols_;
+
+public:
+    SelectAdaptiveOperator(BaseOperator *next,
+                           std::shared_ptr<const CondExpr> expr,
+                           std::shared_ptr<const BackgroundCompilation> kernel) :
+        next_(next), expr_(std::move(expr)), kernel_(std::move(kernel)), function_(nullptr), cols_(expr_->size()) {
+    }
+
+    ~SelectAdaptiveOperator() final {
+        delete next_;
+    }
+
+    void open() {
+        next_->open();
+    }
+
+    void close() {
+        next_->close();
+    }
+
+    BatchResult* next() {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        if (function_ == nullptr)
+            function_ = kernel_->getFunction<SelectKernel>();
+
+        bool nulls = false;
+        for (uint32_t k = 0; k < expr_->size(); k++) {
+            const DbVector<int32_t> *vec = br->getCol((*expr_)[k]->getLeftColName());
+            cols_[k] = vec->col;
+            nulls |= vec->hasNulls();
+        }
+
+        DbVector<uint32_t> *res_sel = new DbVector<uint32_t>(br->getn());
+        if (function_ != nullptr && !nulls) {
+            res_sel->n = function_(br->getn(), res_sel->col, cols_.data());
+        }
+        else {
+            evaluateCondExpr(*expr_, br, res_sel);
         }
 
         br->res_sel = res_sel;
@@ -241,6 +385,10 @@ public:
             return br;
 
         uint32_t n = br->getn();
+        if (br->getCol("tax")->hasNulls() || br->getCol("discount")->hasNulls() || br->getCol("extprice")->hasNulls()) {
+            delete br;
+            throw std::invalid_argument("SelectJitOperator does not handle NULLs");
+        }
         int32_t *tax = br->getCol("tax")->col;
         int32_t *discount = br->getCol("discount")->col;
         int32_t *extprice = br->getCol("extprice")->col;
@@ -277,59 +425,214 @@ public:
  **************************************************************************/
 
 
-QueryPlan *compileQuery_Baseline() {
+/**
+ * The scan of lineitem; with morsels, the part of it that ctx.worker claims.
+ */
+static BaseOperator *makeScan(uint32_t vector_size, uint64_t num_of_rows, const ExecutionContext& ctx) {
     std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names, true, 100);
-    return new QueryPlan(scan_op, false);
+    if (ctx.morsels == nullptr)
+        return new ScanOperator(num_of_rows, col_names, true, 100, vector_size);
+
+    std::vector<ColumnSpec> specs{};
+    for (const auto& name : col_names)
+        specs.emplace_back(name, DIST_UNIFORM, 100);
+    DataGenerator generator(specs, ScanOperator::DEFAULT_SEED, num_of_rows);
+    return new MorselScanOperator(ctx.morsels, ctx.worker, generator, num_of_rows, vector_size);
 }
 
 
-QueryPlan *compileQuery_VectorizationOnly_Branching() {
-    std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names, true, 100);
-    std::vector<CondDAGNode*> expr{};
-    expr.push_back(new ColValCondDAGNode(COND_LT, "extprice", 50, true));
-    expr.push_back(new ColValCondDAGNode(COND_LT, "discount", 50, true));
-    expr.push_back(new ColValCondDAGNode(COND_LT, "tax", 50, true));
-
-    SelectVectorizationOnlyBranchingOperator *sel_op = new SelectVectorizationOnlyBranchingOperator(scan_op, expr);
-    return new QueryPlan(sel_op, false);
+static std::shared_ptr<const CondExpr> makeLessThan50(bool branching) {
+    auto expr = std::make_shared<CondExpr>();
+    expr->emplace_back(new ColValCondDAGNode(COND_LT, "extprice", 50, branching));
+    expr->emplace_back(new ColValCondDAGNode(COND_LT, "discount", 50, branching));
+    expr->emplace_back(new ColValCondDAGNode(COND_LT, "tax", 50, branching));
+    return expr;
 }
 
 
-QueryPlan *compileQuery_VectorizationOnly_NonBranching() {
-    std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names, true, 100);
-    std::vector<CondDAGNode*> expr{};
-    expr.push_back(new ColValCondDAGNode(COND_LT, "extprice", 50, false));
-    expr.push_back(new ColValCondDAGNode(COND_LT, "discount", 50, false));
-    expr.push_back(new ColValCondDAGNode(COND_LT, "tax", 50, false));
-
-    SelectVectorizationOnlyBranchingOperator *sel_op = new SelectVectorizationOnlyBranchingOperator(scan_op, expr);
-    return new QueryPlan(sel_op, false);
+std::shared_ptr<const CompiledPlan> compileQuery_Baseline(uint32_t vector_size = DEFAULT_VECTOR_SIZE,
+                                                          uint64_t num_of_rows = NUM_OF_ROWS) {
+    return std::make_shared<const CompiledPlan>([=](const ExecutionContext& ctx) {
+        BaseOperator *scan_op = makeScan(vector_size, num_of_rows, ctx);
+        return new QueryPlan(scan_op, false);
+    });
 }
 
 
-QueryPlan *compileQuery_JIT_Branching() {
-    std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names, true, 100);
-    SelectJitOperator *sel_op = new SelectJitOperator(scan_op, true);
-    return new QueryPlan(sel_op, false);
+std::shared_ptr<const CompiledPlan> compileQuery_VectorizationOnly_Branching(uint32_t vector_size = DEFAULT_VECTOR_SIZE,
+                                                                             uint64_t num_of_rows = NUM_OF_ROWS) {
+    std::shared_ptr<const CondExpr> expr = makeLessThan50(true);
+    return std::make_shared<const CompiledPlan>([=](const ExecutionContext& ctx) {
+        BaseOperator *scan_op = makeScan(vector_size, num_of_rows, ctx);
+        auto *sel_op = new SelectVectorizationOnlyBranchingOperator(scan_op, expr);
+        return new QueryPlan(sel_op, false);
+    });
 }
 
 
-QueryPlan *compileQuery_JIT_NonBranching() {
-    std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names, true, 100);
-    SelectJitOperator *sel_op = new SelectJitOperator(scan_op, false);
-    return new QueryPlan(sel_op, false);
+std::shared_ptr<const CompiledPlan> compileQuery_VectorizationOnly_NonBranching(uint32_t vector_size = DEFAULT_VECTOR_SIZE,
+                                                                                uint64_t num_of_rows = NUM_OF_ROWS) {
+    std::shared_ptr<const CondExpr> expr = makeLessThan50(false);
+    return std::make_shared<const CompiledPlan>([=](const ExecutionContext& ctx) {
+        BaseOperator *scan_op = makeScan(vector_size, num_of_rows, ctx);
+        auto *sel_op = new SelectVectorizationOnlyBranchingOperator(scan_op, expr);
+        return new QueryPlan(sel_op, false);
+    });
 }
 
 
+std::shared_ptr<const CompiledPlan> compileQuery_JIT_Branching(uint32_t vector_size = DEFAULT_VECTOR_SIZE,
+                                                               uint64_t num_of_rows = NUM_OF_ROWS) {
+    return std::make_shared<const CompiledPlan>([=](const ExecutionContext& ctx) {
+        BaseOperator *scan_op = makeScan(vector_size, num_of_rows, ctx);
+        SelectJitOperator *sel_op = new SelectJitOperator(scan_op, true);
+        return new QueryPlan(sel_op, false);
+    });
+}
+
+
+std::shared_ptr<const CompiledPlan> compileQuery_JIT_NonBranching(uint32_t vector_size = DEFAULT_VECTOR_SIZE,
+                                                                  uint64_t num_of_rows = NUM_OF_ROWS) {
+    return std::make_shared<const CompiledPlan>([=](const ExecutionContext& ctx) {
+        BaseOperator *scan_op = makeScan(vector_size, num_of_rows, ctx);
+        SelectJitOperator *sel_op = new SelectJitOperator(scan_op, false);
+        return new QueryPlan(sel_op, false);
+    });
+}
+
+
+/**
+ * The compilation starts here and is shared by every instance of the plan.
+ */
+static std::shared_ptr<const CompiledPlan> compileAdaptive(uint32_t vector_size, uint64_t num_of_rows, bool branching) {
+    std::shared_ptr<const CondExpr> expr = makeLessThan50(branching);
+    auto kernel = std::make_shared<const BackgroundCompilation>(
+            generateSelectKernel(*expr, branching, "select_lt"), "select_lt");
+    return std::make_shared<const CompiledPlan>([=](const ExecutionContext& ctx) {
+        BaseOperator *scan_op = makeScan(vector_size, num_of_rows, ctx);
+        auto *sel_op = new SelectAdaptiveOperator(scan_op, expr, kernel);
+        return new QueryPlan(sel_op, false);
+    });
+}
+
+
+std::shared_ptr<const CompiledPlan> compileQuery_Adaptive_Branching(uint32_t vector_size = DEFAULT_VECTOR_SIZE,
+                                                                    uint64_t num_of_rows = NUM_OF_ROWS) {
+    return compileAdaptive(vector_size, num_of_rows, true);
+}
+
+
+std::shared_ptr<const CompiledPlan> compileQuery_Adaptive_NonBranching(uint32_t vector_size = DEFAULT_VECTOR_SIZE,
+                                                                       uint64_t num_of_rows = NUM_OF_ROWS) {
+    return compileAdaptive(vector_size, num_of_rows, false);
+}
+
+
+const std::vector<std::pair<std::string, std::shared_ptr<const CompiledPlan> (*)(uint32_t, uint64_t)>> STRATEGIES{
+    {"baseline", compileQuery_Baseline},
+    {"vec_branching", compileQuery_VectorizationOnly_Branching},
+    {"vec_nonbranching", compileQuery_VectorizationOnly_NonBranching},
+    {"jit_branching", compileQuery_JIT_Branching},
+    {"jit_nonbranching", compileQuery_JIT_NonBranching},
+    {"adaptive_branching", compileQuery_Adaptive_Branching},
+    {"adaptive_nonbranching", compileQuery_Adaptive_NonBranching},
+};
+
+
 int main(int argc, char*argv[]) {
-    QueryPlan *query_plan = compileQuery_JIT_NonBranching();
+    const char *usage = "usage: conjunctive [vector_size|auto|column] [num_of_rows] [baseline|vec_branching|vec_nonbranching|jit_branching|jit_nonbranching|adaptive_branching|adaptive_nonbranching] [none|text|binary|checksum] [num_of_threads] [morsel_size] [pin]";
+    //   column - column-at-a-time: the whole table is a single batch, so every
+    //            primitive runs once over the full column and materializes
+    //            full-size intermediates (MonetDB's BAT algebra)
+    //   the sink argument picks the result sink: none drops the batches, text
+    //   and binary write the result to stdout (see result_sink.h), checksum
+    //   prints the row count and a checksum of the values
+    //   with num_of_threads > 1 every thread runs its own plan over morsels of
+    //   morsel_size batches (see morsel.h); only none and checksum apply. The
+    //   query is compiled once and every thread instantiates the shared plan;
+    //   pin runs thread w on cpu w
+    uint64_t num_of_rows = argc > 2 ? strtoull(argv[2], nullptr, 10) : NUM_OF_ROWS;
+    std::string strategy = argc > 3 ? argv[3] : "jit_nonbranching";
+
+    std::shared_ptr<const CompiledPlan> (*compile)(uint32_t, uint64_t) = nullptr;
+    for (const auto& elem : STRATEGIES) {
+        if (strategy == elem.first)
+            compile = elem.second;
+    }
+    if (compile == nullptr) {
+        std::cout << "Unknown strategy " << strategy << "\n";
+        return 1;
+    }
+
+    // 3 columns + selection vector
+    uint32_t vector_size = parseVectorSizeArg(argc, argv, num_of_rows, DEFAULT_VECTOR_SIZE, usage, 4,
+                                              [compile](uint32_t n, uint32_t num_of_batches) {
+        QueryPlan *plan = compile(n, (uint64_t) num_of_batches * n)->instantiate();
+        plan->open();
+        plan->printResultSet();
+        plan->close();
+        delete plan;
+    });
+    if (vector_size == 0)
+        return 1;
+
+    std::string sink_name = argc > 4 ? argv[4] : "none";
+    uint32_t num_of_threads = argc > 5 ? parseCount(argv[5], UINT32_MAX) : 1;
+    uint32_t morsel_size = argc > 6 ? parseCount(argv[6], UINT32_MAX) : 64;
+    bool pin = argc > 7 && strcmp(argv[7], "pin") == 0;
+    if (num_of_threads == 0 || morsel_size == 0) {
+        std::cout << "num_of_threads and morsel_size must be at least 1\n" << usage << "\n";
+        return 1;
+    }
+    std::shared_ptr<const CompiledPlan> compiled = compile(vector_size, num_of_rows);
+    if (num_of_threads > 1) {
+        if (sink_name != "none" && sink_name != "checksum") {
+            std::cout << "Only the none and checksum sinks run in parallel\n";
+            return 1;
+        }
+
+        MorselQueue morsels(numOfBatches(num_of_rows, vector_size), num_of_threads, morsel_size);
+        // none only drops the rows, like printResultSet does with one thread
+        bool checksum = sink_name == "checksum";
+        std::vector<ChecksumSink> checksum_sinks(checksum ? num_of_threads : 0);
+        std::vector<CountSink> count_sinks(checksum ? 0 : num_of_threads);
+        std::vector<ResultSink*> sink_ptrs{};
+        for (uint32_t w = 0; w < num_of_threads; w++)
+            sink_ptrs.push_back(checksum ? (ResultSink*) &checksum_sinks[w] : &count_sinks[w]);
+        executeParallel([&](uint32_t worker) {
+            return compiled->instantiate(ExecutionContext{&morsels, worker});
+        }, sink_ptrs, pin);
+
+        if (checksum) {
+            uint64_t count = 0;
+            uint64_t sum = 0;
+            for (const auto& sink : checksum_sinks) {
+                count += sink.getCount();
+                sum += sink.getChecksum();
+            }
+            std::cout << count << " rows, checksum " << std::hex << sum << std::dec << "\n";
+        }
+        return 0;
+    }
+
+    QueryPlan *query_plan = compiled->instantiate();
     query_plan->open();
-    query_plan->printResultSet();
+    if (sink_name == "text") {
+        TextSink sink(STDOUT_FILENO);
+        query_plan->execute(&sink);
+    }
+    else if (sink_name == "binary") {
+        BinarySink sink(STDOUT_FILENO);
+        query_plan->execute(&sink);
+    }
+    else if (sink_name == "checksum") {
+        ChecksumSink sink;
+        query_plan->execute(&sink);
+        std::cout << sink.getCount() << " rows, checksum " << std::hex << sink.getChecksum() << std::dec << "\n";
+    }
+    else {
+        query_plan->printResultSet();
+    }
     query_plan->close();
     delete query_plan;
-}
\ No newline at end of file
+}
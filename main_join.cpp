@@ -0,0 +1,796 @@
+#include <iostream>
+#include <stdexcept>
+#include <coroutine>
+#include "common.h"
+#include "vector_size.h"
+#include "result_sink.h"
+#include "hash.h"
+#include "bloom.h"
+#include "partition.h"
+#include "runtime_filter.h"
+
+/**
+ * This program evaluates hash joins.
+ *
+ *   select p.k, p.v, b.payload
+ *   from probe p, build b
+ *   where p.k = b.bk
+ *
+ * build has unique keys 0 .. build_rows-1, the keys of probe are uniform
+ * over a range that makes match_percent of them find a partner.
+ *
+ * The build side is materialized into a bucket-chained table: a directory of
+ * power-of-two size holding the first row of each bucket, a next array
+ * chaining the rows, and the keys and payloads as columns indexed by row.
+ * Optionally a blocked bloom filter (bloom.h) over the build keys lets probe
+ * rows without a partner skip the directory and the chains, which is where
+ * the cache misses of a large build side are.
+ *
+ *   vectorized - a probe batch goes through separate primitives: hash the
+ *       keys, (bloom filter,) fetch the bucket heads, compare the keys and
+ *       step down the chains of the candidates left, then gather the result
+ *       columns
+ *   jit - one fused loop per probe row (the code a query compiler would
+ *       generate)
+ *   interleaved - every probe row is a coroutine that prefetches the next
+ *       cache line it needs and suspends; a group of GROUP_SIZE of them is
+ *       resumed round robin, so their misses overlap instead of being paid
+ *       one after the other (Psaropoulos et al., "Interleaving with
+ *       Coroutines", VLDB 2017)
+ *
+ * The _partitioned variants radix partition both sides first (partition.h),
+ * with enough partitions for the table of one to fit half the L2, then join
+ * a partition at a time. The bloom filter indexes its words by the same top
+ * hash bits the partitions share, so the two do not go together.
+ *
+ * The _sip variants push filters over the build keys (runtime_filter.h)
+ * into the probe scan once the table is built, so probe rows without a
+ * partner are dropped in the scan. With sparse build keys (every
+ * 100/match_percent-th key of the probe range instead of the first ones)
+ * the range of the build keys covers the probe keys and only the bloom
+ * filter prunes.
+ */
+
+
+const uint32_t BATCHES = 100000;
+const uint64_t NUM_OF_ROWS = (uint64_t) BATCHES * DEFAULT_VECTOR_SIZE;
+// lookups in flight per interleaved probe, enough to cover a DRAM miss
+const uint32_t GROUP_SIZE = 16;
+
+
+/************************************************************************
+ *
+ * Hash table
+ *
+ **************************************************************************/
+
+
+/**
+ * The build side of a hash join. Rows are appended, then finish() links them
+ * into the directory (and the bloom filter). Directory entries and next
+ * links are row + 1, 0 ending a chain.
+ */
+class JoinHashTable {
+public:
+    std::vector<uint32_t> directory;
+    uint32_t mask;
+    std::vector<uint32_t> next;
+    std::vector<int32_t> keys;
+    std::vector<int32_t> payloads;
+    std::unique_ptr<BlockedBloomFilter> bloom;
+
+    JoinHashTable() : mask(0) {}
+
+    void append(uint32_t n, const int32_t *key_col, const int32_t *payload_col, const uint32_t *sel) {
+        for (uint32_t j = 0; j < n; j++) {
+            uint32_t i = sel != nullptr ? sel[j] : j;
+            keys.push_back(key_col[i]);
+            payloads.push_back(payload_col[i]);
+        }
+    }
+
+    void finish(bool with_bloom) {
+        auto num_of_rows = (uint32_t) keys.size();
+        uint32_t size = 16;
+        while (size < num_of_rows)
+            size <<= 1;
+        directory.assign(size, 0);
+        mask = size - 1;
+        next.assign(num_of_rows, 0);
+        bloom.reset(with_bloom ? new BlockedBloomFilter(num_of_rows) : nullptr);
+
+        for (uint32_t r = 0; r < num_of_rows; r++) {
+            uint32_t hash = hashInt32(keys[r]);
+            uint32_t& head = directory[hash & mask];
+            next[r] = head;
+            head = r + 1;
+            if (with_bloom)
+                bloom->insert(hash);
+        }
+    }
+};
+
+
+/**
+ * The build child is drained into the table by the first next(). Each probe
+ * batch then yields a batch with one row per matching pair: the probe key
+ * and value, and the build payload. Batches without matches are skipped.
+ *
+ * With partition_bits, the first next() radix partitions both children on
+ * their keys instead. Partition p of the build side then goes into a fresh
+ * table, and partition p of the probe side is probed against it in slices
+ * of DEFAULT_VECTOR_SIZE rows.
+ *
+ * pushRuntimeFilters(scan) makes the operator push filters over the build
+ * keys into scan, which must produce the probe rows, before the first
+ * probe row is pulled.
+ */
+class HashJoinOperator : public BaseOperator {
+protected:
+    BaseOperator* probe_;
+    BaseOperator* build_;
+    std::string probe_key_;
+    std::string probe_value_;
+    std::string build_key_;
+    std::string build_payload_;
+    bool with_bloom_;
+    uint32_t partition_bits_;
+    JoinHashTable table_;
+    bool built_;
+    std::unique_ptr<RadixPartitioner> build_partitions_;
+    std::unique_ptr<RadixPartitioner> probe_partitions_;
+    uint32_t partition_;
+    uint64_t probe_pos_;
+    uint64_t probe_end_;
+    ScanOperator *filter_scan_;
+
+public:
+    HashJoinOperator(BaseOperator *probe, BaseOperator *build,
+                     std::string probe_key, std::string probe_value,
+                     std::string build_key, std::string build_payload,
+                     bool with_bloom, uint32_t partition_bits) :
+        probe_(probe),
+        build_(build),
+        probe_key_(std::move(probe_key)),
+        probe_value_(std::move(probe_value)),
+        build_key_(std::move(build_key)),
+        build_payload_(std::move(build_payload)),
+        with_bloom_(with_bloom),
+        partition_bits_(partition_bits),
+        built_(false),
+        partition_(0),
+        probe_pos_(0),
+        probe_end_(0),
+        filter_scan_(nullptr) {
+        if (with_bloom && partition_bits > 0)
+            throw std::invalid_argument("a partitioned join has no bloom filter");
+    }
+
+    ~HashJoinOperator() override {
+        delete probe_;
+        delete build_;
+    }
+
+    void open() final {
+        probe_->open();
+        build_->open();
+        table_ = JoinHashTable();
+        built_ = false;
+        build_partitions_.reset();
+        probe_partitions_.reset();
+        partition_ = 0;
+        probe_pos_ = 0;
+        probe_end_ = 0;
+    }
+
+    void close() final {
+        probe_->close();
+        build_->close();
+    }
+
+    void pushRuntimeFilters(ScanOperator *scan) {
+        filter_scan_ = scan;
+    }
+
+    BatchResult* next() final {
+        if (partition_bits_ > 0)
+            return nextPartitioned_();
+
+        if (!built_) {
+            while (true) {
+                std::unique_ptr<BatchResult> br(build_->next());
+                if (br == nullptr)
+                    break;
+                const DbVector<uint32_t> *sel = br->res_sel;
+                table_.append(sel == nullptr ? br->getn() : sel->n,
+                              br->getCol(build_key_)->col,
+                              br->getCol(build_payload_)->col,
+                              sel == nullptr ? nullptr : sel->col);
+            }
+            table_.finish(with_bloom_);
+            pushFilters_(table_.keys.data(), table_.keys.size());
+            built_ = true;
+        }
+
+        while (true) {
+            std::unique_ptr<BatchResult> br(probe_->next());
+            if (br == nullptr)
+                return nullptr;
+
+            const DbVector<uint32_t> *sel = br->res_sel;
+            BatchResult *res = probeBatch_(sel == nullptr ? br->getn() : sel->n,
+                                           br->getCol(probe_key_)->col,
+                                           br->getCol(probe_value_)->col,
+                                           sel == nullptr ? nullptr : sel->col);
+            if (res != nullptr)
+                return res;
+        }
+    }
+
+protected:
+    /**
+     * Join n probe rows, row j being keys[sel[j]] and values[sel[j]] (index
+     * j without sel); nullptr if none of them matches.
+     */
+    virtual BatchResult* probeBatch_(uint32_t n, const int32_t *keys, const int32_t *values, const uint32_t *sel) = 0;
+
+    BatchResult* newResult_(uint32_t n) const {
+        return new BatchResult({probe_key_, probe_value_, build_payload_}, n);
+    }
+
+private:
+    void pushFilters_(const int32_t *keys, uint64_t num_of_keys) {
+        if (filter_scan_ == nullptr)
+            return;
+        for (auto& filter : makeKeyFilters(probe_key_, keys, num_of_keys))
+            filter_scan_->pushFilter(std::move(filter));
+    }
+
+    BatchResult* nextPartitioned_() {
+        if (!built_) {
+            build_partitions_ = partitionChild_(build_, build_key_, build_payload_);
+            if (filter_scan_ != nullptr) {
+                // the partitions are separated by padding
+                std::vector<int32_t> keys{};
+                for (uint32_t p = 0; p < build_partitions_->getNumOfPartitions(); p++)
+                    keys.insert(keys.end(), build_partitions_->getCol(0) + build_partitions_->getBegin(p),
+                                build_partitions_->getCol(0) + build_partitions_->getEnd(p));
+                pushFilters_(keys.data(), keys.size());
+            }
+            probe_partitions_ = partitionChild_(probe_, probe_key_, probe_value_);
+            built_ = true;
+        }
+
+        while (true) {
+            if (probe_pos_ == probe_end_) {
+                if (partition_ == build_partitions_->getNumOfPartitions())
+                    return nullptr;
+                buildPartition_(partition_++);
+                continue;
+            }
+
+            auto n = (uint32_t) std::min<uint64_t>(DEFAULT_VECTOR_SIZE, probe_end_ - probe_pos_);
+            BatchResult *res = probeBatch_(n, probe_partitions_->getCol(0) + probe_pos_,
+                                           probe_partitions_->getCol(1) + probe_pos_, nullptr);
+            probe_pos_ += n;
+            if (res != nullptr)
+                return res;
+        }
+    }
+
+    std::unique_ptr<RadixPartitioner> partitionChild_(BaseOperator *child, const std::string& key, const std::string& value) const {
+        std::unique_ptr<RadixPartitioner> partitions(new RadixPartitioner({key, value}, key, partition_bits_));
+        while (true) {
+            std::unique_ptr<BatchResult> br(child->next());
+            if (br == nullptr)
+                break;
+            partitions->append(br.get());
+        }
+        partitions->partition();
+        return partitions;
+    }
+
+    void buildPartition_(uint32_t partition) {
+        uint64_t begin = build_partitions_->getBegin(partition);
+        table_ = JoinHashTable();
+        table_.append((uint32_t) (build_partitions_->getEnd(partition) - begin),
+                      build_partitions_->getCol(0) + begin, build_partitions_->getCol(1) + begin, nullptr);
+        table_.finish(false);
+        probe_pos_ = probe_partitions_->getBegin(partition);
+        probe_end_ = probe_partitions_->getEnd(partition);
+    }
+};
+
+
+class HashJoinVectorizedOperator : public HashJoinOperator {
+private:
+    // per probe row
+    std::vector<uint32_t> hashes_;
+    // the candidates: probe row and build row + 1
+    std::vector<uint32_t> cand_probe_;
+    std::vector<uint32_t> cand_build_;
+    // the matches: probe row (in the input batch) and build row
+    std::vector<uint32_t> match_probe_;
+    std::vector<uint32_t> match_build_;
+
+public:
+    HashJoinVectorizedOperator(BaseOperator *probe, BaseOperator *build,
+                               std::string probe_key, std::string probe_value,
+                               std::string build_key, std::string build_payload,
+                               bool with_bloom, uint32_t partition_bits = 0) :
+        HashJoinOperator(probe, build, std::move(probe_key), std::move(probe_value),
+                         std::move(build_key), std::move(build_payload), with_bloom, partition_bits) {
+    }
+
+protected:
+    BatchResult* probeBatch_(uint32_t n, const int32_t *keys, const int32_t *values, const uint32_t *sel) final {
+        if (hashes_.size() < n) {
+            for (auto v : {&hashes_, &cand_probe_, &cand_build_})
+                v->resize(n);
+        }
+        uint32_t *hashes = hashes_.data();
+        uint32_t *cand_probe = cand_probe_.data();
+        uint32_t *cand_build = cand_build_.data();
+
+        hash_int32_col(n, hashes, keys, sel);
+
+        uint32_t m;
+        if (table_.bloom != nullptr) {
+            m = table_.bloom->filter(n, cand_probe, hashes);
+        }
+        else {
+            for (uint32_t j = 0; j < n; j++)
+                cand_probe[j] = j;
+            m = n;
+        }
+
+        // bucket heads, the empty buckets drop out
+        const uint32_t *directory = table_.directory.data();
+        uint32_t k = 0;
+        for (uint32_t t = 0; t < m; t++) {
+            uint32_t j = cand_probe[t];
+            uint32_t head = directory[hashes[j] & table_.mask];
+            cand_probe[k] = j;
+            cand_build[k] = head;
+            k += head != 0;
+        }
+
+        // row j of the batch is row j of the input with sel
+        if (sel != nullptr) {
+            for (uint32_t t = 0; t < k; t++)
+                cand_probe[t] = sel[cand_probe[t]];
+        }
+
+        uint32_t num_of_matches = 0;
+        const int32_t *build_keys = table_.keys.data();
+        const uint32_t *next = table_.next.data();
+        while (k > 0) {
+            if (match_probe_.size() < num_of_matches + k) {
+                match_probe_.resize(std::max<size_t>(num_of_matches + k, 2 * match_probe_.size()));
+                match_build_.resize(match_probe_.size());
+            }
+            uint32_t *match_probe = match_probe_.data();
+            uint32_t *match_build = match_build_.data();
+
+            // compare keys
+            for (uint32_t t = 0; t < k; t++) {
+                uint32_t r = cand_build[t] - 1;
+                match_probe[num_of_matches] = cand_probe[t];
+                match_build[num_of_matches] = r;
+                num_of_matches += build_keys[r] == keys[cand_probe[t]];
+            }
+
+            // follow the chains
+            uint32_t k2 = 0;
+            for (uint32_t t = 0; t < k; t++) {
+                uint32_t r = next[cand_build[t] - 1];
+                cand_probe[k2] = cand_probe[t];
+                cand_build[k2] = r;
+                k2 += r != 0;
+            }
+            k = k2;
+        }
+
+        if (num_of_matches == 0)
+            return nullptr;
+
+        BatchResult *res = newResult_(num_of_matches);
+        gather_int32_col(num_of_matches, res->getCol(probe_key_)->col, keys, match_probe_.data());
+        gather_int32_col(num_of_matches, res->getCol(probe_value_)->col, values, match_probe_.data());
+        gather_int32_col(num_of_matches, res->getCol(build_payload_)->col, table_.payloads.data(), match_build_.data());
+        return res;
+    }
+};
+
+
+class HashJoinJitOperator : public HashJoinOperator {
+public:
+    HashJoinJitOperator(BaseOperator *probe, BaseOperator *build,
+                        std::string probe_key, std::string probe_value,
+                        std::string build_key, std::string build_payload,
+                        bool with_bloom, uint32_t partition_bits = 0) :
+        HashJoinOperator(probe, build, std::move(probe_key), std::move(probe_value),
+                         std::move(build_key), std::move(build_payload), with_bloom, partition_bits) {
+    }
+
+protected:
+    BatchResult* probeBatch_(uint32_t n, const int32_t *keys, const int32_t *values, const uint32_t *sel) final {
+        // a build key matches at most once unless it is duplicated
+        uint32_t capacity = n;
+        BatchResult *res = newResult_(capacity);
+        int32_t *out_key = res->getCol(probe_key_)->col;
+        int32_t *out_value = res->getCol(probe_value_)->col;
+        int32_t *out_payload = res->getCol(build_payload_)->col;
+
+        const BlockedBloomFilter *bloom = table_.bloom.get();
+        const uint32_t *directory = table_.directory.data();
+        const uint32_t *next = table_.next.data();
+        const int32_t *build_keys = table_.keys.data();
+        const int32_t *payloads = table_.payloads.data();
+        uint32_t num_of_matches = 0;
+        for (uint32_t j = 0; j < n; j++) {
+            uint32_t i = sel != nullptr ? sel[j] : j;
+            int32_t key = keys[i];
+            uint32_t hash = hashInt32(key);
+            if (bloom != nullptr && !bloom->contains(hash))
+                continue;
+
+            for (uint32_t r = directory[hash & table_.mask]; r != 0; r = next[r - 1]) {
+                if (build_keys[r - 1] != key)
+                    continue;
+                if (num_of_matches == capacity) {
+                    capacity *= 2;
+                    grow_(res, capacity);
+                    out_key = res->getCol(probe_key_)->col;
+                    out_value = res->getCol(probe_value_)->col;
+                    out_payload = res->getCol(build_payload_)->col;
+                }
+                out_key[num_of_matches] = key;
+                out_value[num_of_matches] = values[i];
+                out_payload[num_of_matches] = payloads[r - 1];
+                num_of_matches++;
+            }
+        }
+
+        if (num_of_matches == 0) {
+            delete res;
+            return nullptr;
+        }
+        for (auto& elem : res->data)
+            elem.second->n = num_of_matches;
+        return res;
+    }
+
+private:
+    static void grow_(BatchResult *br, uint32_t capacity) {
+        for (auto& elem : br->data) {
+            auto vec = new DbVector<int32_t>(capacity);
+            memcpy(vec->col, elem.second->col, sizeof(int32_t) * elem.second->n);
+            delete elem.second;
+            elem.second = vec;
+        }
+    }
+};
+
+
+/**
+ * A lookup coroutine. It starts running when created and suspends after each
+ * prefetch; the owner resumes it until done(). Frames are recycled through a
+ * per-thread free list, so starting a lookup does not go to malloc.
+ */
+class ProbeTask {
+public:
+    struct promise_type {
+        ProbeTask get_return_object() {
+            return ProbeTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            throw;
+        }
+
+        static void* operator new(size_t size) {
+            FramePool& pool = framePool_();
+            if (size == pool.size && !pool.frames.empty()) {
+                void *frame = pool.frames.back();
+                pool.frames.pop_back();
+                return frame;
+            }
+            return ::operator new(size);
+        }
+
+        static void operator delete(void *frame, size_t size) {
+            FramePool& pool = framePool_();
+            if (pool.size == 0)
+                pool.size = size;
+            if (size == pool.size)
+                pool.frames.push_back(frame);
+            else
+                ::operator delete(frame);
+        }
+    };
+
+    ProbeTask() = default;
+
+    ProbeTask(ProbeTask&& other) noexcept : handle_(other.handle_) {
+        other.handle_ = nullptr;
+    }
+
+    ProbeTask& operator=(ProbeTask&& other) noexcept {
+        if (this != &other) {
+            if (handle_)
+                handle_.destroy();
+            handle_ = other.handle_;
+            other.handle_ = nullptr;
+        }
+        return *this;
+    }
+
+    ~ProbeTask() {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    explicit operator bool() const {
+        return (bool) handle_;
+    }
+
+    bool done() const {
+        return handle_.done();
+    }
+
+    void resume() const {
+        handle_.resume();
+    }
+
+private:
+    struct FramePool {
+        size_t size = 0;
+        std::vector<void*> frames;
+
+        ~FramePool() {
+            for (void *frame : frames)
+                ::operator delete(frame);
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle_;
+
+    explicit ProbeTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    static FramePool& framePool_() {
+        static thread_local FramePool pool;
+        return pool;
+    }
+};
+
+
+class HashJoinInterleavedOperator : public HashJoinOperator {
+private:
+    std::vector<uint32_t> hashes_;
+    std::vector<uint32_t> match_probe_;
+    std::vector<uint32_t> match_build_;
+    std::vector<ProbeTask> group_;
+
+public:
+    HashJoinInterleavedOperator(BaseOperator *probe, BaseOperator *build,
+                                std::string probe_key, std::string probe_value,
+                                std::string build_key, std::string build_payload,
+                                bool with_bloom, uint32_t partition_bits = 0, uint32_t group_size = GROUP_SIZE) :
+        HashJoinOperator(probe, build, std::move(probe_key), std::move(probe_value),
+                         std::move(build_key), std::move(build_payload), with_bloom, partition_bits),
+        group_(group_size) {
+        if (group_size == 0)
+            throw std::invalid_argument("group size must be positive");
+    }
+
+protected:
+    BatchResult* probeBatch_(uint32_t n, const int32_t *keys, const int32_t *values, const uint32_t *sel) final {
+        if (hashes_.size() < n)
+            hashes_.resize(n);
+        hash_int32_col(n, hashes_.data(), keys, sel);
+        match_probe_.clear();
+        match_build_.clear();
+
+        // fills a slot with the next lookup that did not finish right away
+        uint32_t j = 0;
+        auto start = [&](ProbeTask& slot) {
+            while (j < n) {
+                uint32_t i = sel != nullptr ? sel[j] : j;
+                slot = lookup_(i, keys[i], hashes_[j]);
+                j++;
+                if (!slot.done())
+                    return true;
+            }
+            slot = ProbeTask();
+            return false;
+        };
+
+        uint32_t num_of_active = 0;
+        for (auto& slot : group_)
+            num_of_active += start(slot);
+        while (num_of_active > 0) {
+            for (auto& slot : group_) {
+                if (!slot)
+                    continue;
+                slot.resume();
+                if (slot.done())
+                    num_of_active -= !start(slot);
+            }
+        }
+
+        auto num_of_matches = (uint32_t) match_probe_.size();
+        if (num_of_matches == 0)
+            return nullptr;
+
+        BatchResult *res = newResult_(num_of_matches);
+        gather_int32_col(num_of_matches, res->getCol(probe_key_)->col, keys, match_probe_.data());
+        gather_int32_col(num_of_matches, res->getCol(probe_value_)->col, values, match_probe_.data());
+        gather_int32_col(num_of_matches, res->getCol(build_payload_)->col, table_.payloads.data(), match_build_.data());
+        return res;
+    }
+
+private:
+    /**
+     * Looks up probe row i; every cache line that is likely a miss is
+     * prefetched before suspending and only touched after resumption.
+     */
+    ProbeTask lookup_(uint32_t i, int32_t key, uint32_t hash) {
+        const BlockedBloomFilter *bloom = table_.bloom.get();
+        if (bloom != nullptr) {
+            bloom->prefetch(hash);
+            co_await std::suspend_always();
+            if (!bloom->contains(hash))
+                co_return;
+        }
+
+        const uint32_t *bucket = &table_.directory[hash & table_.mask];
+        __builtin_prefetch(bucket);
+        co_await std::suspend_always();
+
+        const int32_t *build_keys = table_.keys.data();
+        const uint32_t *next = table_.next.data();
+        for (uint32_t r = *bucket; r != 0; r = next[r - 1]) {
+            __builtin_prefetch(&build_keys[r - 1]);
+            __builtin_prefetch(&next[r - 1]);
+            co_await std::suspend_always();
+            if (build_keys[r - 1] == key) {
+                match_probe_.push_back(i);
+                match_build_.push_back(r - 1);
+            }
+        }
+    }
+};
+
+
+
+/************************************************************************
+ *
+ * Query compiler
+ *
+ **************************************************************************/
+
+
+static ScanOperator *makeProbeScan(uint32_t vector_size, uint64_t num_of_rows, uint32_t build_rows, uint32_t match_percent) {
+    auto key_range = (int32_t) std::min<uint64_t>(INT32_MAX, (uint64_t) build_rows * 100 / match_percent);
+    std::vector<ColumnSpec> specs{};
+    specs.emplace_back("k", DIST_UNIFORM, key_range);
+    specs.emplace_back("v", DIST_UNIFORM, 100);
+    return makeScan(specs, num_of_rows, vector_size);
+}
+
+
+static ScanOperator *makeBuildScan(uint32_t build_rows, uint32_t match_percent, bool sparse) {
+    // unique keys: row i has key i, or i * 100/match_percent if sparse
+    uint64_t num_of_rows = build_rows;
+    uint64_t stride = sparse ? 100 / match_percent : 1;
+    std::vector<ColumnSpec> specs{};
+    specs.emplace_back("bk", DIST_SORTED, (int32_t) std::min<uint64_t>(INT32_MAX, num_of_rows * stride));
+    specs.emplace_back("payload", DIST_UNIFORM, 100);
+    return makeScan(specs, num_of_rows, DEFAULT_VECTOR_SIZE, ScanOperator::DEFAULT_SEED + 1);
+}
+
+
+/**
+ * The radix bits that make the table of a partition fit half the L2: a
+ * build row takes its key, payload and next link, and up to two directory
+ * entries.
+ */
+static uint32_t partitionBits(uint32_t build_rows) {
+    const uint64_t bytes_per_row = 2 * sizeof(int32_t) + 3 * sizeof(uint32_t);
+    return radixBitsFor(build_rows * bytes_per_row, detectCacheInfo().l2);
+}
+
+
+template<class JoinOperator, bool with_bloom, bool partitioned = false, bool sip = false>
+QueryPlan *compileQuery_Join(uint32_t vector_size, uint64_t num_of_rows, uint32_t build_rows, uint32_t match_percent, bool sparse) {
+    auto probe_op = makeProbeScan(vector_size, num_of_rows, build_rows, match_percent);
+    auto build_op = makeBuildScan(build_rows, match_percent, sparse);
+    auto join_op = new JoinOperator(probe_op, build_op, "k", "v", "bk", "payload", with_bloom,
+                                    partitioned ? partitionBits(build_rows) : 0);
+    if (sip)
+        join_op->pushRuntimeFilters(probe_op);
+    return new QueryPlan(join_op, false);
+}
+
+
+QueryPlan *compileQuery_Baseline(uint32_t vector_size, uint64_t num_of_rows, uint32_t build_rows, uint32_t match_percent, bool) {
+    return new QueryPlan(makeProbeScan(vector_size, num_of_rows, build_rows, match_percent), false);
+}
+
+
+const std::vector<std::pair<std::string, QueryPlan *(*)(uint32_t, uint64_t, uint32_t, uint32_t, bool)>> STRATEGIES{
+    {"baseline", compileQuery_Baseline},
+    {"vectorized", compileQuery_Join<HashJoinVectorizedOperator, false>},
+    {"vectorized_bloom", compileQuery_Join<HashJoinVectorizedOperator, true>},
+    {"jit", compileQuery_Join<HashJoinJitOperator, false>},
+    {"jit_bloom", compileQuery_Join<HashJoinJitOperator, true>},
+    {"interleaved", compileQuery_Join<HashJoinInterleavedOperator, false>},
+    {"interleaved_bloom", compileQuery_Join<HashJoinInterleavedOperator, true>},
+    {"vectorized_partitioned", compileQuery_Join<HashJoinVectorizedOperator, false, true>},
+    {"jit_partitioned", compileQuery_Join<HashJoinJitOperator, false, true>},
+    {"vectorized_sip", compileQuery_Join<HashJoinVectorizedOperator, false, false, true>},
+    {"jit_sip", compileQuery_Join<HashJoinJitOperator, false, false, true>},
+    {"vectorized_partitioned_sip", compileQuery_Join<HashJoinVectorizedOperator, false, true, true>},
+};
+
+
+int main(int argc, char **argv) {
+    const char *usage = "usage: join [vector_size|auto|column] [num_of_rows] [baseline|vectorized|vectorized_bloom|jit|jit_bloom|interleaved|interleaved_bloom|vectorized_partitioned|jit_partitioned|vectorized_sip|jit_sip|vectorized_partitioned_sip] [build_rows] [match_percent] [dense|sparse]";
+    //   num_of_rows is the size of the probe side
+    //   sparse spreads the build keys over the range of the probe keys
+    //   prints the number of result rows and a checksum of them
+    uint64_t num_of_rows = argc > 2 ? strtoull(argv[2], nullptr, 10) : NUM_OF_ROWS;
+    std::string strategy = argc > 3 ? argv[3] : "vectorized_bloom";
+    uint32_t build_rows = argc > 4 ? parseCount(argv[4], INT32_MAX) : 1u << 22;
+    uint32_t match_percent = argc > 5 ? parseCount(argv[5], 100) : 10;
+    bool sparse = argc > 6 && strcmp(argv[6], "sparse") == 0;
+    if (build_rows == 0) {
+        std::cout << "build_rows must be 1 to " << INT32_MAX << "\n" << usage << "\n";
+        return 1;
+    }
+    if (match_percent == 0) {
+        std::cout << "match_percent must be 1 to 100\n" << usage << "\n";
+        return 1;
+    }
+
+    QueryPlan *(*compile)(uint32_t, uint64_t, uint32_t, uint32_t, bool) = nullptr;
+    for (const auto& elem : STRATEGIES) {
+        if (strategy == elem.first)
+            compile = elem.second;
+    }
+    if (compile == nullptr) {
+        std::cout << "Unknown strategy " << strategy << "\n";
+        return 1;
+    }
+
+    // 2 columns + hashes, 2 candidate lists, 2 match lists and 3 result columns
+    uint32_t vector_size = parseVectorSizeArg(argc, argv, num_of_rows, DEFAULT_VECTOR_SIZE, usage, 10,
+                                              [compile, build_rows, match_percent, sparse](uint32_t n, uint32_t num_of_batches) {
+        QueryPlan *plan = compile(n, (uint64_t) num_of_batches * n, build_rows, match_percent, sparse);
+        plan->open();
+        plan->printResultSet();
+        plan->close();
+        delete plan;
+    });
+    if (vector_size == 0)
+        return 1;
+
+    QueryPlan *query_plan = compile(vector_size, num_of_rows, build_rows, match_percent, sparse);
+    query_plan->open();
+    ChecksumSink sink;
+    query_plan->execute(&sink);
+    query_plan->close();
+    delete query_plan;
+    std::cout << sink.getCount() << " rows, checksum " << std::hex << sink.getChecksum() << std::dec << "\n";
+}
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <chrono>
+#include <sstream>
+#include "loader.h"
+
+/**
+ * Loads a TPC-H .tbl (or any delimited text) file into a columnar file.
+ *
+ *   loader <input> <output> [lineitem|<columns>] [delimiter] [num_of_threads] [header]
+ *
+ * lineitem loads the lineitem columns used by the other programs:
+ *   orderkey, quantity, extprice (cents), discount (%), tax (%), shipdate (yyyymmdd)
+ *
+ * <columns> is a comma separated list of name:field:type[:scale] with type
+ * int, decimal or date, e.g. "a:0:int,price:3:decimal:2". header skips the
+ * first line of a CSV file.
+ */
+
+
+static std::vector<LoaderColumn> lineitemColumns() {
+    return {
+        {"orderkey", 0, FIELD_INT, 0},
+        {"quantity", 4, FIELD_DECIMAL, 0},
+        {"extprice", 5, FIELD_DECIMAL, 2},
+        {"discount", 6, FIELD_DECIMAL, 2},
+        {"tax", 7, FIELD_DECIMAL, 2},
+        {"shipdate", 10, FIELD_DATE, 0},
+    };
+}
+
+
+static std::vector<LoaderColumn> parseColumns(const std::string& spec) {
+    std::vector<LoaderColumn> res{};
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::vector<std::string> parts{};
+        std::stringstream is(item);
+        std::string part;
+        while (std::getline(is, part, ':'))
+            parts.push_back(part);
+        if (parts.size() < 3)
+            throw std::invalid_argument("Bad column spec " + item);
+
+        LoaderColumn col{parts[0], (uint32_t) std::stoul(parts[1]), 0, 0};
+        if (parts[2] == "int")
+            col.type = FIELD_INT;
+        else if (parts[2] == "decimal")
+            col.type = FIELD_DECIMAL;
+        else if (parts[2] == "date")
+            col.type = FIELD_DATE;
+        else
+            throw std::invalid_argument("Bad column type " + parts[2]);
+        if (parts.size() > 3)
+            col.scale = (uint32_t) std::stoul(parts[3]);
+        res.push_back(col);
+    }
+    return res;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cout << "Usage: loader <input> <output> [lineitem|<columns>] [delimiter] [num_of_threads] [header]\n";
+        return 1;
+    }
+
+    std::string spec = argc > 3 ? argv[3] : "lineitem";
+    char delimiter = argc > 4 ? argv[4][0] : '|';
+    uint32_t num_of_threads = argc > 5 ? (uint32_t) atoi(argv[5]) : std::thread::hardware_concurrency();
+    bool skip_header = argc > 6 && strcmp(argv[6], "header") == 0;
+
+    std::vector<LoaderColumn> columns = spec == "lineitem" ? lineitemColumns() : parseColumns(spec);
+    BulkLoader loader(columns, delimiter, skip_header, num_of_threads);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t rows = loader.load(argv[1], argv[2]);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << rows << " rows loaded in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << "ms\n";
+}
@@ -0,0 +1,412 @@
+#include <iostream>
+#include <memory>
+#include "common.h"
+#include "vector_size.h"
+
+/**
+ * This program evaluates the cost of NULL handling.
+ *
+ *   select extprice * (100 - discount) * (100 + tax)
+ *   from lineitem
+ *   where tax < 90
+ *
+ * where every column is nullable. A NULL operand makes the product NULL and
+ * a NULL tax makes the condition unknown, i.e. the row is filtered out.
+ *
+ * the program evaluates the following strategies:
+ *   bitmap - the arithmetic is computed for all lanes, NULL or not, and the
+ *            validity bitmaps are combined with a word-wide AND; the selection
+ *            folds the validity bit into its non-branching mask. A vector
+ *            without NULLs has no bitmap and takes the plain primitives.
+ *   branching - the classic way, checking every value for NULL with a branch.
+ *
+ * null_fraction controls the share of NULLs in every column, 0 means the
+ * vectors carry no bitmap at all.
+ */
+
+
+const uint32_t BATCHES = 100000;
+const uint64_t NUM_OF_ROWS = (uint64_t) BATCHES * DEFAULT_VECTOR_SIZE;
+
+
+/**
+ * Ross, Kenneth A. "Conjunctive selection conditions in main memory." Proceedings of
+ * the twenty-first ACM SIGMOD-SIGACT-SIGART symposium on Principles of database systems. 2002.
+ **/
+static uint32_t sel_lt_int32_col_int32_val_nonbranching(uint32_t n,
+                                                        uint32_t *res_sel,
+                                                        int32_t *col,
+                                                        int32_t val,
+                                                        uint32_t *sel) {
+    uint32_t res = 0;
+
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = sel[i];
+            res += (col[sel[i]] < val);
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = i;
+            res += (col[i] < val);
+        }
+    }
+
+    return res;
+}
+
+
+/**
+ * The non-branching selection with the validity bit ANDed into the mask.
+ * Without a bitmap it is the plain primitive; on dense input whole words
+ * that are all-valid or all-NULL skip the per-value bit test.
+ */
+static uint32_t sel_lt_int32_col_int32_val_nullable(uint32_t n,
+                                                    uint32_t *res_sel,
+                                                    int32_t *col,
+                                                    int32_t val,
+                                                    uint64_t *validity,
+                                                    uint32_t *sel) {
+    if (validity == nullptr)
+        return sel_lt_int32_col_int32_val_nonbranching(n, res_sel, col, val, sel);
+
+    uint32_t res = 0;
+
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = sel[i];
+            res += (col[sel[i]] < val) & validBit(validity, sel[i]);
+        }
+        return res;
+    }
+
+    for (uint32_t base = 0; base < n; base += 64) {
+        uint32_t end = base + 64 < n ? base + 64 : n;
+        uint64_t word = validity[base >> 6];
+        if (word == 0)
+            continue;
+
+        if (word == ~0ull) {
+            for (uint32_t i = base; i < end; i++) {
+                res_sel[res] = i;
+                res += (col[i] < val);
+            }
+        }
+        else {
+            for (uint32_t i = base; i < end; i++) {
+                res_sel[res] = i;
+                res += (col[i] < val) & ((word >> (i & 63)) & 1);
+            }
+        }
+    }
+
+    return res;
+}
+
+
+static uint32_t sel_lt_int32_col_int32_val_nullbranching(uint32_t n,
+                                                         uint32_t *res_sel,
+                                                         DbVector<int32_t> *vec,
+                                                         int32_t val,
+                                                         uint32_t *sel) {
+    uint32_t res = 0;
+    int32_t *col = vec->col;
+
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (!vec->isNull(sel[i]) && col[sel[i]] < val)
+                res_sel[res++] = sel[i];
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++) {
+            if (!vec->isNull(i) && col[i] < val)
+                res_sel[res++] = i;
+        }
+    }
+
+    return res;
+}
+
+
+static uint32_t map_sub_int32_val_int32_col(uint32_t n, int32_t *res, int32_t val, int32_t *col2) {
+    for (uint32_t i = 0; i < n; i++)
+        res[i] = val - col2[i];
+    return n;
+}
+
+
+static uint32_t map_add_int32_val_int32_col(uint32_t n, int32_t *res, int32_t val, int32_t *col2) {
+    for (uint32_t i = 0; i < n; i++)
+        res[i] = val + col2[i];
+    return n;
+}
+
+
+static uint32_t map_mul_int32_col_int32_col(uint32_t n, int32_t *res, int32_t *col1, int32_t *col2) {
+    for (uint32_t i = 0; i < n; i++)
+        res[i] = col1[i] * col2[i];
+    return n;
+}
+
+
+/**
+ * Marks null_fraction of the values of every column of the child's batches
+ * as NULL. The positions come from a xorshift stream so that the NULLs do
+ * not cost a rand() call each.
+ */
+class NullableScanOperator : public BaseOperator {
+private:
+    BaseOperator *next_;
+    uint32_t null_threshold_;
+    uint64_t state_;
+
+public:
+    NullableScanOperator(BaseOperator *next, double null_fraction) :
+        next_(next),
+        null_threshold_((uint32_t) (null_fraction * 4294967295.0)),
+        state_(0x9E3779B97F4A7C15ull) {
+    }
+
+    ~NullableScanOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        BatchResult *br = next_->next();
+        if (br == nullptr || null_threshold_ == 0)
+            return br;
+
+        for (auto& elem : br->data) {
+            DbVector<int32_t> *v = elem.second;
+            uint32_t n = v->n;
+            uint32_t words = validityWords(n);
+            auto validity = new uint64_t[words];
+            memset(validity, 0, sizeof(uint64_t)*words);
+            for (uint32_t i = 0; i < n; i++) {
+                state_ ^= state_ << 13;
+                state_ ^= state_ >> 7;
+                state_ ^= state_ << 17;
+                uint64_t valid = (uint32_t) state_ >= null_threshold_;
+                validity[i >> 6] |= valid << (i & 63);
+            }
+            v->setValidity(validity);
+        }
+
+        return br;
+    }
+};
+
+
+class SelectNullableOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    std::string col_name_;
+    int32_t val_;
+    bool branching_;
+
+public:
+    SelectNullableOperator(BaseOperator *next, std::string col_name, int32_t val, bool branching) :
+        next_(next), col_name_(std::move(col_name)), val_(val), branching_(branching) {
+    }
+
+    ~SelectNullableOperator() final {
+        delete next_;
+    }
+
+    void open() {
+        next_->open();
+    }
+
+    void close() {
+        next_->close();
+    }
+
+    BatchResult* next() {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        DbVector<int32_t> *vec = br->getCol(col_name_);
+        DbVector<uint32_t> *res_sel = new DbVector<uint32_t>(vec->n);
+        if (branching_)
+            res_sel->n = sel_lt_int32_col_int32_val_nullbranching(vec->n, res_sel->col, vec, val_, nullptr);
+        else
+            res_sel->n = sel_lt_int32_col_int32_val_nullable(vec->n, res_sel->col, vec->col, val_, vec->validity, nullptr);
+
+        br->res_sel = res_sel;
+        return br;
+    }
+};
+
+
+/**
+ * extprice * (100 - discount) * (100 + tax) over all lanes of the batch; the
+ * selection vector is kept. The result is NULL where any operand is NULL.
+ */
+class ProjectNullableComputeAllOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+
+public:
+    ProjectNullableComputeAllOperator(BaseOperator *next) :
+        next_(next) {}
+
+    ~ProjectNullableComputeAllOperator() final {
+        delete next_;
+    }
+
+    void open() {
+        next_->open();
+    }
+
+    void close() {
+        next_->close();
+    }
+
+    BatchResult* next() {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        uint32_t n = br->getn();
+        DbVector<int32_t> *tax = br->getCol("tax");
+        DbVector<int32_t> *discount = br->getCol("discount");
+        DbVector<int32_t> *extprice = br->getCol("extprice");
+
+        std::unique_ptr<DbVector<int32_t>> tmp1(new DbVector<int32_t>(n));
+        std::unique_ptr<DbVector<int32_t>> tmp2(new DbVector<int32_t>(n));
+        DbVector<int32_t> *res = new DbVector<int32_t>(n);
+        map_sub_int32_val_int32_col(n, tmp1->col, 100, discount->col);
+        map_add_int32_val_int32_col(n, tmp2->col, 100, tax->col);
+        map_mul_int32_col_int32_col(n, tmp1->col, extprice->col, tmp1->col);
+        map_mul_int32_col_int32_col(n, res->col, tmp1->col, tmp2->col);
+
+        std::unique_ptr<uint64_t[]> validity(validity_and(n, extprice->validity, discount->validity));
+        res->setValidity(validity_and(n, validity.get(), tax->validity));
+
+        br->add("price", res);
+        br->remove("tax");
+        br->remove("extprice");
+        br->remove("discount");
+
+        return br;
+    }
+};
+
+
+class ProjectNullBranchingOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+
+public:
+    ProjectNullBranchingOperator(BaseOperator *next) :
+        next_(next) {}
+
+    ~ProjectNullBranchingOperator() final {
+        delete next_;
+    }
+
+    void open() {
+        next_->open();
+    }
+
+    void close() {
+        next_->close();
+    }
+
+    BatchResult* next() {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        uint32_t n = br->getn();
+        DbVector<int32_t> *tax = br->getCol("tax");
+        DbVector<int32_t> *discount = br->getCol("discount");
+        DbVector<int32_t> *extprice = br->getCol("extprice");
+        DbVector<int32_t> *res = new DbVector<int32_t>(n);
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (extprice->isNull(i) || discount->isNull(i) || tax->isNull(i))
+                res->setNull(i);
+            else
+                res->col[i] = extprice->col[i] * (100 - discount->col[i]) * (100 + tax->col[i]);
+        }
+
+        br->add("price", res);
+        br->remove("tax");
+        br->remove("extprice");
+        br->remove("discount");
+
+        return br;
+    }
+};
+
+
+/************************************************************************
+ *
+ * Query compiler
+ *
+ **************************************************************************/
+
+
+QueryPlan *compileQuery_Baseline(double null_fraction, uint32_t vector_size = DEFAULT_VECTOR_SIZE) {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    auto scan_op = new ScanOperator(NUM_OF_ROWS, col_names, true, 100, vector_size);
+    auto null_op = new NullableScanOperator(scan_op, null_fraction);
+    return new QueryPlan(null_op, false);
+}
+
+
+QueryPlan *compileQuery_Bitmap(double null_fraction, uint32_t vector_size = DEFAULT_VECTOR_SIZE) {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    auto scan_op = new ScanOperator(NUM_OF_ROWS, col_names, true, 100, vector_size);
+    auto null_op = new NullableScanOperator(scan_op, null_fraction);
+    auto sel_op = new SelectNullableOperator(null_op, "tax", 90, false);
+    auto proj_op = new ProjectNullableComputeAllOperator(sel_op);
+    return new QueryPlan(proj_op, false);
+}
+
+
+QueryPlan *compileQuery_NullBranching(double null_fraction, uint32_t vector_size = DEFAULT_VECTOR_SIZE) {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    auto scan_op = new ScanOperator(NUM_OF_ROWS, col_names, true, 100, vector_size);
+    auto null_op = new NullableScanOperator(scan_op, null_fraction);
+    auto sel_op = new SelectNullableOperator(null_op, "tax", 90, true);
+    auto proj_op = new ProjectNullBranchingOperator(sel_op);
+    return new QueryPlan(proj_op, false);
+}
+
+
+int main(int argc, char **argv) {
+    const char *usage = "usage: nullable [baseline|bitmap|branching] [null_fraction] [vector_size]";
+    std::string strategy = argc > 1 ? argv[1] : "bitmap";
+    double null_fraction = argc > 2 ? atof(argv[2]) : 0.1;
+    uint32_t vector_size = argc > 3 ? parseVectorSize(argv[3]) : DEFAULT_VECTOR_SIZE;
+    if (vector_size == 0) {
+        std::cout << "Invalid vector size " << argv[3] << "\n" << usage << "\n";
+        return 1;
+    }
+
+    QueryPlan *query_plan = nullptr;
+    if (strategy == "baseline")
+        query_plan = compileQuery_Baseline(null_fraction, vector_size);
+    else if (strategy == "branching")
+        query_plan = compileQuery_NullBranching(null_fraction, vector_size);
+    else
+        query_plan = compileQuery_Bitmap(null_fraction, vector_size);
+
+    query_plan->open();
+    query_plan->printResultSet();
+    query_plan->close();
+    delete query_plan;
+}
@@ -0,0 +1,721 @@
+#include <iostream>
+#include <climits>
+#include <stdexcept>
+#include "common.h"
+#include "vector_size.h"
+#include "codegen.h"
+
+/**
+ * This program evaluates TPC-H Q6, an ungrouped aggregation over a
+ * selective conjunction:
+ *
+ *   select sum(extprice * discount) as revenue, count(*), min(extprice), max(extprice)
+ *   from lineitem
+ *   where shipdate >= 365 and shipdate < 730
+ *     and discount between 5 and 7
+ *     and quantity < 24
+ *
+ * shipdate is uniform over 7 years of days, discount over [0, 10] percent,
+ * quantity over [0, 50) and extprice over [0, 100000) cents; about 1.9% of
+ * the rows qualify. count, min and max come along with the sum of Q6 so
+ * that every kind of aggregate runs.
+ *
+ * The aggregates are int64 and a BatchResult only carries int32 columns, so
+ * the aggregation operator is the root of the plan and yields no batches: it
+ * stores the aggregates in a result the caller passes in.
+ *
+ *   vectorized - three selection operators refine a selection vector, and
+ *       the aggregation consumes it; extprice * discount is multiplied into
+ *       the sum and never materialized as a column
+ *   bitmap - the aggregation evaluates the conjunction itself into a bitmap
+ *       (one AND per 64 rows and predicate) and aggregates all rows of a
+ *       non-empty word with the bit as a mask, so its loops have no
+ *       indirection
+ *   jit - one hand-written fused loop evaluates the predicates and updates
+ *       the aggregates
+ *   codegen - that loop generated from the plan scan -> select -> project ->
+ *       aggregate (codegen.h) and compiled at run time
+ */
+
+
+const uint32_t BATCHES = 100000;
+const uint64_t NUM_OF_ROWS = (uint64_t) BATCHES * DEFAULT_VECTOR_SIZE;
+
+
+#define AGGR_COUNT  1
+#define AGGR_SUM    2
+#define AGGR_MIN    3
+#define AGGR_MAX    4
+
+
+/**
+ * func of left (times right, if set); count ignores both.
+ */
+struct AggregateSpec {
+    int func;
+    std::string left;
+    std::string right;
+};
+
+
+/**
+ * lo <= col <= hi
+ */
+struct BetweenPredicate {
+    std::string col;
+    int32_t lo;
+    int32_t hi;
+};
+
+
+static inline int64_t initialAggregate(int func) {
+    switch (func) {
+        case AGGR_MIN:
+            return INT64_MAX;
+        case AGGR_MAX:
+            return INT64_MIN;
+        default:
+            return 0;
+    }
+}
+
+
+/************************************************************************
+ *
+ * Selection primitives
+ *
+ **************************************************************************/
+
+
+/**
+ * lo <= x <= hi as one unsigned compare.
+ */
+static inline bool between(int32_t x, int32_t lo, int32_t hi) {
+    return (uint32_t) x - (uint32_t) lo <= (uint32_t) hi - (uint32_t) lo;
+}
+
+
+static uint32_t sel_between_int32_col_int32_val_int32_val(uint32_t n,
+                                                         uint32_t *res_sel,
+                                                         const int32_t *col,
+                                                         int32_t lo,
+                                                         int32_t hi,
+                                                         const uint32_t *sel) {
+    uint32_t res = 0;
+
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = sel[i];
+            res += between(col[sel[i]], lo, hi);
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = i;
+            res += between(col[i], lo, hi);
+        }
+    }
+
+    return res;
+}
+
+
+/**
+ * bitmap &= the bits of lo <= col[i] <= hi, for the n dense values of col.
+ */
+static void bitmap_and_between_int32_col_int32_val_int32_val(uint32_t n,
+                                                             uint64_t *bitmap,
+                                                             const int32_t *col,
+                                                             int32_t lo,
+                                                             int32_t hi) {
+    for (uint32_t base = 0; base < n; base += 64) {
+        uint64_t word = bitmap[base >> 6];
+        if (word == 0)
+            continue;
+
+        uint32_t end = base + 64 < n ? base + 64 : n;
+        uint64_t mask = 0;
+        for (uint32_t i = base; i < end; i++)
+            mask |= (uint64_t) between(col[i], lo, hi) << (i & 63);
+        bitmap[base >> 6] = word & mask;
+    }
+}
+
+
+/**
+ * bitmap = the n rows of sel (all n rows without sel), for m dense rows.
+ */
+static void bitmap_from_sel(uint32_t m, uint64_t *bitmap, uint32_t n, const uint32_t *sel) {
+    uint32_t words = validityWords(m);
+    if (sel == nullptr) {
+        memset(bitmap, 0xFF, sizeof(uint64_t) * words);
+        if (m & 63)
+            bitmap[words - 1] = (1ull << (m & 63)) - 1;
+        return;
+    }
+
+    memset(bitmap, 0, sizeof(uint64_t) * words);
+    for (uint32_t i = 0; i < n; i++)
+        bitmap[sel[i] >> 6] |= 1ull << (sel[i] & 63);
+}
+
+
+
+/************************************************************************
+ *
+ * Aggregation primitives
+ *
+ **************************************************************************/
+
+
+static void aggr_sum_int64_int32_col(uint32_t n, int64_t *res, const int32_t *col, const uint32_t *sel) {
+    int64_t sum = 0;
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++)
+            sum += col[sel[i]];
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++)
+            sum += col[i];
+    }
+    *res += sum;
+}
+
+
+/**
+ * res += sum of left * right, without materializing the products.
+ */
+static void aggr_sum_int64_mul_int32_col_int32_col(uint32_t n, int64_t *res,
+                                                   const int32_t *left, const int32_t *right,
+                                                   const uint32_t *sel) {
+    int64_t sum = 0;
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++)
+            sum += (int64_t) left[sel[i]] * right[sel[i]];
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++)
+            sum += (int64_t) left[i] * right[i];
+    }
+    *res += sum;
+}
+
+
+static void aggr_min_int64_int32_col(uint32_t n, int64_t *res, const int32_t *col, const uint32_t *sel) {
+    int32_t min = INT32_MAX;
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++)
+            min = std::min(min, col[sel[i]]);
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++)
+            min = std::min(min, col[i]);
+    }
+    if (n > 0)
+        *res = std::min<int64_t>(*res, min);
+}
+
+
+static void aggr_max_int64_int32_col(uint32_t n, int64_t *res, const int32_t *col, const uint32_t *sel) {
+    int32_t max = INT32_MIN;
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++)
+            max = std::max(max, col[sel[i]]);
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++)
+            max = std::max(max, col[i]);
+    }
+    if (n > 0)
+        *res = std::max<int64_t>(*res, max);
+}
+
+
+static void aggr_count_int64_bitmap(uint32_t n, int64_t *res, const uint64_t *bitmap) {
+    int64_t count = 0;
+    for (uint32_t w = 0; w < validityWords(n); w++)
+        count += __builtin_popcountll(bitmap[w]);
+    *res += count;
+}
+
+
+/*
+ * The bitmap primitives visit the words with a bit set and run over all 64
+ * values of such a word, masking the ones not selected.
+ */
+
+
+static void aggr_sum_int64_int32_col_bitmap(uint32_t n, int64_t *res, const int32_t *col, const uint64_t *bitmap) {
+    int64_t sum = 0;
+    for (uint32_t base = 0; base < n; base += 64) {
+        uint64_t word = bitmap[base >> 6];
+        if (word == 0)
+            continue;
+        uint32_t end = base + 64 < n ? base + 64 : n;
+        for (uint32_t i = base; i < end; i++)
+            sum += (int64_t) col[i] & -(int64_t) ((word >> (i & 63)) & 1);
+    }
+    *res += sum;
+}
+
+
+static void aggr_sum_int64_mul_int32_col_int32_col_bitmap(uint32_t n, int64_t *res,
+                                                          const int32_t *left, const int32_t *right,
+                                                          const uint64_t *bitmap) {
+    int64_t sum = 0;
+    for (uint32_t base = 0; base < n; base += 64) {
+        uint64_t word = bitmap[base >> 6];
+        if (word == 0)
+            continue;
+        uint32_t end = base + 64 < n ? base + 64 : n;
+        for (uint32_t i = base; i < end; i++)
+            sum += ((int64_t) left[i] * right[i]) & -(int64_t) ((word >> (i & 63)) & 1);
+    }
+    *res += sum;
+}
+
+
+static void aggr_min_int64_int32_col_bitmap(uint32_t n, int64_t *res, const int32_t *col, const uint64_t *bitmap) {
+    int32_t min = INT32_MAX;
+    bool any = false;
+    for (uint32_t base = 0; base < n; base += 64) {
+        uint64_t word = bitmap[base >> 6];
+        if (word == 0)
+            continue;
+        any = true;
+        uint32_t end = base + 64 < n ? base + 64 : n;
+        for (uint32_t i = base; i < end; i++)
+            min = std::min(min, ((word >> (i & 63)) & 1) ? col[i] : INT32_MAX);
+    }
+    if (any)
+        *res = std::min<int64_t>(*res, min);
+}
+
+
+static void aggr_max_int64_int32_col_bitmap(uint32_t n, int64_t *res, const int32_t *col, const uint64_t *bitmap) {
+    int32_t max = INT32_MIN;
+    bool any = false;
+    for (uint32_t base = 0; base < n; base += 64) {
+        uint64_t word = bitmap[base >> 6];
+        if (word == 0)
+            continue;
+        any = true;
+        uint32_t end = base + 64 < n ? base + 64 : n;
+        for (uint32_t i = base; i < end; i++)
+            max = std::max(max, ((word >> (i & 63)) & 1) ? col[i] : INT32_MIN);
+    }
+    if (any)
+        *res = std::max<int64_t>(*res, max);
+}
+
+
+
+/************************************************************************
+ *
+ * Operators
+ *
+ **************************************************************************/
+
+
+/**
+ * Refines the selection vector of a batch by a conjunction of between
+ * predicates, one non-branching primitive each.
+ */
+class SelectBetweenOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    std::vector<BetweenPredicate> predicates_;
+
+public:
+    SelectBetweenOperator(BaseOperator *next, std::vector<BetweenPredicate> predicates) :
+            next_(next), predicates_(std::move(predicates)) {
+    }
+
+    ~SelectBetweenOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        DbVector<uint32_t> *res_sel = new DbVector<uint32_t>(br->getn());
+        uint32_t n = br->res_sel == nullptr ? br->getn() : br->res_sel->n;
+        const uint32_t *sel = br->res_sel == nullptr ? nullptr : br->res_sel->col;
+        for (const auto& pred : predicates_) {
+            n = sel_between_int32_col_int32_val_int32_val(n, res_sel->col, br->getCol(pred.col)->col,
+                                                          pred.lo, pred.hi, sel);
+            sel = res_sel->col;
+        }
+        res_sel->n = n;
+
+        delete br->res_sel;
+        br->res_sel = res_sel;
+        return br;
+    }
+};
+
+
+/**
+ * Ungrouped aggregation, the root of a plan: the first next() consumes the
+ * child and stores the aggregates in results (one per spec), then it and
+ * every later call return nullptr.
+ *
+ * Without filters the rows of a batch are those of its selection vector.
+ * With filters the aggregation evaluates them into a bitmap over the rows
+ * of the batch and aggregates through that.
+ */
+class AggregateUngroupedOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    std::vector<AggregateSpec> specs_;
+    std::vector<BetweenPredicate> filters_;
+    std::vector<int64_t>* results_;
+    std::vector<uint64_t> bitmap_;
+    bool done_;
+
+public:
+    AggregateUngroupedOperator(BaseOperator *next, std::vector<AggregateSpec> specs,
+                               std::vector<BetweenPredicate> filters, std::vector<int64_t> *results) :
+            next_(next),
+            specs_(std::move(specs)),
+            filters_(std::move(filters)),
+            results_(results),
+            done_(false) {
+        for (const auto& spec : specs_) {
+            if (spec.func < AGGR_COUNT || spec.func > AGGR_MAX)
+                throw std::invalid_argument("unknown aggregate function " + std::to_string(spec.func));
+            if (!spec.right.empty() && spec.func != AGGR_SUM)
+                throw std::invalid_argument("only sum takes a product");
+        }
+    }
+
+    ~AggregateUngroupedOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+        done_ = false;
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        if (done_)
+            return nullptr;
+
+        results_->clear();
+        for (const auto& spec : specs_)
+            results_->push_back(initialAggregate(spec.func));
+
+        while (true) {
+            std::unique_ptr<BatchResult> br(next_->next());
+            if (br == nullptr)
+                break;
+            if (filters_.empty())
+                consumeSel_(br.get());
+            else
+                consumeBitmap_(br.get());
+        }
+        done_ = true;
+        return nullptr;
+    }
+
+private:
+    void consumeSel_(BatchResult *br) {
+        const DbVector<uint32_t> *sel_vec = br->res_sel;
+        uint32_t n = sel_vec == nullptr ? br->getn() : sel_vec->n;
+        const uint32_t *sel = sel_vec == nullptr ? nullptr : sel_vec->col;
+
+        for (size_t a = 0; a < specs_.size(); a++) {
+            const AggregateSpec& spec = specs_[a];
+            int64_t *res = &(*results_)[a];
+            if (spec.func == AGGR_COUNT) {
+                *res += n;
+                continue;
+            }
+
+            const int32_t *left = br->getCol(spec.left)->col;
+            switch (spec.func) {
+                case AGGR_SUM:
+                    if (spec.right.empty())
+                        aggr_sum_int64_int32_col(n, res, left, sel);
+                    else
+                        aggr_sum_int64_mul_int32_col_int32_col(n, res, left, br->getCol(spec.right)->col, sel);
+                    break;
+                case AGGR_MIN:
+                    aggr_min_int64_int32_col(n, res, left, sel);
+                    break;
+                case AGGR_MAX:
+                    aggr_max_int64_int32_col(n, res, left, sel);
+                    break;
+            }
+        }
+    }
+
+    void consumeBitmap_(BatchResult *br) {
+        uint32_t m = br->getn();
+        if (bitmap_.size() < validityWords(m))
+            bitmap_.resize(validityWords(m));
+        uint64_t *bitmap = bitmap_.data();
+
+        const DbVector<uint32_t> *sel_vec = br->res_sel;
+        bitmap_from_sel(m, bitmap, sel_vec == nullptr ? m : sel_vec->n, sel_vec == nullptr ? nullptr : sel_vec->col);
+        for (const auto& pred : filters_)
+            bitmap_and_between_int32_col_int32_val_int32_val(m, bitmap, br->getCol(pred.col)->col, pred.lo, pred.hi);
+
+        for (size_t a = 0; a < specs_.size(); a++) {
+            const AggregateSpec& spec = specs_[a];
+            int64_t *res = &(*results_)[a];
+            if (spec.func == AGGR_COUNT) {
+                aggr_count_int64_bitmap(m, res, bitmap);
+                continue;
+            }
+
+            const int32_t *left = br->getCol(spec.left)->col;
+            switch (spec.func) {
+                case AGGR_SUM:
+                    if (spec.right.empty())
+                        aggr_sum_int64_int32_col_bitmap(m, res, left, bitmap);
+                    else
+                        aggr_sum_int64_mul_int32_col_int32_col_bitmap(m, res, left, br->getCol(spec.right)->col, bitmap);
+                    break;
+                case AGGR_MIN:
+                    aggr_min_int64_int32_col_bitmap(m, res, left, bitmap);
+                    break;
+                case AGGR_MAX:
+                    aggr_max_int64_int32_col_bitmap(m, res, left, bitmap);
+                    break;
+            }
+        }
+    }
+};
+
+
+/**
+ * Q6 as one fused loop per batch, with the same results as an
+ * AggregateUngroupedOperator over the Q6 specs.
+ */
+class AggregateQ6JitOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    std::vector<int64_t>* results_;
+    bool done_;
+
+public:
+    AggregateQ6JitOperator(BaseOperator *next, std::vector<int64_t> *results) :
+            next_(next), results_(results), done_(false) {
+    }
+
+    ~AggregateQ6JitOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+        done_ = false;
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        if (done_)
+            return nullptr;
+
+        int64_t revenue = 0;
+        int64_t count = 0;
+        int32_t min = INT32_MAX;
+        int32_t max = INT32_MIN;
+        while (true) {
+            std::unique_ptr<BatchResult> br(next_->next());
+            if (br == nullptr)
+                break;
+
+            const int32_t *shipdate = br->getCol("shipdate")->col;
+            const int32_t *discount = br->getCol("discount")->col;
+            const int32_t *quantity = br->getCol("quantity")->col;
+            const int32_t *extprice = br->getCol("extprice")->col;
+            const DbVector<uint32_t> *sel = br->res_sel;
+            uint32_t n = sel == nullptr ? br->getn() : sel->n;
+            for (uint32_t j = 0; j < n; j++) {
+                uint32_t i = sel == nullptr ? j : sel->col[j];
+                if (shipdate[i] >= 365 && shipdate[i] < 730 &&
+                    discount[i] >= 5 && discount[i] <= 7 &&
+                    quantity[i] < 24) {
+                    revenue += (int64_t) extprice[i] * discount[i];
+                    count++;
+                    min = std::min(min, extprice[i]);
+                    max = std::max(max, extprice[i]);
+                }
+            }
+        }
+
+        *results_ = {revenue, count,
+                     count > 0 ? min : initialAggregate(AGGR_MIN),
+                     count > 0 ? max : initialAggregate(AGGR_MAX)};
+        done_ = true;
+        return nullptr;
+    }
+};
+
+
+
+/************************************************************************
+ *
+ * Query compiler
+ *
+ **************************************************************************/
+
+
+static const std::vector<std::string> RESULT_NAMES{"revenue", "count", "min_extprice", "max_extprice"};
+
+
+static std::vector<AggregateSpec> q6Aggregates() {
+    return {
+        {AGGR_SUM, "extprice", "discount"},
+        {AGGR_COUNT, "", ""},
+        {AGGR_MIN, "extprice", ""},
+        {AGGR_MAX, "extprice", ""},
+    };
+}
+
+
+static std::vector<BetweenPredicate> q6Predicates() {
+    return {
+        {"shipdate", 365, 729},
+        {"discount", 5, 7},
+        {"quantity", INT32_MIN, 23},
+    };
+}
+
+
+static std::vector<ColumnSpec> lineitemSpecs() {
+    std::vector<ColumnSpec> specs{};
+    specs.emplace_back("shipdate", DIST_UNIFORM, 7 * 365);
+    specs.emplace_back("discount", DIST_UNIFORM, 11);
+    specs.emplace_back("quantity", DIST_UNIFORM, 50);
+    specs.emplace_back("extprice", DIST_UNIFORM, 100000);
+    return specs;
+}
+
+
+QueryPlan *compileQuery_Baseline(uint32_t vector_size, uint64_t num_of_rows, std::vector<int64_t> * /*results*/) {
+    return new QueryPlan(makeScan(lineitemSpecs(), num_of_rows, vector_size), false);
+}
+
+
+QueryPlan *compileQuery_Vectorized(uint32_t vector_size, uint64_t num_of_rows, std::vector<int64_t> *results) {
+    auto scan_op = makeScan(lineitemSpecs(), num_of_rows, vector_size);
+    auto sel_op = new SelectBetweenOperator(scan_op, q6Predicates());
+    auto aggr_op = new AggregateUngroupedOperator(sel_op, q6Aggregates(), {}, results);
+    return new QueryPlan(aggr_op, false);
+}
+
+
+QueryPlan *compileQuery_Bitmap(uint32_t vector_size, uint64_t num_of_rows, std::vector<int64_t> *results) {
+    auto scan_op = makeScan(lineitemSpecs(), num_of_rows, vector_size);
+    auto aggr_op = new AggregateUngroupedOperator(scan_op, q6Aggregates(), q6Predicates(), results);
+    return new QueryPlan(aggr_op, false);
+}
+
+
+QueryPlan *compileQuery_JIT(uint32_t vector_size, uint64_t num_of_rows, std::vector<int64_t> *results) {
+    auto scan_op = makeScan(lineitemSpecs(), num_of_rows, vector_size);
+    auto aggr_op = new AggregateQ6JitOperator(scan_op, results);
+    return new QueryPlan(aggr_op, false);
+}
+
+
+/**
+ * Q6 as a pipeline of code generating nodes, the predicates as one
+ * conjunction and extprice * discount projected before the sum.
+ */
+static std::shared_ptr<const CompiledPipeline> q6Pipeline() {
+    CgExprPtr cond = nullptr;
+    for (const auto& pred : q6Predicates()) {
+        CgExprPtr between = cgBetween(pred.col, pred.lo, pred.hi);
+        cond = cond == nullptr ? between : cgOp("&&", cond, between);
+    }
+
+    std::unique_ptr<CgOperator> plan(new CgScan({"shipdate", "discount", "quantity", "extprice"}));
+    plan.reset(new CgSelect(std::move(plan), cond));
+    plan.reset(new CgProject(std::move(plan), {{"disc_price", cgOp("*", cgCol("extprice"), cgCol("discount"))}}));
+    plan.reset(new CgAggregate(std::move(plan), {
+        {CG_SUM, cgCol("disc_price")},
+        {CG_COUNT, nullptr},
+        {CG_MIN, cgCol("extprice")},
+        {CG_MAX, cgCol("extprice")},
+    }));
+    return std::make_shared<const CompiledPipeline>(*plan, "q6_pipeline");
+}
+
+
+QueryPlan *compileQuery_Codegen(uint32_t vector_size, uint64_t num_of_rows, std::vector<int64_t> *results) {
+    auto scan_op = makeScan(lineitemSpecs(), num_of_rows, vector_size);
+    auto aggr_op = new PipelineJitOperator(scan_op, q6Pipeline(), results);
+    return new QueryPlan(aggr_op, false);
+}
+
+
+const std::vector<std::pair<std::string, QueryPlan *(*)(uint32_t, uint64_t, std::vector<int64_t>*)>> STRATEGIES{
+    {"baseline", compileQuery_Baseline},
+    {"vectorized", compileQuery_Vectorized},
+    {"bitmap", compileQuery_Bitmap},
+    {"jit", compileQuery_JIT},
+    {"codegen", compileQuery_Codegen},
+};
+
+
+int main(int argc, char **argv) {
+    const char *usage = "usage: q6 [vector_size|auto|column] [num_of_rows] [baseline|vectorized|bitmap|jit|codegen]";
+    //   column - column-at-a-time: the whole table is a single batch
+    //   prints the aggregates (none for baseline)
+    uint64_t num_of_rows = argc > 2 ? strtoull(argv[2], nullptr, 10) : NUM_OF_ROWS;
+    std::string strategy = argc > 3 ? argv[3] : "vectorized";
+
+    QueryPlan *(*compile)(uint32_t, uint64_t, std::vector<int64_t>*) = nullptr;
+    for (const auto& elem : STRATEGIES) {
+        if (strategy == elem.first)
+            compile = elem.second;
+    }
+    if (compile == nullptr) {
+        std::cout << "Unknown strategy " << strategy << "\n";
+        return 1;
+    }
+
+    std::vector<int64_t> results;
+    // 4 columns + selection vector
+    uint32_t vector_size = parseVectorSizeArg(argc, argv, num_of_rows, DEFAULT_VECTOR_SIZE, usage, 5,
+                                              [compile, &results](uint32_t n, uint32_t num_of_batches) {
+        QueryPlan *plan = compile(n, (uint64_t) num_of_batches * n, &results);
+        plan->open();
+        plan->printResultSet();
+        plan->close();
+        delete plan;
+    });
+    if (vector_size == 0)
+        return 1;
+
+    results.clear();
+    QueryPlan *query_plan = compile(vector_size, num_of_rows, &results);
+    query_plan->open();
+    query_plan->printResultSet();
+    query_plan->close();
+    delete query_plan;
+    for (size_t a = 0; a < results.size(); a++)
+        std::cout << RESULT_NAMES[a] << " " << results[a] << "\n";
+}
@@ -0,0 +1,697 @@
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include "common.h"
+#include "vector_size.h"
+#include "result_sink.h"
+
+/**
+ * This program evaluates sorting.
+ *
+ *   select k, v
+ *   from t
+ *   order by k
+ *   [limit N]
+ *
+ * k is uniform in [0, key_range) and v uniform in [0, 100).
+ *
+ * The sort never moves the columns while sorting: every row becomes an
+ * 8-byte entry of the key (sign bit flipped, so signed keys sort as
+ * unsigned) above its row number, the entries are sorted, and the row
+ * numbers left in the low halves are the permutation the output batches
+ * gather the columns through. Since the row numbers are unique and
+ * increasing in input order, sorting the entries is a stable sort of the
+ * rows.
+ *
+ *   std - std::sort of the entries
+ *   radix - LSD radix sort, one pass per byte of the key; a pass is skipped
+ *       when all keys share that byte
+ *   network - blocks of 128 entries are sorted by a sorting network of
+ *       branch-free compare-exchanges over 16 rows of 8 lanes (every
+ *       compare-exchange is a loop over the lanes, which the compiler turns
+ *       into SIMD min/max), then merged with branch-free merges
+ *   topn - for order by k limit N: a max-heap of the N smallest rows so far;
+ *       once it is full a batch is first filtered against the largest key
+ *       in the heap by a selection primitive, and only the survivors go to
+ *       the heap
+ */
+
+
+const uint32_t BATCHES = 100000;
+const uint64_t NUM_OF_ROWS = (uint64_t) BATCHES * DEFAULT_VECTOR_SIZE;
+
+// the sorting network sorts NETWORK_ROWS rows of NETWORK_LANES lanes
+#define NETWORK_ROWS    16
+#define NETWORK_LANES   8
+#define NETWORK_BLOCK   (NETWORK_ROWS * NETWORK_LANES)
+
+
+/************************************************************************
+ *
+ * Sort primitives
+ *
+ **************************************************************************/
+
+
+/**
+ * The sort entry of a row: its key with the sign bit flipped, then its row
+ * number.
+ */
+static inline uint64_t sortEntry(int32_t key, uint32_t row) {
+    return ((uint64_t) ((uint32_t) key ^ 0x80000000u) << 32) | row;
+}
+
+
+static inline int32_t sortEntryKey(uint64_t entry) {
+    return (int32_t) ((uint32_t) (entry >> 32) ^ 0x80000000u);
+}
+
+
+/**
+ * res[j] = entry of col[sel[j]] (col[j] without sel) as row first_row + j
+ */
+static uint32_t sort_entry_int32_col(uint32_t n, uint64_t *res, const int32_t *col, const uint32_t *sel, uint32_t first_row) {
+    if (sel != nullptr) {
+        for (uint32_t j = 0; j < n; j++)
+            res[j] = sortEntry(col[sel[j]], first_row + j);
+    }
+    else {
+        for (uint32_t j = 0; j < n; j++)
+            res[j] = sortEntry(col[j], first_row + j);
+    }
+    return n;
+}
+
+
+/**
+ * res[j] = the row number of entries[j]
+ */
+static uint32_t sort_entry_rows(uint32_t n, uint32_t *res, const uint64_t *entries) {
+    for (uint32_t j = 0; j < n; j++)
+        res[j] = (uint32_t) entries[j];
+    return n;
+}
+
+
+/**
+ * res_sel = the j < n with col[sel[j]] < val (col[j] without sel)
+ */
+static uint32_t sel_lt_int32_col_int32_val(uint32_t n, uint32_t *res_sel, const int32_t *col, int32_t val, const uint32_t *sel) {
+    uint32_t res = 0;
+    if (sel != nullptr) {
+        for (uint32_t j = 0; j < n; j++) {
+            res_sel[res] = j;
+            res += col[sel[j]] < val;
+        }
+    }
+    else {
+        for (uint32_t j = 0; j < n; j++) {
+            res_sel[res] = j;
+            res += col[j] < val;
+        }
+    }
+    return res;
+}
+
+
+/**
+ * Sorts the n entries of a, using tmp (n entries) as scratch.
+ */
+typedef void (*SortKernel)(uint64_t n, uint64_t *a, uint64_t *tmp);
+
+
+static void sort_std(uint64_t n, uint64_t *a, uint64_t * /*tmp*/) {
+    std::sort(a, a + n);
+}
+
+
+/**
+ * LSD radix sort on the key half. The row halves are increasing in input
+ * order and every pass is stable, so it sorts the whole entries.
+ */
+static void sort_radix(uint64_t n, uint64_t *a, uint64_t *tmp) {
+    if (n == 0)
+        return;
+
+    std::vector<uint64_t> counts(4 * 256, 0);
+    for (uint64_t i = 0; i < n; i++) {
+        auto key = (uint32_t) (a[i] >> 32);
+        counts[key & 255]++;
+        counts[256 + ((key >> 8) & 255)]++;
+        counts[512 + ((key >> 16) & 255)]++;
+        counts[768 + (key >> 24)]++;
+    }
+
+    uint64_t *src = a;
+    uint64_t *dst = tmp;
+    for (uint32_t pass = 0; pass < 4; pass++) {
+        uint64_t *count = &counts[pass * 256];
+        uint32_t shift = 32 + 8 * pass;
+        if (count[(src[0] >> shift) & 255] == n)
+            continue;
+
+        uint64_t offset = 0;
+        for (uint32_t d = 0; d < 256; d++) {
+            uint64_t c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t entry = src[i];
+            dst[count[(entry >> shift) & 255]++] = entry;
+        }
+        std::swap(src, dst);
+    }
+    if (src != a)
+        memcpy(a, src, sizeof(uint64_t) * n);
+}
+
+
+/**
+ * Merges the sorted a (na entries) and b (nb entries) into res; the next
+ * entry is picked by a compare whose result only moves indexes.
+ */
+static void merge_uint64(const uint64_t *a, uint64_t na, const uint64_t *b, uint64_t nb, uint64_t *res) {
+    uint64_t i = 0;
+    uint64_t j = 0;
+    uint64_t k = 0;
+    while (i < na && j < nb) {
+        uint64_t x = a[i];
+        uint64_t y = b[j];
+        bool take_b = y < x;
+        res[k++] = take_b ? y : x;
+        j += take_b;
+        i += !take_b;
+    }
+    memcpy(res + k, a + i, sizeof(uint64_t) * (na - i));
+    k += na - i;
+    memcpy(res + k, b + j, sizeof(uint64_t) * (nb - j));
+}
+
+
+/**
+ * Merges the sorted runs of width entries in src into runs of 2 * width in
+ * dst.
+ */
+static void merge_runs_uint64(uint64_t n, const uint64_t *src, uint64_t *dst, uint64_t width) {
+    for (uint64_t i = 0; i < n; i += 2 * width) {
+        uint64_t mid = std::min(i + width, n);
+        uint64_t end = std::min(i + 2 * width, n);
+        merge_uint64(src + i, mid - i, src + mid, end - mid, dst + i);
+    }
+}
+
+
+static inline void compare_exchange_rows(uint64_t *block, uint32_t a, uint32_t b) {
+    uint64_t *row_a = block + a * NETWORK_LANES;
+    uint64_t *row_b = block + b * NETWORK_LANES;
+    for (uint32_t l = 0; l < NETWORK_LANES; l++) {
+        uint64_t x = row_a[l];
+        uint64_t y = row_b[l];
+        row_a[l] = std::min(x, y);
+        row_b[l] = std::max(x, y);
+    }
+}
+
+
+/**
+ * Sorts the NETWORK_BLOCK entries of block. Batcher's odd-even merge sort
+ * over the rows sorts every lane, the lanes are transposed into runs, and
+ * the runs are merged.
+ */
+static void sort_network_block(uint64_t *block) {
+    for (uint32_t p = 1; p < NETWORK_ROWS; p *= 2) {
+        for (uint32_t k = p; k > 0; k /= 2) {
+            for (uint32_t j = k % p; j + k < NETWORK_ROWS; j += 2 * k) {
+                for (uint32_t i = 0; i < k && i + j + k < NETWORK_ROWS; i++) {
+                    if ((i + j) / (2 * p) == (i + j + k) / (2 * p))
+                        compare_exchange_rows(block, i + j, i + j + k);
+                }
+            }
+        }
+    }
+
+    uint64_t runs[NETWORK_BLOCK];
+    for (uint32_t r = 0; r < NETWORK_ROWS; r++) {
+        for (uint32_t l = 0; l < NETWORK_LANES; l++)
+            runs[l * NETWORK_ROWS + r] = block[r * NETWORK_LANES + l];
+    }
+
+    uint64_t *src = runs;
+    uint64_t *dst = block;
+    for (uint64_t width = NETWORK_ROWS; width < NETWORK_BLOCK; width *= 2) {
+        merge_runs_uint64(NETWORK_BLOCK, src, dst, width);
+        std::swap(src, dst);
+    }
+    if (src != block)
+        memcpy(block, src, sizeof(runs));
+}
+
+
+static void sort_network(uint64_t n, uint64_t *a, uint64_t *tmp) {
+    uint64_t i = 0;
+    for (; i + NETWORK_BLOCK <= n; i += NETWORK_BLOCK)
+        sort_network_block(a + i);
+    if (i < n) {
+        // the entries of the last block are followed by ones larger than any
+        uint64_t block[NETWORK_BLOCK];
+        std::fill(block, block + NETWORK_BLOCK, UINT64_MAX);
+        memcpy(block, a + i, sizeof(uint64_t) * (n - i));
+        sort_network_block(block);
+        memcpy(a + i, block, sizeof(uint64_t) * (n - i));
+    }
+
+    uint64_t *src = a;
+    uint64_t *dst = tmp;
+    for (uint64_t width = NETWORK_BLOCK; width < n; width *= 2) {
+        merge_runs_uint64(n, src, dst, width);
+        std::swap(src, dst);
+    }
+    if (src != a)
+        memcpy(a, src, sizeof(uint64_t) * n);
+}
+
+
+
+/************************************************************************
+ *
+ * Operators
+ *
+ **************************************************************************/
+
+
+/**
+ * order by key_col [limit]: drains the child on the first next(), sorts,
+ * then yields the rows in order in batches of vector_size. A limit of 0
+ * means no limit.
+ */
+class SortOperator : public BaseOperator {
+private:
+    BaseOperator *child_;
+    std::string key_col_;
+    uint64_t limit_;
+    uint32_t vector_size_;
+    SortKernel kernel_;
+
+    std::vector<std::string> names_;
+    std::vector<std::vector<int32_t>> columns_;
+    std::vector<uint64_t> entries_;
+    std::vector<uint32_t> perm_;
+    uint64_t num_of_rows_;
+    uint64_t pos_;
+    bool sorted_;
+
+public:
+    SortOperator(BaseOperator *child, std::string key_col, uint64_t limit, uint32_t vector_size, SortKernel kernel) :
+        child_(child),
+        key_col_(std::move(key_col)),
+        limit_(limit),
+        vector_size_(vector_size),
+        kernel_(kernel),
+        num_of_rows_(0),
+        pos_(0),
+        sorted_(false) {
+    }
+
+    ~SortOperator() override {
+        delete child_;
+    }
+
+    void open() final {
+        child_->open();
+        names_.clear();
+        columns_.clear();
+        entries_.clear();
+        perm_.clear();
+        num_of_rows_ = 0;
+        pos_ = 0;
+        sorted_ = false;
+    }
+
+    void close() final {
+        child_->close();
+    }
+
+    BatchResult* next() final {
+        if (!sorted_) {
+            sort_();
+            sorted_ = true;
+        }
+        if (pos_ == num_of_rows_)
+            return nullptr;
+
+        auto n = (uint32_t) std::min<uint64_t>(vector_size_, num_of_rows_ - pos_);
+        BatchResult *br = new BatchResult(names_, n);
+        for (size_t c = 0; c < names_.size(); c++)
+            gather_int32_col(n, br->getCol(names_[c])->col, columns_[c].data(), perm_.data() + pos_);
+        pos_ += n;
+        return br;
+    }
+
+private:
+    void sort_() {
+        while (true) {
+            std::unique_ptr<BatchResult> br(child_->next());
+            if (br == nullptr)
+                break;
+
+            if (names_.empty()) {
+                for (const auto& elem : br->data)
+                    names_.push_back(elem.first);
+                columns_.resize(names_.size());
+            }
+            const DbVector<uint32_t> *sel = br->res_sel;
+            uint32_t n = sel == nullptr ? br->getn() : sel->n;
+            auto first_row = (uint32_t) entries_.size();
+            if (entries_.size() + n >= UINT32_MAX)
+                throw std::overflow_error("sort input exceeds 2^32 - 1 rows");
+
+            for (size_t c = 0; c < names_.size(); c++) {
+                const DbVector<int32_t> *vec = br->getCol(names_[c]);
+                if (vec->validity != nullptr)
+                    throw std::invalid_argument("sort of nullable column " + names_[c]);
+                std::vector<int32_t>& column = columns_[c];
+                if (sel == nullptr) {
+                    column.insert(column.end(), vec->col, vec->col + n);
+                }
+                else {
+                    for (uint32_t j = 0; j < n; j++)
+                        column.push_back(vec->col[sel->col[j]]);
+                }
+            }
+
+            entries_.resize(first_row + n);
+            sort_entry_int32_col(n, entries_.data() + first_row, br->getCol(key_col_)->col,
+                                 sel == nullptr ? nullptr : sel->col, first_row);
+        }
+
+        std::vector<uint64_t> tmp(entries_.size());
+        kernel_(entries_.size(), entries_.data(), tmp.data());
+
+        num_of_rows_ = limit_ != 0 ? std::min<uint64_t>(limit_, entries_.size()) : entries_.size();
+        perm_.resize(num_of_rows_);
+        sort_entry_rows((uint32_t) num_of_rows_, perm_.data(), entries_.data());
+        std::vector<uint64_t>().swap(entries_);
+    }
+};
+
+
+/**
+ * order by key_col limit: keeps the limit smallest rows in a max-heap of
+ * their sort entries (the row half numbering the rows in input order, so
+ * ties keep the earlier row as the stable sort does) and the slots their
+ * columns are stored in.
+ */
+class TopNOperator : public BaseOperator {
+private:
+    BaseOperator *child_;
+    std::string key_col_;
+    uint32_t limit_;
+    uint32_t vector_size_;
+
+    std::vector<std::string> names_;
+    // the stored rows, column by column, indexed by slot
+    std::vector<std::vector<int32_t>> columns_;
+    // sort entry, slot
+    std::vector<std::pair<uint64_t, uint32_t>> heap_;
+    std::vector<uint32_t> cand_;
+    std::vector<uint32_t> perm_;
+    uint64_t num_of_rows_;
+    uint32_t pos_;
+    bool done_;
+
+public:
+    TopNOperator(BaseOperator *child, std::string key_col, uint32_t limit, uint32_t vector_size) :
+        child_(child),
+        key_col_(std::move(key_col)),
+        limit_(limit),
+        vector_size_(vector_size),
+        num_of_rows_(0),
+        pos_(0),
+        done_(false) {
+        if (limit == 0)
+            throw std::invalid_argument("top-n needs a limit");
+    }
+
+    ~TopNOperator() override {
+        delete child_;
+    }
+
+    void open() final {
+        child_->open();
+        names_.clear();
+        columns_.clear();
+        heap_.clear();
+        perm_.clear();
+        num_of_rows_ = 0;
+        pos_ = 0;
+        done_ = false;
+    }
+
+    void close() final {
+        child_->close();
+    }
+
+    BatchResult* next() final {
+        if (!done_) {
+            consumeAll_();
+            done_ = true;
+        }
+        if (pos_ == perm_.size())
+            return nullptr;
+
+        uint32_t n = std::min<uint32_t>(vector_size_, (uint32_t) perm_.size() - pos_);
+        BatchResult *br = new BatchResult(names_, n);
+        for (size_t c = 0; c < names_.size(); c++)
+            gather_int32_col(n, br->getCol(names_[c])->col, columns_[c].data(), perm_.data() + pos_);
+        pos_ += n;
+        return br;
+    }
+
+private:
+    void consumeAll_() {
+        std::vector<const int32_t*> cols;
+        while (true) {
+            std::unique_ptr<BatchResult> br(child_->next());
+            if (br == nullptr)
+                break;
+
+            if (names_.empty()) {
+                for (const auto& elem : br->data)
+                    names_.push_back(elem.first);
+                columns_.assign(names_.size(), std::vector<int32_t>(limit_));
+            }
+            cols.clear();
+            for (const auto& name : names_) {
+                const DbVector<int32_t> *vec = br->getCol(name);
+                if (vec->validity != nullptr)
+                    throw std::invalid_argument("top-n of nullable column " + name);
+                cols.push_back(vec->col);
+            }
+            const DbVector<uint32_t> *sel_vec = br->res_sel;
+            const uint32_t *sel = sel_vec == nullptr ? nullptr : sel_vec->col;
+            uint32_t n = sel_vec == nullptr ? br->getn() : sel_vec->n;
+            const int32_t *keys = br->getCol(key_col_)->col;
+            uint64_t first_row = num_of_rows_;
+            num_of_rows_ += n;
+            if (num_of_rows_ >= UINT32_MAX)
+                throw std::overflow_error("top-n input exceeds 2^32 - 1 rows");
+
+            // fill the heap
+            uint32_t j = 0;
+            for (; j < n && heap_.size() < limit_; j++) {
+                uint32_t i = sel != nullptr ? sel[j] : j;
+                auto slot = (uint32_t) heap_.size();
+                store_(slot, cols, i);
+                heap_.emplace_back(sortEntry(keys[i], (uint32_t) (first_row + j)), slot);
+                std::push_heap(heap_.begin(), heap_.end());
+            }
+            if (j == n)
+                continue;
+
+            // only rows below the largest key in the heap can get in
+            if (cand_.size() < n - j)
+                cand_.resize(n - j);
+            uint32_t m = sel_lt_int32_col_int32_val(n - j, cand_.data(), sel != nullptr ? keys : keys + j,
+                                                    sortEntryKey(heap_[0].first), sel != nullptr ? sel + j : nullptr);
+            for (uint32_t t = 0; t < m; t++) {
+                uint32_t row = j + cand_[t];
+                uint32_t i = sel != nullptr ? sel[row] : row;
+                if (keys[i] >= sortEntryKey(heap_[0].first))
+                    continue;
+                uint32_t slot = heap_[0].second;
+                store_(slot, cols, i);
+                replaceTop_(sortEntry(keys[i], (uint32_t) (first_row + row)), slot);
+            }
+        }
+
+        std::sort(heap_.begin(), heap_.end());
+        perm_.resize(heap_.size());
+        for (size_t t = 0; t < heap_.size(); t++)
+            perm_[t] = heap_[t].second;
+    }
+
+    void store_(uint32_t slot, const std::vector<const int32_t*>& cols, uint32_t i) {
+        for (size_t c = 0; c < cols.size(); c++)
+            columns_[c][slot] = cols[c][i];
+    }
+
+    /**
+     * Replaces the largest entry and sifts the new one down.
+     */
+    void replaceTop_(uint64_t entry, uint32_t slot) {
+        auto size = (uint32_t) heap_.size();
+        uint32_t k = 0;
+        while (true) {
+            uint32_t child = 2 * k + 1;
+            if (child >= size)
+                break;
+            if (child + 1 < size && heap_[child + 1].first > heap_[child].first)
+                child++;
+            if (heap_[child].first <= entry)
+                break;
+            heap_[k] = heap_[child];
+            k = child;
+        }
+        heap_[k] = std::make_pair(entry, slot);
+    }
+};
+
+
+
+/************************************************************************
+ *
+ * Query compiler
+ *
+ **************************************************************************/
+
+
+static std::vector<ColumnSpec> tableSpecs(int32_t key_range) {
+    std::vector<ColumnSpec> specs{};
+    specs.emplace_back("k", DIST_UNIFORM, key_range);
+    specs.emplace_back("v", DIST_UNIFORM, 100);
+    return specs;
+}
+
+
+QueryPlan *compileQuery_Baseline(uint32_t vector_size, uint64_t num_of_rows, uint32_t /*limit*/, int32_t key_range) {
+    return new QueryPlan(makeScan(tableSpecs(key_range), num_of_rows, vector_size), false);
+}
+
+
+template<SortKernel kernel>
+QueryPlan *compileQuery_Sort(uint32_t vector_size, uint64_t num_of_rows, uint32_t limit, int32_t key_range) {
+    auto scan_op = makeScan(tableSpecs(key_range), num_of_rows, vector_size);
+    auto sort_op = new SortOperator(scan_op, "k", limit, vector_size, kernel);
+    return new QueryPlan(sort_op, false);
+}
+
+
+QueryPlan *compileQuery_TopN(uint32_t vector_size, uint64_t num_of_rows, uint32_t limit, int32_t key_range) {
+    auto scan_op = makeScan(tableSpecs(key_range), num_of_rows, vector_size);
+    auto topn_op = new TopNOperator(scan_op, "k", limit, vector_size);
+    return new QueryPlan(topn_op, false);
+}
+
+
+const std::vector<std::pair<std::string, QueryPlan *(*)(uint32_t, uint64_t, uint32_t, int32_t)>> STRATEGIES{
+    {"baseline", compileQuery_Baseline},
+    {"std", compileQuery_Sort<sort_std>},
+    {"radix", compileQuery_Sort<sort_radix>},
+    {"network", compileQuery_Sort<sort_network>},
+    {"topn", compileQuery_TopN},
+};
+
+
+/**
+ * Checks that the rows arrive ordered by the key column and passes them on
+ * to a ChecksumSink.
+ */
+class OrderCheckSink : public ResultSink {
+private:
+    std::string key_col_;
+    ChecksumSink checksum_;
+    bool first_;
+    int32_t last_;
+    bool ordered_;
+
+public:
+    explicit OrderCheckSink(std::string key_col) :
+        key_col_(std::move(key_col)), first_(true), last_(0), ordered_(true) {
+    }
+
+    const ChecksumSink& getChecksumSink() const {
+        return checksum_;
+    }
+
+    bool isOrdered() const {
+        return ordered_;
+    }
+
+    void consume(BatchResult *br) final {
+        const DbVector<uint32_t> *sel = br->res_sel;
+        uint32_t n = sel == nullptr ? br->getn() : sel->n;
+        const int32_t *keys = br->getCol(key_col_)->col;
+        for (uint32_t j = 0; j < n; j++) {
+            int32_t key = keys[sel == nullptr ? j : sel->col[j]];
+            ordered_ &= first_ || last_ <= key;
+            first_ = false;
+            last_ = key;
+        }
+        checksum_.consume(br);
+    }
+
+    void finish() final {
+        checksum_.finish();
+    }
+};
+
+
+int main(int argc, char **argv) {
+    const char *usage = "usage: sort [vector_size|auto|column] [num_of_rows] [baseline|std|radix|network|topn] [limit] [key_range]";
+    //   limit - 0 for none, topn needs one
+    //   prints the number of result rows and a checksum of them
+    uint64_t num_of_rows = argc > 2 ? strtoull(argv[2], nullptr, 10) : NUM_OF_ROWS;
+    std::string strategy = argc > 3 ? argv[3] : "radix";
+    uint32_t limit = argc > 4 ? (uint32_t) atoi(argv[4]) : 0;
+    int32_t key_range = argc > 5 ? (int32_t) parseCount(argv[5], INT32_MAX) : 1 << 30;
+    if (key_range == 0) {
+        std::cout << "key_range must be 1 to " << INT32_MAX << "\n" << usage << "\n";
+        return 1;
+    }
+
+    QueryPlan *(*compile)(uint32_t, uint64_t, uint32_t, int32_t) = nullptr;
+    for (const auto& elem : STRATEGIES) {
+        if (strategy == elem.first)
+            compile = elem.second;
+    }
+    if (compile == nullptr) {
+        std::cout << "Unknown strategy " << strategy << "\n";
+        return 1;
+    }
+
+    // 2 columns, the sort entries and the permutation
+    uint32_t vector_size = parseVectorSizeArg(argc, argv, num_of_rows, DEFAULT_VECTOR_SIZE, usage, 4,
+                                              [compile, limit, key_range](uint32_t n, uint32_t num_of_batches) {
+        QueryPlan *plan = compile(n, (uint64_t) num_of_batches * n, limit, key_range);
+        plan->open();
+        plan->printResultSet();
+        plan->close();
+        delete plan;
+    });
+    if (vector_size == 0)
+        return 1;
+
+    QueryPlan *query_plan = compile(vector_size, num_of_rows, limit, key_range);
+    query_plan->open();
+    OrderCheckSink sink(strategy == "baseline" ? "v" : "k");
+    query_plan->execute(&sink);
+    query_plan->close();
+    delete query_plan;
+    std::cout << sink.getChecksumSink().getCount() << " rows, checksum " << std::hex
+              << sink.getChecksumSink().getChecksum() << std::dec << "\n";
+    if (strategy != "baseline" && !sink.isOrdered()) {
+        std::cout << "rows are not ordered by k\n";
+        return 1;
+    }
+}
@@ -0,0 +1,443 @@
+#include <iostream>
+#include "common.h"
+
+/**
+ * This program evaluates selections on string columns.
+ *
+ *   create table lineitem (
+ *       shipmode varchar,      -- 'AIR', 'MAIL', 'REG AIR', ...; always inlined
+ *       comment varchar        -- a few words, mostly longer than 12 bytes
+ *   )
+ *
+ *   select * from lineitem where shipmode = 'MAIL'
+ *   select * from lineitem where comment like 'furiously%'
+ *   select * from lineitem where comment like 'quickly%deposits%'
+ *
+ * the program evaluates the following strategies:
+ *   prefix - the primitives compare the first 8 bytes of the header (length
+ *            and 4-byte prefix) as one word for all rows, without branches,
+ *            and only follow the pointer of the few rows that survive.
+ *   pointer - every row is compared through its data pointer, as a system
+ *             storing plain (pointer, length) strings has to.
+ */
+
+
+const uint32_t BATCHES = 10000;
+
+const char *SHIPMODES[] = {"AIR", "FOB", "MAIL", "RAIL", "REG AIR", "SHIP", "TRUCK"};
+
+const char *WORDS[] = {"furiously", "quickly", "carefully", "slyly", "blithely", "regular",
+                       "final", "special", "pending", "express", "ironic", "bold",
+                       "deposits", "requests", "accounts", "packages", "theodolites", "pinto beans"};
+
+
+const uint32_t NUM_OF_SHIPMODES = sizeof(SHIPMODES) / sizeof(SHIPMODES[0]);
+const uint32_t NUM_OF_WORDS = sizeof(WORDS) / sizeof(WORDS[0]);
+// a comment has 2 to COMMENT_MAX_WORDS words
+#define COMMENT_MAX_WORDS   5
+
+
+/**
+ * Generates the shipmode and comment columns. The random choices of a row
+ * (its shipmode, number of words and words) come from a DataGenerator, so
+ * every run scans the same rows.
+ */
+class StringScanOperator : public BaseOperator {
+private:
+    uint32_t num_of_batches_;
+    uint32_t vector_size_;
+    DataGenerator generator_;
+    uint32_t batch_idx_;
+    // per batch: the shipmode, the number of words - 2, then the words
+    std::vector<std::vector<int32_t>> draws_;
+
+    static std::vector<ColumnSpec> drawSpecs_() {
+        std::vector<ColumnSpec> specs{};
+        specs.emplace_back("shipmode", DIST_UNIFORM, (int32_t) NUM_OF_SHIPMODES);
+        specs.emplace_back("num_of_words", DIST_UNIFORM, COMMENT_MAX_WORDS - 1);
+        for (uint32_t w = 0; w < COMMENT_MAX_WORDS; w++)
+            specs.emplace_back("word" + std::to_string(w), DIST_UNIFORM, (int32_t) NUM_OF_WORDS);
+        return specs;
+    }
+
+public:
+    StringScanOperator(uint32_t num_of_batches, uint32_t vector_size = DEFAULT_VECTOR_SIZE) :
+        num_of_batches_(num_of_batches),
+        vector_size_(vector_size),
+        generator_(drawSpecs_(), ScanOperator::DEFAULT_SEED, (uint64_t) num_of_batches * vector_size),
+        batch_idx_(0),
+        draws_(2 + COMMENT_MAX_WORDS, std::vector<int32_t>(vector_size)) {
+    }
+
+    ~StringScanOperator() final = default;
+
+    void open() final {
+        // do nothing
+    }
+
+    void close() final {
+        // do nothing
+    }
+
+    BatchResult* next() final {
+        if (batch_idx_ == num_of_batches_)
+            return nullptr;
+
+        uint32_t n = vector_size_;
+        BatchResult *br = new BatchResult();
+        auto shipmode = new DbVector<DbString>(n);
+        auto comment = new DbVector<DbString>(n);
+        br->addStr("shipmode", shipmode);
+        br->addStr("comment", comment);
+
+        std::vector<int32_t*> draws{};
+        for (auto& draw : draws_)
+            draws.push_back(draw.data());
+        generator_.fillRows((uint64_t) batch_idx_ * vector_size_, n, draws.data());
+
+        char buf[128];
+        for (uint32_t i = 0; i < n; i++) {
+            const char *mode = SHIPMODES[draws[0][i]];
+            shipmode->col[i] = makeDbString(mode, (uint32_t) strlen(mode), br->heap);
+
+            uint32_t len = 0;
+            uint32_t num_of_comment_words = 2 + draws[1][i];
+            for (uint32_t w = 0; w < num_of_comment_words; w++) {
+                const char *word = WORDS[draws[2 + w][i]];
+                auto word_len = (uint32_t) strlen(word);
+                if (w > 0)
+                    buf[len++] = ' ';
+                memcpy(buf + len, word, word_len);
+                len += word_len;
+            }
+            comment->col[i] = makeDbString(buf, len, br->heap);
+        }
+
+        batch_idx_++;
+        return br;
+    }
+};
+
+
+/************************************************************************
+ *
+ * PRIMITIVES
+ *
+ **************************************************************************/
+
+
+/**
+ * Candidates whose len + prefix word equals head, without branches.
+ */
+static uint32_t sel_eq_str_head(uint32_t n, uint32_t *res_sel, DbString *col, uint64_t head, uint32_t *sel) {
+    uint32_t res = 0;
+
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = sel[i];
+            res += (col[sel[i]].head() == head);
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++) {
+            res_sel[res] = i;
+            res += (col[i].head() == head);
+        }
+    }
+
+    return res;
+}
+
+
+static uint32_t sel_eq_str_col_str_val(uint32_t n, uint32_t *res_sel, DbString *col, const DbString *val, uint32_t *sel) {
+    uint64_t head = val->head();
+    uint32_t res = 0;
+
+    if (val->len <= DbString::INLINE_LEN) {
+        // the 16 bytes of the header are the whole string
+        uint64_t tail = val->tail();
+        if (sel != nullptr) {
+            for (uint32_t i = 0; i < n; i++) {
+                res_sel[res] = sel[i];
+                res += (col[sel[i]].head() == head) & (col[sel[i]].tail() == tail);
+            }
+        }
+        else {
+            for (uint32_t i = 0; i < n; i++) {
+                res_sel[res] = i;
+                res += (col[i].head() == head) & (col[i].tail() == tail);
+            }
+        }
+        return res;
+    }
+
+    // length and prefix reject most rows, then verify the rest of the survivors
+    uint32_t m = sel_eq_str_head(n, res_sel, col, head, sel);
+    for (uint32_t i = 0; i < m; i++) {
+        res_sel[res] = res_sel[i];
+        res += memcmp(col[res_sel[i]].ptr + 4, val->ptr + 4, val->len - 4) == 0;
+    }
+    return res;
+}
+
+
+/**
+ * s like 'pattern%'.
+ */
+static uint32_t sel_prefix_str_col_str_val(uint32_t n,
+                                           uint32_t *res_sel,
+                                           DbString *col,
+                                           const char *pattern,
+                                           uint32_t pattern_len,
+                                           uint32_t *sel) {
+    uint32_t head_len = pattern_len < 4 ? pattern_len : 4;
+    uint32_t mask = head_len == 4 ? 0xffffffffu : (1u << (8 * head_len)) - 1;
+    uint32_t head = 0;
+    memcpy(&head, pattern, head_len);
+
+    uint32_t res = 0;
+    if (sel != nullptr) {
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t prefix;
+            memcpy(&prefix, col[sel[i]].prefix, sizeof(prefix));
+            res_sel[res] = sel[i];
+            res += (col[sel[i]].len >= pattern_len) & ((prefix & mask) == head);
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t prefix;
+            memcpy(&prefix, col[i].prefix, sizeof(prefix));
+            res_sel[res] = i;
+            res += (col[i].len >= pattern_len) & ((prefix & mask) == head);
+        }
+    }
+
+    if (pattern_len <= 4)
+        return res;
+
+    uint32_t m = res;
+    res = 0;
+    for (uint32_t i = 0; i < m; i++) {
+        res_sel[res] = res_sel[i];
+        res += memcmp(col[res_sel[i]].data() + 4, pattern + 4, pattern_len - 4) == 0;
+    }
+    return res;
+}
+
+
+/**
+ * SQL LIKE with '%' and '_'.
+ */
+static bool likeMatch(const char *s, uint32_t len, const char *p, uint32_t plen) {
+    uint32_t si = 0, pi = 0;
+    uint32_t star_pi = UINT32_MAX, star_si = 0;
+
+    while (si < len) {
+        if (pi < plen && (p[pi] == '_' || p[pi] == s[si])) {
+            si++;
+            pi++;
+        }
+        else if (pi < plen && p[pi] == '%') {
+            star_pi = pi++;
+            star_si = si;
+        }
+        else if (star_pi != UINT32_MAX) {
+            pi = star_pi + 1;
+            si = ++star_si;
+        }
+        else {
+            return false;
+        }
+    }
+
+    while (pi < plen && p[pi] == '%')
+        pi++;
+    return pi == plen;
+}
+
+
+/**
+ * s like pattern. The literal part in front of the first wildcard is checked
+ * on the prefix first; only its survivors run the full matcher.
+ */
+static uint32_t sel_like_str_col_str_val(uint32_t n,
+                                         uint32_t *res_sel,
+                                         DbString *col,
+                                         const std::string& pattern,
+                                         uint32_t *sel) {
+    auto literal_len = (uint32_t) pattern.find_first_of("%_");
+    if (literal_len == (uint32_t) std::string::npos)
+        literal_len = (uint32_t) pattern.size();
+
+    uint32_t m = n;
+    uint32_t *src = sel;
+    if (literal_len > 0) {
+        m = sel_prefix_str_col_str_val(n, res_sel, col, pattern.data(), literal_len, sel);
+        src = res_sel;
+    }
+
+    uint32_t res = 0;
+    for (uint32_t i = 0; i < m; i++) {
+        uint32_t idx = src != nullptr ? src[i] : i;
+        res_sel[res] = idx;
+        res += likeMatch(col[idx].data(), col[idx].len, pattern.data(), (uint32_t) pattern.size());
+    }
+    return res;
+}
+
+
+static uint32_t sel_eq_str_col_str_val_pointer(uint32_t n, uint32_t *res_sel, DbString *col, const DbString *val, uint32_t *sel) {
+    uint32_t res = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t idx = sel != nullptr ? sel[i] : i;
+        if (col[idx].len == val->len && memcmp(col[idx].data(), val->data(), val->len) == 0)
+            res_sel[res++] = idx;
+    }
+    return res;
+}
+
+
+static uint32_t sel_like_str_col_str_val_pointer(uint32_t n,
+                                                 uint32_t *res_sel,
+                                                 DbString *col,
+                                                 const std::string& pattern,
+                                                 uint32_t *sel) {
+    uint32_t res = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t idx = sel != nullptr ? sel[i] : i;
+        if (likeMatch(col[idx].data(), col[idx].len, pattern.data(), (uint32_t) pattern.size()))
+            res_sel[res++] = idx;
+    }
+    return res;
+}
+
+
+/************************************************************************
+ *
+ * OPERATORS
+ *
+ **************************************************************************/
+
+
+#define STR_COND_EQ     1
+#define STR_COND_LIKE   2
+
+
+class SelectStringOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    int cond_;
+    std::string col_name_;
+    std::string literal_;
+    bool use_prefix_;
+
+    StringHeap heap_;
+    DbString val_;
+
+public:
+    SelectStringOperator(BaseOperator *next, int cond, std::string col_name, std::string literal, bool use_prefix) :
+        next_(next),
+        cond_(cond),
+        col_name_(std::move(col_name)),
+        literal_(std::move(literal)),
+        use_prefix_(use_prefix) {
+        val_ = makeDbString(literal_.data(), (uint32_t) literal_.size(), &heap_);
+    }
+
+    ~SelectStringOperator() final {
+        delete next_;
+    }
+
+    void open() {
+        next_->open();
+    }
+
+    void close() {
+        next_->close();
+    }
+
+    BatchResult* next() {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        DbVector<DbString> *vec = br->getStrCol(col_name_);
+        uint32_t *sel = br->res_sel != nullptr ? br->res_sel->col : nullptr;
+        uint32_t n = br->res_sel != nullptr ? br->res_sel->n : vec->n;
+        DbVector<uint32_t> *res_sel = new DbVector<uint32_t>(vec->n);
+
+        if (cond_ == STR_COND_EQ) {
+            if (use_prefix_)
+                res_sel->n = sel_eq_str_col_str_val(n, res_sel->col, vec->col, &val_, sel);
+            else
+                res_sel->n = sel_eq_str_col_str_val_pointer(n, res_sel->col, vec->col, &val_, sel);
+        }
+        else {
+            if (use_prefix_)
+                res_sel->n = sel_like_str_col_str_val(n, res_sel->col, vec->col, literal_, sel);
+            else
+                res_sel->n = sel_like_str_col_str_val_pointer(n, res_sel->col, vec->col, literal_, sel);
+        }
+
+        delete br->res_sel;
+        br->res_sel = res_sel;
+        return br;
+    }
+};
+
+
+/************************************************************************
+ *
+ * Query compiler
+ *
+ **************************************************************************/
+
+
+QueryPlan *compileQuery_Baseline() {
+    auto scan_op = new StringScanOperator(BATCHES);
+    return new QueryPlan(scan_op, false);
+}
+
+
+QueryPlan *compileQuery_Equal(bool use_prefix) {
+    auto scan_op = new StringScanOperator(BATCHES);
+    auto sel_op = new SelectStringOperator(scan_op, STR_COND_EQ, "shipmode", "MAIL", use_prefix);
+    return new QueryPlan(sel_op, false);
+}
+
+
+QueryPlan *compileQuery_Prefix(bool use_prefix) {
+    auto scan_op = new StringScanOperator(BATCHES);
+    auto sel_op = new SelectStringOperator(scan_op, STR_COND_LIKE, "comment", "furiously%", use_prefix);
+    return new QueryPlan(sel_op, false);
+}
+
+
+QueryPlan *compileQuery_Like(bool use_prefix) {
+    auto scan_op = new StringScanOperator(BATCHES);
+    auto sel_op = new SelectStringOperator(scan_op, STR_COND_LIKE, "comment", "quickly%deposits%", use_prefix);
+    return new QueryPlan(sel_op, false);
+}
+
+
+int main(int argc, char **argv) {
+    // usage: string [baseline|eq|prefix|like] [prefix|pointer]
+    std::string query = argc > 1 ? argv[1] : "like";
+    bool use_prefix = argc > 2 ? strcmp(argv[2], "pointer") != 0 : true;
+
+    QueryPlan *query_plan = nullptr;
+    if (query == "baseline")
+        query_plan = compileQuery_Baseline();
+    else if (query == "eq")
+        query_plan = compileQuery_Equal(use_prefix);
+    else if (query == "prefix")
+        query_plan = compileQuery_Prefix(use_prefix);
+    else
+        query_plan = compileQuery_Like(use_prefix);
+
+    query_plan->open();
+    query_plan->printResultSet();
+    query_plan->close();
+    delete query_plan;
+}
@@ -1,5 +1,7 @@
 #include <iostream>
 #include "common.h"
+#include "vector_size.h"
+#include "codegen.h"
 
 
 /**
@@ -12,9 +14,18 @@
  *   2. non-compute-all + jie projection + non-branching, vec-only selection
  *
  * So, the key is compute-all vs. non-compute-all. The latter will prohibit SIMDization.
+ *
+ * codegen generates one loop for the whole pipeline scan -> select -> project
+ * (codegen.h): the selection is an if around the projection, so neither a
+ * selection vector nor the unselected prices are materialized.
+ *
+ * adaptive runs the projection of non_compute_all while a projection-only
+ * pipeline compiles in the background and switches to it once it is
+ * loaded, so the first batches do not wait for the compiler.
  */
 
 const uint32_t BATCHES = 100000;
+const uint64_t NUM_OF_ROWS = (uint64_t) BATCHES * DEFAULT_VECTOR_SIZE;
 
 
 /**
@@ -25,9 +36,20 @@ static uint32_t sel_lt_int32_col_int32_val_nonbranching(uint32_t n,
                                                         uint32_t *res_sel,
                                                         int32_t *col,
                                                         int32_t val,
+                                                        const uint64_t *validity,
                                                         uint32_t *sel) {
     uint32_t res = 0;
 
+    if (validity != nullptr) {
+        // a NULL makes the condition unknown: its bit clears the mask
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t idx = sel == nullptr ? i : sel[i];
+            res_sel[res] = idx;
+            res += (col[idx] < val) & validBit(validity, idx);
+        }
+        return res;
+    }
+
     if (sel != nullptr) {
         for (uint32_t i = 0; i < n; i++) {
             res_sel[res] = sel[i];
@@ -48,6 +70,10 @@ static uint32_t sel_lt_int32_col_int32_val_nonbranching(uint32_t n,
 #define COND_LT     1
 
 
+/**
+ * A predicate of the plan. Nodes are immutable: the vector a node reads is
+ * bound per call, so plans can share them.
+ */
 class CondDAGNode {
 private:
     int cond_;
@@ -56,28 +82,26 @@ public:
     CondDAGNode(int cond) : cond_(cond) {}
     virtual ~CondDAGNode() = default;
 
-    virtual uint32_t compute(DbVector<uint32_t>* res_sel) = 0;
-    virtual uint32_t compute(DbVector<uint32_t>* res_sel, DbVector<uint32_t>* src_sel) = 0;
+    virtual uint32_t compute(const DbVector<int32_t> *left_vec, DbVector<uint32_t>* res_sel) const = 0;
+    virtual uint32_t compute(const DbVector<int32_t> *left_vec, DbVector<uint32_t>* res_sel,
+                             const DbVector<uint32_t>* src_sel) const = 0;
 
-    virtual void setLeftVector(DbVector<int32_t> *vec) = 0;
-    virtual std::string getLeftColName() = 0;
+    virtual const std::string& getLeftColName() const = 0;
 };
 
 
 class ColValCondDAGNode : public CondDAGNode {
 private:
     bool branching_;
-    uint32_t (*primitive_)(uint32_t, uint32_t*, int32_t*, int32_t, uint32_t*);
+    uint32_t (*primitive_)(uint32_t, uint32_t*, int32_t*, int32_t, const uint64_t*, uint32_t*);
     int32_t right_val_;
 
-    DbVector<int32_t> *left_vec_;
     std::string left_col_name_;
 
 public:
     ColValCondDAGNode(int cond, std::string left_col_name, int32_t right_val) :
             CondDAGNode(cond),
             left_col_name_(std::move(left_col_name)),
-            left_vec_(nullptr),
             right_val_(right_val) {
         assignPrimitive_();
     }
@@ -85,22 +109,19 @@ public:
     ~ColValCondDAGNode() final {
     }
 
-    void setLeftVector(DbVector<int32_t> *vec) final {
-        left_vec_ = vec;
-    }
-
-    std::string getLeftColName() final {
+    const std::string& getLeftColName() const final {
         return left_col_name_;
     }
 
-    uint32_t compute(DbVector<uint32_t>* res_sel) final {
-        auto n = primitive_(left_vec_->n, res_sel->col, left_vec_->col, right_val_, nullptr);
+    uint32_t compute(const DbVector<int32_t> *left_vec, DbVector<uint32_t>* res_sel) const final {
+        auto n = primitive_(left_vec->n, res_sel->col, left_vec->col, right_val_, left_vec->validity, nullptr);
         res_sel->n = n;
         return n;
     }
 
-    uint32_t compute(DbVector<uint32_t>* res_sel, DbVector<uint32_t>* src_sel) final {
-        auto n = primitive_(src_sel->n, res_sel->col, left_vec_->col, right_val_, src_sel->col);
+    uint32_t compute(const DbVector<int32_t> *left_vec, DbVector<uint32_t>* res_sel,
+                     const DbVector<uint32_t>* src_sel) const final {
+        auto n = primitive_(src_sel->n, res_sel->col, left_vec->col, right_val_, left_vec->validity, src_sel->col);
         res_sel->n = n;
         return n;
     }
@@ -112,22 +133,21 @@ private:
 };
 
 
+typedef std::vector<std::unique_ptr<const CondDAGNode>> CondExpr;
+
+
 class SelectVectorizationOnlyNonBranchingOperator : public BaseOperator {
 private:
     BaseOperator* next_;
-    std::vector<CondDAGNode*> expr_;
+    std::shared_ptr<const CondExpr> expr_;
 
 public:
-    SelectVectorizationOnlyNonBranchingOperator(BaseOperator *next, std::vector<CondDAGNode*> expr) :
+    SelectVectorizationOnlyNonBranchingOperator(BaseOperator *next, std::shared_ptr<const CondExpr> expr) :
             next_(next), expr_(std::move(expr)) {
     }
 
     ~SelectVectorizationOnlyNonBranchingOperator() final {
         delete next_;
-        for (auto node : expr_) {
-            delete node;
-        }
-        expr_.clear();
     }
 
     void open() {
@@ -145,15 +165,14 @@ public:
 
         DbVector<uint32_t> *res_sel = new DbVector<uint32_t>(br->getn());
         bool first = true;
-        for (auto node : expr_) {
+        for (const auto& node : *expr_) {
             DbVector<int32_t> *dbVector = br->getCol(node->getLeftColName());
-            node->setLeftVector(dbVector);
             if (first) {
-                node->compute(res_sel);
+                node->compute(dbVector, res_sel);
                 first = false;
             }
             else {
-                node->compute(res_sel, res_sel);
+                node->compute(dbVector, res_sel, res_sel);
             }
         }
 
@@ -163,6 +182,17 @@ public:
 };
 
 
+/**
+ * The validity of the price of every row of br: a NULL operand makes it
+ * NULL. nullptr if no operand has NULLs.
+ */
+static uint64_t* priceValidity(BatchResult *br) {
+    uint32_t n = br->getn();
+    std::unique_ptr<uint64_t[]> validity(validity_and(n, br->getCol("extprice")->validity, br->getCol("discount")->validity));
+    return validity_and(n, validity.get(), br->getCol("tax")->validity);
+}
+
+
 class ProjectJitComputeAllOperator : public BaseOperator {
 private:
     BaseOperator* next_;
@@ -197,6 +227,7 @@ public:
         for (uint32_t i = 0; i < n; i++) {
             resvec[i] = extprice[i] * (100 - discount[i]) * (100 + tax[i]);
         }
+        res->setValidity(priceValidity(br));
 
         br->add("price", res);
         br->remove("tax");
@@ -245,11 +276,91 @@ public:
         for (uint32_t i = 0; i < n1; i++) {
             resvec[i] = extprice[ressel[i]] * (100 - discount[ressel[i]]) * (100 + tax[ressel[i]]);
         }
+        std::unique_ptr<uint64_t[]> validity(priceValidity(br));
+        res->setValidity(validity_gather(n1, validity.get(), ressel));
 
         br->add("price", res);
 
+        delete br->res_sel;
+        br->res_sel = nullptr;
+        br->remove("tax");
+        br->remove("extprice");
+        br->remove("discount");
+
+        return br;
+    }
+};
+
+
+/**
+ * The projection of ProjectJitNonComputeAllOperator, run with its loop
+ * until pipeline is compiled and with the generated code from then on; the
+ * switch happens at a batch boundary. Batches with NULLs always take the
+ * loop, the generated code reads values only.
+ */
+class ProjectAdaptiveOperator : public BaseOperator {
+private:
+    BaseOperator* next_;
+    std::shared_ptr<const CompiledPipeline> pipeline_;
+    PipelineKernel kernel_;
+    std::vector<int32_t*> in_;
+    std::vector<int64_t> state_;
+
+public:
+    ProjectAdaptiveOperator(BaseOperator *next, std::shared_ptr<const CompiledPipeline> pipeline) :
+            next_(next),
+            pipeline_(std::move(pipeline)),
+            kernel_(nullptr),
+            in_(pipeline_->getInputs().size()),
+            state_(pipeline_->getState()) {
+    }
+
+    ~ProjectAdaptiveOperator() final {
+        delete next_;
+    }
+
+    void open() {
+        next_->open();
+    }
+
+    void close() {
+        next_->close();
+    }
+
+    BatchResult* next() {
+        BatchResult *br = next_->next();
+        if (br == nullptr)
+            return br;
+
+        if (kernel_ == nullptr)
+            kernel_ = pipeline_->tryGetKernel();
+
+        std::unique_ptr<DbVector<uint32_t>> sel(br->res_sel);
         br->res_sel = nullptr;
-        delete ressel;
+        uint32_t n = sel == nullptr ? br->getn() : sel->n;
+        const uint32_t *ressel = sel == nullptr ? nullptr : sel->col;
+        DbVector<int32_t> *res = new DbVector<int32_t>(n);
+        std::unique_ptr<uint64_t[]> validity(priceValidity(br));
+
+        if (kernel_ != nullptr && validity == nullptr) {
+            for (uint32_t k = 0; k < in_.size(); k++)
+                in_[k] = br->getCol(pipeline_->getInputs()[k])->col;
+            int32_t *out = res->col;
+            res->n = kernel_(n, ressel, in_.data(), &out, state_.data());
+        }
+        else {
+            int32_t *resvec = res->col;
+            int32_t *tax = br->getCol("tax")->col;
+            int32_t *discount = br->getCol("discount")->col;
+            int32_t *extprice = br->getCol("extprice")->col;
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t idx = ressel == nullptr ? i : ressel[i];
+                resvec[i] = extprice[idx] * (100 - discount[idx]) * (100 + tax[idx]);
+            }
+            res->setValidity(ressel == nullptr ? validity.release() : validity_gather(n, validity.get(), ressel));
+        }
+
+        br->add("price", res);
         br->remove("tax");
         br->remove("extprice");
         br->remove("discount");
@@ -266,18 +377,18 @@ public:
  **************************************************************************/
 
 
-QueryPlan *compileQuery_Baseline() {
+QueryPlan *compileQuery_Baseline(uint32_t vector_size = DEFAULT_VECTOR_SIZE, uint64_t num_of_rows = NUM_OF_ROWS) {
     std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names, true, 100);
+    ScanOperator *scan_op = new ScanOperator(num_of_rows, col_names, true, 100, vector_size);
     return new QueryPlan(scan_op, false);
 }
 
 
-QueryPlan *compileQuery_ComputeAll() {
+QueryPlan *compileQuery_ComputeAll(uint32_t vector_size = DEFAULT_VECTOR_SIZE, uint64_t num_of_rows = NUM_OF_ROWS) {
     std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names, true, 100);
-    std::vector<CondDAGNode*> expr{};
-    expr.push_back(new ColValCondDAGNode(COND_LT, "tax", 90));
+    ScanOperator *scan_op = new ScanOperator(num_of_rows, col_names, true, 100, vector_size);
+    auto expr = std::make_shared<CondExpr>();
+    expr->emplace_back(new ColValCondDAGNode(COND_LT, "tax", 90));
 
     auto sel_op = new SelectVectorizationOnlyNonBranchingOperator(scan_op, expr);
     auto proj_op = new ProjectJitComputeAllOperator(sel_op);
@@ -285,11 +396,11 @@ QueryPlan *compileQuery_ComputeAll() {
 }
 
 
-QueryPlan *compileQuery_NonComputeAll() {
+QueryPlan *compileQuery_NonComputeAll(uint32_t vector_size = DEFAULT_VECTOR_SIZE, uint64_t num_of_rows = NUM_OF_ROWS) {
     std::vector<std::string> col_names{"extprice", "discount", "tax"};
-    ScanOperator *scan_op = new ScanOperator(BATCHES, col_names, true, 100);
-    std::vector<CondDAGNode*> expr{};
-    expr.push_back(new ColValCondDAGNode(COND_LT, "tax", 90));
+    ScanOperator *scan_op = new ScanOperator(num_of_rows, col_names, true, 100, vector_size);
+    auto expr = std::make_shared<CondExpr>();
+    expr->emplace_back(new ColValCondDAGNode(COND_LT, "tax", 90));
 
     auto sel_op = new SelectVectorizationOnlyNonBranchingOperator(scan_op, expr);
     auto proj_op = new ProjectJitNonComputeAllOperator(sel_op);
@@ -297,10 +408,83 @@ QueryPlan *compileQuery_NonComputeAll() {
 }
 
 
+QueryPlan *compileQuery_Codegen(uint32_t vector_size = DEFAULT_VECTOR_SIZE, uint64_t num_of_rows = NUM_OF_ROWS) {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    ScanOperator *scan_op = new ScanOperator(num_of_rows, col_names, true, 100, vector_size);
+
+    std::unique_ptr<CgOperator> plan(new CgScan(col_names));
+    plan.reset(new CgSelect(std::move(plan), cgOp("<", cgCol("tax"), cgConst(90))));
+    plan.reset(new CgProject(std::move(plan), {{"price",
+        cgOp("*", cgOp("*", cgCol("extprice"), cgOp("-", cgConst(100), cgCol("discount"))), cgOp("+", cgConst(100), cgCol("tax")))}}));
+    plan.reset(new CgMaterialize(std::move(plan), {"price"}));
+
+    auto pipeline = std::make_shared<const CompiledPipeline>(*plan, "synthesis_pipeline");
+    auto proj_op = new PipelineJitOperator(scan_op, pipeline);
+    return new QueryPlan(proj_op, false);
+}
+
+
+QueryPlan *compileQuery_Adaptive(uint32_t vector_size = DEFAULT_VECTOR_SIZE, uint64_t num_of_rows = NUM_OF_ROWS) {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    ScanOperator *scan_op = new ScanOperator(num_of_rows, col_names, true, 100, vector_size);
+    auto expr = std::make_shared<CondExpr>();
+    expr->emplace_back(new ColValCondDAGNode(COND_LT, "tax", 90));
+
+    // the selection stays vectorized, the generated code only projects
+    std::unique_ptr<CgOperator> plan(new CgScan(col_names));
+    plan.reset(new CgProject(std::move(plan), {{"price",
+        cgOp("*", cgOp("*", cgCol("extprice"), cgOp("-", cgConst(100), cgCol("discount"))), cgOp("+", cgConst(100), cgCol("tax")))}}));
+    plan.reset(new CgMaterialize(std::move(plan), {"price"}));
+    auto pipeline = std::make_shared<const CompiledPipeline>(*plan, "synthesis_projection");
+
+    auto sel_op = new SelectVectorizationOnlyNonBranchingOperator(scan_op, expr);
+    auto proj_op = new ProjectAdaptiveOperator(sel_op, pipeline);
+    return new QueryPlan(proj_op, false);
+}
+
+
+const std::vector<std::pair<std::string, QueryPlan *(*)(uint32_t, uint64_t)>> STRATEGIES{
+    {"baseline", compileQuery_Baseline},
+    {"compute_all", compileQuery_ComputeAll},
+    {"non_compute_all", compileQuery_NonComputeAll},
+    {"codegen", compileQuery_Codegen},
+    {"adaptive", compileQuery_Adaptive},
+};
+
+
 int main(int argc, char **argv) {
-    QueryPlan *query_plan = compileQuery_NonComputeAll();
+    const char *usage = "usage: synthesis [vector_size|auto|column] [num_of_rows] [baseline|compute_all|non_compute_all|codegen|adaptive]";
+    //   column - column-at-a-time: the whole table is a single batch, so every
+    //            primitive runs once over the full column and materializes
+    //            full-size intermediates (MonetDB's BAT algebra)
+    uint64_t num_of_rows = argc > 2 ? strtoull(argv[2], nullptr, 10) : NUM_OF_ROWS;
+    std::string strategy = argc > 3 ? argv[3] : "non_compute_all";
+
+    QueryPlan *(*compile)(uint32_t, uint64_t) = nullptr;
+    for (const auto& elem : STRATEGIES) {
+        if (strategy == elem.first)
+            compile = elem.second;
+    }
+    if (compile == nullptr) {
+        std::cout << "Unknown strategy " << strategy << "\n";
+        return 1;
+    }
+
+    // 3 columns + selection vector + projected column
+    uint32_t vector_size = parseVectorSizeArg(argc, argv, num_of_rows, DEFAULT_VECTOR_SIZE, usage, 5,
+                                              [compile](uint32_t n, uint32_t num_of_batches) {
+        QueryPlan *plan = compile(n, (uint64_t) num_of_batches * n);
+        plan->open();
+        plan->printResultSet();
+        plan->close();
+        delete plan;
+    });
+    if (vector_size == 0)
+        return 1;
+
+    QueryPlan *query_plan = compile(vector_size, num_of_rows);
     query_plan->open();
     query_plan->printResultSet();
     query_plan->close();
     delete query_plan;
-}
\ No newline at end of file
+}
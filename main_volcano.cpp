@@ -0,0 +1,528 @@
+#include <iostream>
+#include <memory>
+#include "common.h"
+
+/**
+ * This program evaluates the classic tuple-at-a-time (Volcano) model, the
+ * baseline that vectorization and jit are supposed to beat.
+ *
+ * Every operator returns one tuple per next() call and the expressions are
+ * interpreted per tuple by walking DAGNode/CondDAGNode trees. The data comes
+ * from the same ScanOperator as the other programs, and the top of the plan
+ * packs the tuples back into batches so that the same QueryPlan drives it.
+ *
+ * queries:
+ *   conjunctive - select * from lineitem
+ *                 where extprice < 50 and discount < 50 and tax < 50
+ *   project     - select extprice * (1 - discount) * (1 + tax) from lineitem
+ *   synthesis   - select extprice * (100 - discount) * (100 + tax)
+ *                 from lineitem where tax < 90
+ */
+
+
+const uint32_t BATCHES = 100000;
+const uint64_t NUM_OF_ROWS = (uint64_t) BATCHES * DEFAULT_VECTOR_SIZE;
+
+
+/**
+ * A row. values[i] belongs to the i-th column of the producing operator.
+ */
+struct Tuple {
+    std::vector<int32_t> values;
+};
+
+
+class TupleOperator {
+public:
+    TupleOperator() = default;
+    virtual ~TupleOperator() = default;
+
+    virtual void open() = 0;
+    virtual void close() = 0;
+
+    /**
+     * The next tuple, or nullptr at the end. The tuple is owned by the
+     * operator and is valid until the following call.
+     */
+    virtual Tuple* next() = 0;
+
+    virtual const std::vector<std::string>& getColumns() = 0;
+
+    uint32_t getColumnIndex(const std::string& col_name) {
+        const auto& columns = getColumns();
+        for (uint32_t i = 0; i < columns.size(); i++) {
+            if (columns[i] == col_name)
+                return i;
+        }
+        throw std::invalid_argument("Unknown column " + col_name);
+    }
+};
+
+
+/************************************************************************
+ *
+ * DAG NODES
+ *
+ **************************************************************************/
+
+
+#define OP_ADD      1
+#define OP_SUB      2
+#define OP_MUL      3
+
+
+class DAGNode {
+public:
+    DAGNode() = default;
+    virtual ~DAGNode() = default;
+
+    /**
+     * Resolve the column names against the columns of the input operator.
+     */
+    virtual void bind(TupleOperator *input) = 0;
+
+    virtual int32_t evaluate(const Tuple *tuple) = 0;
+};
+
+
+static int32_t applyOp(int op, int32_t left, int32_t right) {
+    switch (op)
+    {
+        case OP_ADD:
+            return left + right;
+
+        case OP_SUB:
+            return left - right;
+
+        case OP_MUL:
+            return left * right;
+
+        default:
+            throw std::invalid_argument("Unkonwn op");
+    }
+}
+
+
+class ValColDAGNode : public DAGNode {
+private:
+    int op_;
+    int32_t left_val_;
+    DAGNode *right_;
+    std::string col_name_;
+    uint32_t col_idx_;
+
+public:
+    ValColDAGNode(int op, int32_t left_val, DAGNode *right) :
+        op_(op), left_val_(left_val), right_(right), col_name_(""), col_idx_(0) {
+    }
+
+    ValColDAGNode(int op, int32_t left_val, std::string col_name) :
+        op_(op), left_val_(left_val), right_(nullptr), col_name_(std::move(col_name)), col_idx_(0) {
+    }
+
+    ~ValColDAGNode() final {
+        delete right_;
+    }
+
+    void bind(TupleOperator *input) final {
+        if (right_ != nullptr)
+            right_->bind(input);
+        else
+            col_idx_ = input->getColumnIndex(col_name_);
+    }
+
+    int32_t evaluate(const Tuple *tuple) final {
+        int32_t right = right_ != nullptr ? right_->evaluate(tuple) : tuple->values[col_idx_];
+        return applyOp(op_, left_val_, right);
+    }
+};
+
+
+class ColColDAGNode : public DAGNode {
+private:
+    int op_;
+    DAGNode *left_;
+    std::string left_col_name_;
+    uint32_t left_col_idx_;
+    DAGNode *right_;
+    std::string right_col_name_;
+    uint32_t right_col_idx_;
+
+public:
+    ColColDAGNode(int op, DAGNode* left, DAGNode* right) :
+        op_(op), left_(left), left_col_idx_(0), right_(right), right_col_idx_(0) {
+    }
+
+    ColColDAGNode(int op, std::string left_col_name, DAGNode* right) :
+        op_(op), left_(nullptr), left_col_name_(std::move(left_col_name)), left_col_idx_(0), right_(right), right_col_idx_(0) {
+    }
+
+    ColColDAGNode(int op, DAGNode* left, std::string right_col_name) :
+        op_(op), left_(left), left_col_idx_(0), right_(nullptr), right_col_name_(std::move(right_col_name)), right_col_idx_(0) {
+    }
+
+    ColColDAGNode(int op, std::string left_col_name, std::string right_col_name) :
+        op_(op), left_(nullptr), left_col_name_(std::move(left_col_name)), left_col_idx_(0),
+        right_(nullptr), right_col_name_(std::move(right_col_name)), right_col_idx_(0) {
+    }
+
+    ~ColColDAGNode() final {
+        delete left_;
+        delete right_;
+    }
+
+    void bind(TupleOperator *input) final {
+        if (left_ != nullptr)
+            left_->bind(input);
+        else
+            left_col_idx_ = input->getColumnIndex(left_col_name_);
+
+        if (right_ != nullptr)
+            right_->bind(input);
+        else
+            right_col_idx_ = input->getColumnIndex(right_col_name_);
+    }
+
+    int32_t evaluate(const Tuple *tuple) final {
+        int32_t left = left_ != nullptr ? left_->evaluate(tuple) : tuple->values[left_col_idx_];
+        int32_t right = right_ != nullptr ? right_->evaluate(tuple) : tuple->values[right_col_idx_];
+        return applyOp(op_, left, right);
+    }
+};
+
+
+#define COND_LT     1
+
+
+class CondDAGNode {
+private:
+    int cond_;
+
+public:
+    CondDAGNode(int cond) : cond_(cond) {}
+    virtual ~CondDAGNode() = default;
+
+    virtual void bind(TupleOperator *input) = 0;
+    virtual bool evaluate(const Tuple *tuple) = 0;
+
+    int getCond() const {
+        return cond_;
+    }
+};
+
+
+class ColValCondDAGNode : public CondDAGNode {
+private:
+    std::string left_col_name_;
+    uint32_t left_col_idx_;
+    int32_t right_val_;
+
+public:
+    ColValCondDAGNode(int cond, std::string left_col_name, int32_t right_val) :
+        CondDAGNode(cond),
+        left_col_name_(std::move(left_col_name)),
+        left_col_idx_(0),
+        right_val_(right_val) {
+    }
+
+    ~ColValCondDAGNode() final = default;
+
+    void bind(TupleOperator *input) final {
+        left_col_idx_ = input->getColumnIndex(left_col_name_);
+    }
+
+    bool evaluate(const Tuple *tuple) final {
+        switch (getCond())
+        {
+            case COND_LT:
+                return tuple->values[left_col_idx_] < right_val_;
+
+            default:
+                throw std::invalid_argument("Unkonwn cond");
+        }
+    }
+};
+
+
+/************************************************************************
+ *
+ * OPERATORS
+ *
+ **************************************************************************/
+
+
+/**
+ * Turns the batches of a batch operator (e.g. ScanOperator) into tuples.
+ */
+class TupleScanOperator : public TupleOperator {
+private:
+    BaseOperator *next_;
+    std::vector<std::string> columns_;
+    std::unique_ptr<BatchResult> br_;
+    std::vector<DbVector<int32_t>*> vecs_;
+    uint32_t pos_;
+    Tuple tuple_;
+
+public:
+    TupleScanOperator(BaseOperator *next, std::vector<std::string> columns) :
+        next_(next), columns_(std::move(columns)), br_(nullptr), pos_(0) {
+        tuple_.values.resize(columns_.size());
+    }
+
+    ~TupleScanOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    const std::vector<std::string>& getColumns() final {
+        return columns_;
+    }
+
+    Tuple* next() final {
+        while (br_ == nullptr || pos_ == br_->getn()) {
+            br_.reset(next_->next());
+            if (br_ == nullptr)
+                return nullptr;
+
+            vecs_.clear();
+            for (const auto& name : columns_)
+                vecs_.push_back(br_->getCol(name));
+            pos_ = 0;
+        }
+
+        for (uint32_t i = 0; i < vecs_.size(); i++)
+            tuple_.values[i] = vecs_[i]->col[pos_];
+        pos_++;
+        return &tuple_;
+    }
+};
+
+
+class TupleSelectOperator : public TupleOperator {
+private:
+    TupleOperator *next_;
+    std::vector<CondDAGNode*> expr_;
+
+public:
+    TupleSelectOperator(TupleOperator *next, std::vector<CondDAGNode*> expr) :
+        next_(next), expr_(std::move(expr)) {
+    }
+
+    ~TupleSelectOperator() final {
+        delete next_;
+        for (auto node : expr_)
+            delete node;
+        expr_.clear();
+    }
+
+    void open() final {
+        next_->open();
+        for (auto node : expr_)
+            node->bind(next_);
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    const std::vector<std::string>& getColumns() final {
+        return next_->getColumns();
+    }
+
+    Tuple* next() final {
+        while (true) {
+            Tuple *tuple = next_->next();
+            if (tuple == nullptr)
+                return nullptr;
+
+            bool qualified = true;
+            for (auto node : expr_) {
+                if (!node->evaluate(tuple)) {
+                    qualified = false;
+                    break;
+                }
+            }
+            if (qualified)
+                return tuple;
+        }
+    }
+};
+
+
+class TupleProjectOperator : public TupleOperator {
+private:
+    TupleOperator *next_;
+    DAGNode *expr_;
+    std::vector<std::string> columns_;
+    Tuple tuple_;
+
+public:
+    TupleProjectOperator(TupleOperator *next, std::string col_name, DAGNode *expr) :
+        next_(next), expr_(expr), columns_{std::move(col_name)} {
+        tuple_.values.resize(1);
+    }
+
+    ~TupleProjectOperator() final {
+        delete next_;
+        delete expr_;
+    }
+
+    void open() final {
+        next_->open();
+        expr_->bind(next_);
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    const std::vector<std::string>& getColumns() final {
+        return columns_;
+    }
+
+    Tuple* next() final {
+        Tuple *tuple = next_->next();
+        if (tuple == nullptr)
+            return nullptr;
+
+        tuple_.values[0] = expr_->evaluate(tuple);
+        return &tuple_;
+    }
+};
+
+
+/**
+ * Packs tuples into batches of vector_size rows for QueryPlan.
+ */
+class TupleToBatchOperator : public BaseOperator {
+private:
+    TupleOperator *next_;
+    uint32_t vector_size_;
+
+public:
+    TupleToBatchOperator(TupleOperator *next, uint32_t vector_size = DEFAULT_VECTOR_SIZE) :
+        next_(next), vector_size_(vector_size) {
+    }
+
+    ~TupleToBatchOperator() final {
+        delete next_;
+    }
+
+    void open() final {
+        next_->open();
+    }
+
+    void close() final {
+        next_->close();
+    }
+
+    BatchResult* next() final {
+        const auto& columns = next_->getColumns();
+        BatchResult *br = nullptr;
+        std::vector<int32_t*> cols{};
+        uint32_t n = 0;
+
+        while (n < vector_size_) {
+            Tuple *tuple = next_->next();
+            if (tuple == nullptr)
+                break;
+
+            if (br == nullptr) {
+                br = new BatchResult(columns, vector_size_);
+                for (const auto& name : columns)
+                    cols.push_back(br->getCol(name)->col);
+            }
+            for (uint32_t i = 0; i < cols.size(); i++)
+                cols[i][n] = tuple->values[i];
+            n++;
+        }
+
+        if (br != nullptr) {
+            for (auto& elem : br->data)
+                elem.second->n = n;
+        }
+        return br;
+    }
+};
+
+
+/************************************************************************
+ *
+ * Query compiler
+ *
+ **************************************************************************/
+
+
+QueryPlan *compileQuery_Conjunctive() {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    auto scan_op = new ScanOperator(NUM_OF_ROWS, col_names, true, 100);
+    auto tuple_scan_op = new TupleScanOperator(scan_op, col_names);
+
+    std::vector<CondDAGNode*> expr{};
+    expr.push_back(new ColValCondDAGNode(COND_LT, "extprice", 50));
+    expr.push_back(new ColValCondDAGNode(COND_LT, "discount", 50));
+    expr.push_back(new ColValCondDAGNode(COND_LT, "tax", 50));
+    auto sel_op = new TupleSelectOperator(tuple_scan_op, expr);
+
+    return new QueryPlan(new TupleToBatchOperator(sel_op), false);
+}
+
+
+QueryPlan *compileQuery_Project() {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    auto scan_op = new ScanOperator(NUM_OF_ROWS, col_names, true, 100);
+    auto tuple_scan_op = new TupleScanOperator(scan_op, col_names);
+
+    auto oneMinusDiscount = new ValColDAGNode(OP_SUB, 1, "discount");
+    auto extpriceMul = new ColColDAGNode(OP_MUL, "extprice", oneMinusDiscount);
+    auto oneAddTax = new ValColDAGNode(OP_ADD, 1, "tax");
+    auto mul = new ColColDAGNode(OP_MUL, extpriceMul, oneAddTax);
+    auto proj_op = new TupleProjectOperator(tuple_scan_op, "bonus", mul);
+
+    return new QueryPlan(new TupleToBatchOperator(proj_op), false);
+}
+
+
+QueryPlan *compileQuery_Synthesis() {
+    std::vector<std::string> col_names{"extprice", "discount", "tax"};
+    auto scan_op = new ScanOperator(NUM_OF_ROWS, col_names, true, 100);
+    auto tuple_scan_op = new TupleScanOperator(scan_op, col_names);
+
+    std::vector<CondDAGNode*> expr{};
+    expr.push_back(new ColValCondDAGNode(COND_LT, "tax", 90));
+    auto sel_op = new TupleSelectOperator(tuple_scan_op, expr);
+
+    auto hundredMinusDiscount = new ValColDAGNode(OP_SUB, 100, "discount");
+    auto extpriceMul = new ColColDAGNode(OP_MUL, "extprice", hundredMinusDiscount);
+    auto hundredAddTax = new ValColDAGNode(OP_ADD, 100, "tax");
+    auto mul = new ColColDAGNode(OP_MUL, extpriceMul, hundredAddTax);
+    auto proj_op = new TupleProjectOperator(sel_op, "price", mul);
+
+    return new QueryPlan(new TupleToBatchOperator(proj_op), false);
+}
+
+
+int main(int argc, char **argv) {
+    // usage: volcano [conjunctive|project|synthesis]
+    std::string query = argc > 1 ? argv[1] : "conjunctive";
+
+    QueryPlan *query_plan = nullptr;
+    if (query == "project")
+        query_plan = compileQuery_Project();
+    else if (query == "synthesis")
+        query_plan = compileQuery_Synthesis();
+    else
+        query_plan = compileQuery_Conjunctive();
+
+    query_plan->open();
+    query_plan->printResultSet();
+    query_plan->close();
+    delete query_plan;
+}
@@ -0,0 +1,243 @@
+#ifndef PROJECT_MORSEL_H
+#define PROJECT_MORSEL_H
+
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <functional>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include "common.h"
+
+
+/**
+ * Morsel-driven parallelism (Leis et al., "Morsel-driven parallelism: a
+ * NUMA-aware query evaluation framework for the many-core age", SIGMOD 2014).
+ *
+ * The batches of a scan are split into one contiguous range per worker.
+ * A worker takes morsels (morsel_size batches) from the front of its own
+ * range and, once that is empty, steals the back half of the largest range
+ * left. Every worker runs its own instance of the pipeline on top of a
+ * MorselScanOperator, so operators need no synchronization; only the
+ * ranges are shared.
+ */
+
+
+class MorselQueue {
+private:
+    // [begin, end) packed as begin << 32 | end, one cache line per worker
+    struct alignas(64) Range {
+        std::atomic<uint64_t> bounds;
+    };
+
+    std::vector<Range> ranges_;
+    uint32_t morsel_size_;
+
+    static inline uint64_t pack_(uint32_t begin, uint32_t end) {
+        return (uint64_t) begin << 32 | end;
+    }
+
+    static inline uint32_t begin_(uint64_t bounds) {
+        return (uint32_t) (bounds >> 32);
+    }
+
+    static inline uint32_t end_(uint64_t bounds) {
+        return (uint32_t) bounds;
+    }
+
+public:
+    MorselQueue(uint32_t num_of_batches, uint32_t num_of_workers, uint32_t morsel_size) :
+            ranges_(num_of_workers == 0 ? 1 : num_of_workers),
+            morsel_size_(morsel_size == 0 ? 1 : morsel_size) {
+        auto workers = (uint32_t) ranges_.size();
+        for (uint32_t w = 0; w < workers; w++) {
+            auto begin = (uint32_t) ((uint64_t) num_of_batches * w / workers);
+            auto end = (uint32_t) ((uint64_t) num_of_batches * (w + 1) / workers);
+            ranges_[w].bounds.store(pack_(begin, end), std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t getNumOfWorkers() const {
+        return (uint32_t) ranges_.size();
+    }
+
+    /**
+     * Claim the next morsel [*begin, *end) of batches for worker; false once
+     * all batches are taken.
+     */
+    bool next(uint32_t worker, uint32_t *begin, uint32_t *end) {
+        while (true) {
+            if (popFront_(worker, begin, end))
+                return true;
+            if (!steal_(worker))
+                return false;
+        }
+    }
+
+private:
+    bool popFront_(uint32_t worker, uint32_t *begin, uint32_t *end) {
+        std::atomic<uint64_t>& bounds = ranges_[worker].bounds;
+        uint64_t cur = bounds.load(std::memory_order_acquire);
+        while (begin_(cur) < end_(cur)) {
+            uint32_t b = begin_(cur);
+            uint32_t e = std::min(end_(cur), b + morsel_size_);
+            if (bounds.compare_exchange_weak(cur, pack_(e, end_(cur)), std::memory_order_acq_rel)) {
+                *begin = b;
+                *end = e;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Move the back half of the largest other range into the (empty) range
+     * of worker; false if there is nothing left anywhere.
+     */
+    bool steal_(uint32_t worker) {
+        while (true) {
+            uint32_t victim = worker;
+            uint32_t largest = 0;
+            for (uint32_t w = 0; w < ranges_.size(); w++) {
+                uint64_t cur = ranges_[w].bounds.load(std::memory_order_acquire);
+                uint32_t left = end_(cur) - std::min(begin_(cur), end_(cur));
+                if (w != worker && left > largest) {
+                    victim = w;
+                    largest = left;
+                }
+            }
+            if (victim == worker)
+                return false;
+
+            std::atomic<uint64_t>& bounds = ranges_[victim].bounds;
+            uint64_t cur = bounds.load(std::memory_order_acquire);
+            uint32_t b = begin_(cur);
+            uint32_t e = end_(cur);
+            if (b >= e)
+                continue;
+
+            uint32_t left = e - b;
+            uint32_t take = left <= morsel_size_ ? left : (left + 1) / 2;
+            uint32_t split = e - take;
+            if (bounds.compare_exchange_strong(cur, pack_(b, split), std::memory_order_acq_rel)) {
+                ranges_[worker].bounds.store(pack_(split, e), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+};
+
+
+/**
+ * ScanOperator over the morsels a worker claims from a MorselQueue of
+ * numOfBatches(num_of_rows, vector_size) batches. The batches are generated
+ * by their index, so together the workers produce exactly the batches of the
+ * sequential ScanOperator, including its short last one.
+ */
+class MorselScanOperator : public BaseOperator {
+private:
+    MorselQueue *morsels_;
+    uint32_t worker_;
+    std::vector<std::string> columns_;
+    uint64_t num_of_rows_;
+    uint32_t vector_size_;
+    DataGenerator generator_;
+    uint32_t batch_idx_;
+    uint32_t morsel_end_;
+
+public:
+    MorselScanOperator(MorselQueue *morsels,
+                       uint32_t worker,
+                       const DataGenerator& generator,
+                       uint64_t num_of_rows,
+                       uint32_t vector_size = DEFAULT_VECTOR_SIZE) :
+            morsels_(morsels),
+            worker_(worker),
+            num_of_rows_(num_of_rows),
+            vector_size_(vector_size),
+            generator_(generator),
+            batch_idx_(0),
+            morsel_end_(0) {
+        for (const auto& spec : generator_.getSpecs())
+            columns_.push_back(spec.name);
+    }
+
+    ~MorselScanOperator() final = default;
+
+    void open() final {
+        batch_idx_ = 0;
+        morsel_end_ = 0;
+    }
+
+    void close() final {
+        // do nothing
+    }
+
+    BatchResult* next() final {
+        if (batch_idx_ >= morsel_end_ && !morsels_->next(worker_, &batch_idx_, &morsel_end_))
+            return nullptr;
+
+        auto n = (uint32_t) std::min<uint64_t>(vector_size_, num_of_rows_ - (uint64_t) batch_idx_ * vector_size_);
+        BatchResult *br = new BatchResult(columns_, n);
+        std::vector<int32_t*> cols{};
+        for (const auto& name : columns_)
+            cols.push_back(br->data[name]->col);
+        generator_.fillRows((uint64_t) batch_idx_ * vector_size_, n, cols.data());
+
+        batch_idx_++;
+        return br;
+    }
+};
+
+
+/**
+ * Runs num_of_threads instances of a plan, compile(worker) builds the one of
+ * each worker, and drains instance w into sinks[w]. The first exception of
+ * any worker is rethrown once all are done. With pin, worker w runs on cpu
+ * w modulo the number of cpus.
+ */
+inline void executeParallel(const std::function<QueryPlan*(uint32_t)>& compile,
+                            const std::vector<ResultSink*>& sinks,
+                            bool pin = false) {
+    auto num_of_threads = (uint32_t) sinks.size();
+    std::mutex error_mutex;
+    std::exception_ptr error = nullptr;
+
+    auto worker = [&](uint32_t w) {
+        try {
+            QueryPlan *plan = compile(w);
+            plan->open();
+            plan->execute(sinks[w]);
+            plan->close();
+            delete plan;
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> guard(error_mutex);
+            if (error == nullptr)
+                error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads{};
+    for (uint32_t w = 0; w < num_of_threads; w++) {
+        threads.emplace_back(worker, w);
+        if (pin) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(w % std::thread::hardware_concurrency(), &cpus);
+            pthread_setaffinity_np(threads.back().native_handle(), sizeof(cpus), &cpus);
+        }
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    if (error != nullptr)
+        std::rethrow_exception(error);
+}
+
+
+#endif //PROJECT_MORSEL_H
@@ -0,0 +1,260 @@
+#ifndef PROJECT_PARTITION_H
+#define PROJECT_PARTITION_H
+
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "hash.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/**
+ * Radix partitioning (Manegold et al., "Optimizing main-memory join on
+ * modern hardware", TKDE 2002; Balkesen et al., "Main-memory hash joins on
+ * multi-core CPUs: tuning to the underlying hardware", ICDE 2013).
+ *
+ * The rows of a table too large for the cache are split into 2^num_of_bits
+ * partitions by the top bits of the hash of their key, so that an operator
+ * working one partition at a time keeps its hash table in the cache. Hash
+ * tables index with the low bits of the hash, which stay spread out within
+ * a partition.
+ *
+ * A pass scatters into at most 2^RADIX_BITS_PER_PASS partitions, as more
+ * would thrash the TLB and the L1; more bits take more passes, each one
+ * splitting every partition of the last. A pass first counts the rows of
+ * every partition, then scatters the rows through one 64-byte line per
+ * partition and column (software write-combining): a line is written to
+ * its partition only when full, with non-temporal stores, so the scatter
+ * neither reads the destination nor pushes the source out of the cache.
+ * Every partition starts on a line boundary, which leaves up to 15 rows of
+ * padding between partitions.
+ */
+
+
+#define RADIX_BITS_PER_PASS     8
+#define RADIX_MAX_BITS          16
+#define RADIX_LINE              16      // int32 values per 64-byte line
+
+
+/**
+ * The number of bits that splits num_of_bytes of hash table into
+ * partitions of at most half of cache_size.
+ */
+inline uint32_t radixBitsFor(uint64_t num_of_bytes, uint64_t cache_size) {
+    uint32_t bits = 0;
+    while (bits < RADIX_MAX_BITS && (num_of_bytes >> bits) > cache_size / 2)
+        bits++;
+    return bits;
+}
+
+
+/**
+ * Collects the rows of batches (the int32 columns names, the hash of
+ * key_col with them), then partition() partitions them.
+ */
+class RadixPartitioner {
+private:
+    struct FreeDeleter {
+        void operator()(void *p) const {
+            free(p);
+        }
+    };
+
+    typedef std::unique_ptr<int32_t, FreeDeleter> Buffer;
+
+    std::vector<std::string> names_;
+    std::string key_col_;
+    uint32_t num_of_bits_;
+
+    // the columns and then the hashes, as collected
+    std::vector<std::vector<int32_t>> input_;
+    // the same, partitioned
+    std::vector<Buffer> columns_;
+    // input_ or columns_
+    std::vector<const int32_t*> cols_;
+    std::vector<uint64_t> begins_;
+    std::vector<uint64_t> ends_;
+    bool partitioned_;
+
+    static Buffer allocate_(uint64_t n) {
+        uint64_t bytes = (n * sizeof(int32_t) + 63) / 64 * 64;
+        auto p = (int32_t*) aligned_alloc(64, bytes == 0 ? 64 : bytes);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return Buffer(p);
+    }
+
+    static inline void streamLine_(int32_t *dst, const int32_t *line) {
+#if defined(__SSE2__)
+        for (uint32_t q = 0; q < 4; q++)
+            _mm_stream_si128((__m128i*) dst + q, _mm_load_si128((const __m128i*) line + q));
+#else
+        memcpy(dst, line, RADIX_LINE * sizeof(int32_t));
+#endif
+    }
+
+    /**
+     * One pass: every partition [begins[p], ends[p]) of src is split into
+     * fanout partitions by the hash bits above shift, into a new dst.
+     */
+    void pass_(uint32_t shift, uint32_t fanout) {
+        auto num_of_cols = (uint32_t) cols_.size();
+        const uint32_t *hashes = (const uint32_t*) cols_[num_of_cols - 1];
+        auto num_of_parents = (uint32_t) begins_.size();
+
+        // histograms, then the line-aligned partition starts
+        std::vector<uint64_t> begins((uint64_t) num_of_parents * fanout, 0);
+        for (uint32_t parent = 0; parent < num_of_parents; parent++) {
+            uint64_t *count = &begins[(uint64_t) parent * fanout];
+            for (uint64_t i = begins_[parent]; i < ends_[parent]; i++)
+                count[(hashes[i] >> shift) & (fanout - 1)]++;
+        }
+        uint64_t offset = 0;
+        for (auto& b : begins) {
+            uint64_t count = b;
+            b = offset;
+            offset += (count + RADIX_LINE - 1) / RADIX_LINE * RADIX_LINE;
+        }
+
+        std::vector<Buffer> dst;
+        for (uint32_t c = 0; c < num_of_cols; c++)
+            dst.push_back(allocate_(offset));
+
+        // the write-combining lines, fanout x num_of_cols
+        Buffer lines = allocate_((uint64_t) fanout * num_of_cols * RADIX_LINE);
+        std::vector<uint64_t> ends(begins);
+        for (uint32_t parent = 0; parent < num_of_parents; parent++) {
+            uint64_t *cursor = &ends[(uint64_t) parent * fanout];
+            for (uint64_t i = begins_[parent]; i < ends_[parent]; i++) {
+                uint32_t p = (hashes[i] >> shift) & (fanout - 1);
+                uint64_t pos = cursor[p]++;
+                uint32_t slot = pos % RADIX_LINE;
+                int32_t *line = lines.get() + (uint64_t) p * num_of_cols * RADIX_LINE;
+                for (uint32_t c = 0; c < num_of_cols; c++)
+                    line[c * RADIX_LINE + slot] = cols_[c][i];
+                if (slot == RADIX_LINE - 1) {
+                    for (uint32_t c = 0; c < num_of_cols; c++)
+                        streamLine_(dst[c].get() + pos + 1 - RADIX_LINE, line + c * RADIX_LINE);
+                }
+            }
+
+            // the partial lines
+            for (uint32_t p = 0; p < fanout; p++) {
+                uint32_t rest = cursor[p] % RADIX_LINE;
+                const int32_t *line = lines.get() + (uint64_t) p * num_of_cols * RADIX_LINE;
+                for (uint32_t c = 0; c < num_of_cols && rest > 0; c++)
+                    memcpy(dst[c].get() + cursor[p] - rest, line + c * RADIX_LINE, rest * sizeof(int32_t));
+            }
+        }
+#if defined(__SSE2__)
+        _mm_sfence();
+#endif
+
+        columns_.swap(dst);
+        for (uint32_t c = 0; c < num_of_cols; c++)
+            cols_[c] = columns_[c].get();
+        begins_.swap(begins);
+        ends_.swap(ends);
+    }
+
+public:
+    RadixPartitioner(std::vector<std::string> names, std::string key_col, uint32_t num_of_bits) :
+        names_(std::move(names)),
+        key_col_(std::move(key_col)),
+        num_of_bits_(num_of_bits),
+        partitioned_(false) {
+        if (num_of_bits > RADIX_MAX_BITS)
+            throw std::invalid_argument("at most " + std::to_string(RADIX_MAX_BITS) + " radix bits");
+        input_.resize(names_.size() + 1);
+    }
+
+    void append(BatchResult *br) {
+        if (partitioned_)
+            throw std::logic_error("append after partition()");
+
+        const DbVector<uint32_t> *sel_vec = br->res_sel;
+        uint32_t n = sel_vec == nullptr ? br->getn() : sel_vec->n;
+        const uint32_t *sel = sel_vec == nullptr ? nullptr : sel_vec->col;
+        for (size_t c = 0; c < names_.size(); c++) {
+            auto it = br->data.find(names_[c]);
+            if (it == br->data.end())
+                throw std::invalid_argument("no column " + names_[c] + " to partition");
+            const int32_t *col = it->second->col;
+            std::vector<int32_t>& column = input_[c];
+            if (sel == nullptr) {
+                column.insert(column.end(), col, col + n);
+            }
+            else {
+                for (uint32_t j = 0; j < n; j++)
+                    column.push_back(col[sel[j]]);
+            }
+        }
+
+        auto it = br->data.find(key_col_);
+        if (it == br->data.end())
+            throw std::invalid_argument("no key column " + key_col_ + " to partition");
+        std::vector<int32_t>& hashes = input_.back();
+        size_t first = hashes.size();
+        hashes.resize(first + n);
+        hash_int32_col(n, (uint32_t*) hashes.data() + first, it->second->col, sel);
+    }
+
+    void partition() {
+        if (partitioned_)
+            throw std::logic_error("partition() twice");
+
+        uint64_t num_of_rows = input_.back().size();
+        for (const auto& column : input_)
+            cols_.push_back(column.data());
+        begins_ = {0};
+        ends_ = {num_of_rows};
+
+        uint32_t done = 0;
+        while (done < num_of_bits_) {
+            // spread the bits evenly over the passes
+            uint32_t passes = (num_of_bits_ - done + RADIX_BITS_PER_PASS - 1) / RADIX_BITS_PER_PASS;
+            uint32_t bits = (num_of_bits_ - done + passes - 1) / passes;
+            pass_(32 - done - bits, 1u << bits);
+            done += bits;
+            // the first pass read the collected rows
+            std::vector<std::vector<int32_t>>().swap(input_);
+        }
+        partitioned_ = true;
+    }
+
+    uint32_t getNumOfPartitions() const {
+        return (uint32_t) begins_.size();
+    }
+
+    uint64_t getBegin(uint32_t partition) const {
+        return begins_[partition];
+    }
+
+    uint64_t getEnd(uint32_t partition) const {
+        return ends_[partition];
+    }
+
+    /**
+     * Column c (in the order of names) after partition(); the rows of
+     * partition p are [getBegin(p), getEnd(p)).
+     */
+    const int32_t* getCol(uint32_t c) const {
+        return cols_[c];
+    }
+
+    const uint32_t* getHashes() const {
+        return (const uint32_t*) cols_.back();
+    }
+};
+
+
+#endif //PROJECT_PARTITION_H
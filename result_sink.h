@@ -0,0 +1,430 @@
+#ifndef PROJECT_RESULT_SINK_H
+#define PROJECT_RESULT_SINK_H
+
+
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unistd.h>
+#include "common.h"
+
+
+/**
+ * Result sinks for QueryPlan::execute, instead of BatchResult::print:
+ *
+ *   TextSink      tab separated text; every column of a batch is formatted
+ *                 at once into fixed-width slots, then the rows are stitched
+ *                 together into a large output buffer
+ *   BinarySink    the columns as raw binary (see below)
+ *   ChecksumSink  counts the rows and hashes the values, for benchmarks that
+ *                 must consume the result without paying for output
+ *   CountSink     only counts the rows, for runs that drop the result
+ *
+ * The columns of a batch are resolved once per batch, never per row. Sinks
+ * follow the column order of print: int32 columns, then string columns,
+ * each by name.
+ */
+
+
+const char DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+
+inline uint32_t decimalDigits(uint32_t v) {
+    static const uint32_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    // log10 from log2, corrected by one comparison
+    uint32_t t = (32 - (uint32_t) __builtin_clz(v | 1)) * 1233 >> 12;
+    return t - ((v | 1) < POW10[t]) + 1;
+}
+
+
+/**
+ * Write v in decimal to out (at least 11 bytes) and return its length.
+ */
+inline uint32_t formatInt32(int32_t v, char *out) {
+    uint32_t len = 0;
+    auto u = (uint32_t) v;
+    if (v < 0) {
+        out[len++] = '-';
+        u = 0u - u;
+    }
+
+    uint32_t digits = decimalDigits(u);
+    char *p = out + len + digits;
+    while (u >= 100) {
+        uint32_t pair = (u % 100) * 2;
+        u /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (u >= 10) {
+        *--p = DIGIT_PAIRS[u * 2 + 1];
+        *--p = DIGIT_PAIRS[u * 2];
+    }
+    else {
+        *--p = (char) ('0' + u);
+    }
+    return len + digits;
+}
+
+
+/**
+ * Buffered writes to a file descriptor.
+ */
+class OutputBuffer {
+private:
+    int fd_;
+    std::vector<char> buffer_;
+    size_t used_;
+
+public:
+    explicit OutputBuffer(int fd, size_t capacity = 1 << 20) : fd_(fd), buffer_(capacity), used_(0) {}
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    ~OutputBuffer() {
+        try {
+            flush();
+        }
+        catch (...) {
+            // the destructor must not throw, call flush() to see errors
+        }
+    }
+
+    /**
+     * Room for len more bytes at the returned pointer; commit() them after.
+     */
+    char* reserve(size_t len) {
+        if (used_ + len > buffer_.size()) {
+            flush();
+            if (len > buffer_.size())
+                buffer_.resize(len);
+        }
+        return buffer_.data() + used_;
+    }
+
+    void commit(size_t len) {
+        used_ += len;
+    }
+
+    void append(const void *data, size_t len) {
+        memcpy(reserve(len), data, len);
+        commit(len);
+    }
+
+    void flush() {
+        const char *p = buffer_.data();
+        size_t len = used_;
+        used_ = 0;
+        while (len > 0) {
+            ssize_t rc = ::write(fd_, p, len);
+            if (rc < 0 && errno == EINTR)
+                continue;
+            if (rc <= 0)
+                throw std::runtime_error("write failed");
+            p += rc;
+            len -= (size_t) rc;
+        }
+    }
+};
+
+
+class TextSink : public ResultSink {
+private:
+    static const uint32_t SLOT = 12;    // "-2147483648" and a separator
+
+    OutputBuffer out_;
+    bool header_;
+    std::vector<char> slots_;
+    std::vector<uint8_t> lens_;
+
+public:
+    explicit TextSink(int fd = STDOUT_FILENO, bool header = true) : out_(fd), header_(header) {}
+
+    void consume(BatchResult *br) final {
+        std::vector<DbVector<int32_t>*> ints{};
+        std::vector<DbVector<DbString>*> strs{};
+        std::string header{};
+        for (const auto& elem : br->data) {
+            ints.push_back(elem.second);
+            header += elem.first + "\t";
+        }
+        for (const auto& elem : br->str_data) {
+            strs.push_back(elem.second);
+            header += elem.first + "\t";
+        }
+        if (header_) {
+            header.back() = '\n';
+            out_.append(header.data(), header.size());
+            header_ = false;
+        }
+
+        const DbVector<uint32_t> *sel = br->res_sel;
+        uint32_t n = sel == nullptr ? br->getn() : sel->n;
+        if (n == 0 || (ints.empty() && strs.empty()))
+            return;
+
+        // every int32 column at once into fixed slots
+        slots_.resize((size_t) n * SLOT * ints.size());
+        lens_.resize((size_t) n * ints.size());
+        for (uint32_t c = 0; c < ints.size(); c++)
+            formatColumn_(ints[c], sel, n, slots_.data() + (size_t) c * n * SLOT, lens_.data() + (size_t) c * n);
+
+        auto num_of_cols = (uint32_t) (ints.size() + strs.size());
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t idx = sel == nullptr ? i : sel->col[i];
+            size_t row_len = ints.size() * SLOT + strs.size();
+            for (auto vec : strs)
+                row_len += vec->col[idx].len + 4;    // or NULL
+
+            char *p = out_.reserve(row_len);
+            char *start = p;
+            uint32_t c = 0;
+            for (; c < ints.size(); c++) {
+                // copy the whole slot, keep the digits
+                memcpy(p, slots_.data() + ((size_t) c * n + i) * SLOT, SLOT);
+                p += lens_[(size_t) c * n + i];
+                *p++ = c + 1 == num_of_cols ? '\n' : '\t';
+            }
+            for (auto vec : strs) {
+                if (vec->isNull(idx)) {
+                    memcpy(p, "NULL", 4);
+                    p += 4;
+                }
+                else {
+                    memcpy(p, vec->col[idx].data(), vec->col[idx].len);
+                    p += vec->col[idx].len;
+                }
+                *p++ = ++c == num_of_cols ? '\n' : '\t';
+            }
+            out_.commit((size_t) (p - start));
+        }
+    }
+
+    void finish() final {
+        out_.flush();
+    }
+
+private:
+    static void formatColumn_(const DbVector<int32_t> *vec, const DbVector<uint32_t> *sel, uint32_t n,
+                              char *slots, uint8_t *lens) {
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t idx = sel == nullptr ? i : sel->col[i];
+            if (vec->isNull(idx)) {
+                memcpy(slots + (size_t) i * SLOT, "NULL", 4);
+                lens[i] = 4;
+            }
+            else {
+                lens[i] = (uint8_t) formatInt32(vec->col[idx], slots + (size_t) i * SLOT);
+            }
+        }
+    }
+};
+
+
+/**
+ * Raw binary columns:
+ *
+ *   "JVRESULT", uint32 num_of_columns,
+ *   per column: uint32 type (1 int32, 2 string), uint32 name length, name
+ *
+ *   per batch:  uint32 num_of_rows
+ *     per column: uint32 has_validity, [validity bitmap, 8-byte words]
+ *                 int32:  num_of_rows values
+ *                 string: num_of_rows uint32 lengths, then the bytes
+ *
+ * Selected rows are compacted; without a selection vector the vectors are
+ * written as they are.
+ */
+class BinarySink : public ResultSink {
+private:
+    OutputBuffer out_;
+    bool header_;
+    std::vector<int32_t> values_;
+    std::vector<uint32_t> lens_;
+
+public:
+    explicit BinarySink(int fd) : out_(fd), header_(true) {}
+
+    void consume(BatchResult *br) final {
+        if (header_) {
+            writeHeader_(br);
+            header_ = false;
+        }
+
+        const DbVector<uint32_t> *sel = br->res_sel;
+        uint32_t n = sel == nullptr ? br->getn() : sel->n;
+        out_.append(&n, sizeof(n));
+
+        for (const auto& elem : br->data) {
+            DbVector<int32_t> *vec = elem.second;
+            writeValidity_(vec->validity, n, sel);
+            if (sel == nullptr) {
+                out_.append(vec->col, (size_t) n * sizeof(int32_t));
+            }
+            else {
+                values_.resize(n);
+                for (uint32_t i = 0; i < n; i++)
+                    values_[i] = vec->col[sel->col[i]];
+                out_.append(values_.data(), (size_t) n * sizeof(int32_t));
+            }
+        }
+
+        for (const auto& elem : br->str_data) {
+            DbVector<DbString> *vec = elem.second;
+            writeValidity_(vec->validity, n, sel);
+            lens_.resize(n);
+            for (uint32_t i = 0; i < n; i++)
+                lens_[i] = vec->col[sel == nullptr ? i : sel->col[i]].len;
+            out_.append(lens_.data(), (size_t) n * sizeof(uint32_t));
+            for (uint32_t i = 0; i < n; i++) {
+                const DbString& s = vec->col[sel == nullptr ? i : sel->col[i]];
+                out_.append(s.data(), s.len);
+            }
+        }
+    }
+
+    void finish() final {
+        out_.flush();
+    }
+
+private:
+    void writeHeader_(BatchResult *br) {
+        out_.append("JVRESULT", 8);
+        auto num_of_columns = (uint32_t) (br->data.size() + br->str_data.size());
+        out_.append(&num_of_columns, sizeof(num_of_columns));
+        auto write_column = [this](const std::string& name, uint32_t type) {
+            auto len = (uint32_t) name.size();
+            out_.append(&type, sizeof(type));
+            out_.append(&len, sizeof(len));
+            out_.append(name.data(), len);
+        };
+        for (const auto& elem : br->data)
+            write_column(elem.first, 1);
+        for (const auto& elem : br->str_data)
+            write_column(elem.first, 2);
+    }
+
+    void writeValidity_(const uint64_t *validity, uint32_t n, const DbVector<uint32_t> *sel) {
+        uint32_t has_validity = validity != nullptr;
+        out_.append(&has_validity, sizeof(has_validity));
+        if (validity == nullptr)
+            return;
+        if (sel == nullptr) {
+            out_.append(validity, validityWords(n) * sizeof(uint64_t));
+            return;
+        }
+        uint64_t *gathered = validity_gather(n, validity, sel->col);
+        out_.append(gathered, validityWords(n) * sizeof(uint64_t));
+        delete[] gathered;
+    }
+};
+
+
+/**
+ * Counts the rows and folds every value into a checksum. The checksum is a
+ * sum of per-value hashes, so it does not depend on how the rows are cut
+ * into batches (or on their order).
+ */
+class ChecksumSink : public ResultSink {
+private:
+    uint64_t count_;
+    uint64_t checksum_;
+
+    static inline uint64_t mix_(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDull;
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ull;
+        return x ^ (x >> 33);
+    }
+
+public:
+    ChecksumSink() : count_(0), checksum_(0) {}
+
+    uint64_t getCount() const {
+        return count_;
+    }
+
+    uint64_t getChecksum() const {
+        return checksum_;
+    }
+
+    void consume(BatchResult *br) final {
+        const DbVector<uint32_t> *sel = br->res_sel;
+        uint32_t n = sel == nullptr ? br->getn() : sel->n;
+        count_ += n;
+
+        uint64_t column = 0;
+        for (const auto& elem : br->data) {
+            const DbVector<int32_t> *vec = elem.second;
+            uint64_t seed = ++column << 32;
+            uint64_t sum = 0;
+            if (sel == nullptr && vec->validity == nullptr) {
+                for (uint32_t i = 0; i < n; i++)
+                    sum += mix_(seed | (uint32_t) vec->col[i]);
+            }
+            else {
+                for (uint32_t i = 0; i < n; i++) {
+                    uint32_t idx = sel == nullptr ? i : sel->col[i];
+                    sum += vec->isNull(idx) ? seed : mix_(seed | (uint32_t) vec->col[idx]);
+                }
+            }
+            checksum_ += sum;
+        }
+
+        for (const auto& elem : br->str_data) {
+            const DbVector<DbString> *vec = elem.second;
+            uint64_t seed = ++column << 32;
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t idx = sel == nullptr ? i : sel->col[i];
+                if (vec->isNull(idx)) {
+                    checksum_ += seed;
+                    continue;
+                }
+                const DbString& s = vec->col[idx];
+                uint64_t h = seed ^ s.len;
+                for (uint32_t j = 0; j < s.len; j += 8) {
+                    uint64_t w = 0;
+                    memcpy(&w, s.data() + j, std::min<uint32_t>(8, s.len - j));
+                    h = mix_(h ^ w);
+                }
+                checksum_ += mix_(h);
+            }
+        }
+    }
+};
+
+
+class CountSink : public ResultSink {
+private:
+    uint64_t count_;
+
+public:
+    CountSink() : count_(0) {}
+
+    uint64_t getCount() const {
+        return count_;
+    }
+
+    void consume(BatchResult *br) final {
+        count_ += br->res_sel == nullptr ? br->getn() : br->res_sel->n;
+    }
+};
+
+
+#endif //PROJECT_RESULT_SINK_H
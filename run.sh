@@ -1,7 +1,7 @@
 #!/bin/bash
 
+# CPUS is the taskset mask, one core unless set (e.g. CPUS=0xff for parallel runs)
 for i in {1..10}
 do
-    time taskset 0x1 $1
+    time taskset ${CPUS:-0x1} $1
 done
-
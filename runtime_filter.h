@@ -0,0 +1,192 @@
+#ifndef PROJECT_RUNTIME_FILTER_H
+#define PROJECT_RUNTIME_FILTER_H
+
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "hash.h"
+#include "bloom.h"
+
+
+/**
+ * Runtime filters (see RuntimeFilter in common.h): what an operator learned
+ * about the values it will keep, pushed into a scan so that the other rows
+ * are dropped right after they are produced instead of travelling through
+ * the plan (sideways information passing, Ives and Taylor, "Sideways
+ * Information Passing for Push-Style Query Processing", ICDE 2008).
+ *
+ *   MinMaxRuntimeFilter - the values in [min, max]
+ *   InSetRuntimeFilter - the values of a set of up to RUNTIME_FILTER_MAX_IN_SET
+ *   BloomRuntimeFilter - the values a blocked bloom filter (bloom.h) may hold
+ *
+ * The filters are immutable and may be shared by the scans of several
+ * threads. Each one is a branch-free loop over the rows: the range check
+ * and the set compares vectorize, the bloom probe is one load per row.
+ */
+
+
+#define RUNTIME_FILTER_MAX_IN_SET   16
+
+
+class MinMaxRuntimeFilter : public RuntimeFilter {
+private:
+    std::string col_name_;
+    int32_t min_;
+    int32_t max_;
+
+public:
+    MinMaxRuntimeFilter(std::string col_name, int32_t min, int32_t max) :
+        col_name_(std::move(col_name)), min_(min), max_(max) {
+        if (min > max)
+            throw std::invalid_argument("empty range");
+    }
+
+    const std::string& getColName() const final {
+        return col_name_;
+    }
+
+    uint32_t filter(uint32_t n, uint32_t *res_sel, const int32_t *col, const uint32_t *sel) const final {
+        // min <= x <= max as one unsigned compare
+        auto min = (uint32_t) min_;
+        uint32_t width = (uint32_t) max_ - min;
+        uint32_t res = 0;
+        if (sel != nullptr) {
+            for (uint32_t j = 0; j < n; j++) {
+                uint32_t i = sel[j];
+                res_sel[res] = i;
+                res += (uint32_t) col[i] - min <= width;
+            }
+        }
+        else {
+            for (uint32_t i = 0; i < n; i++) {
+                res_sel[res] = i;
+                res += (uint32_t) col[i] - min <= width;
+            }
+        }
+        return res;
+    }
+};
+
+
+/**
+ * The set is padded to RUNTIME_FILTER_MAX_IN_SET values by repeating one,
+ * so every row takes the same fixed number of compares.
+ */
+class InSetRuntimeFilter : public RuntimeFilter {
+private:
+    std::string col_name_;
+    int32_t values_[RUNTIME_FILTER_MAX_IN_SET];
+    bool empty_;
+
+    inline bool contains_(int32_t x) const {
+        bool match = false;
+        for (int32_t v : values_)
+            match |= x == v;
+        return match;
+    }
+
+public:
+    InSetRuntimeFilter(std::string col_name, const std::vector<int32_t>& values) :
+        col_name_(std::move(col_name)), values_(), empty_(values.empty()) {
+        if (values.size() > RUNTIME_FILTER_MAX_IN_SET)
+            throw std::invalid_argument("at most " + std::to_string(RUNTIME_FILTER_MAX_IN_SET) + " values in a set");
+        for (uint32_t v = 0; v < RUNTIME_FILTER_MAX_IN_SET; v++)
+            values_[v] = v < values.size() ? values[v] : (empty_ ? 0 : values[0]);
+    }
+
+    const std::string& getColName() const final {
+        return col_name_;
+    }
+
+    uint32_t filter(uint32_t n, uint32_t *res_sel, const int32_t *col, const uint32_t *sel) const final {
+        if (empty_)
+            return 0;
+
+        uint32_t res = 0;
+        if (sel != nullptr) {
+            for (uint32_t j = 0; j < n; j++) {
+                uint32_t i = sel[j];
+                res_sel[res] = i;
+                res += contains_(col[i]);
+            }
+        }
+        else {
+            for (uint32_t i = 0; i < n; i++) {
+                res_sel[res] = i;
+                res += contains_(col[i]);
+            }
+        }
+        return res;
+    }
+};
+
+
+class BloomRuntimeFilter : public RuntimeFilter {
+private:
+    std::string col_name_;
+    std::shared_ptr<const BlockedBloomFilter> bloom_;
+
+public:
+    BloomRuntimeFilter(std::string col_name, std::shared_ptr<const BlockedBloomFilter> bloom) :
+        col_name_(std::move(col_name)), bloom_(std::move(bloom)) {}
+
+    const std::string& getColName() const final {
+        return col_name_;
+    }
+
+    uint32_t filter(uint32_t n, uint32_t *res_sel, const int32_t *col, const uint32_t *sel) const final {
+        const BlockedBloomFilter& bloom = *bloom_;
+        uint32_t res = 0;
+        if (sel != nullptr) {
+            for (uint32_t j = 0; j < n; j++) {
+                uint32_t i = sel[j];
+                res_sel[res] = i;
+                res += bloom.contains(hashInt32(col[i]));
+            }
+        }
+        else {
+            for (uint32_t i = 0; i < n; i++) {
+                res_sel[res] = i;
+                res += bloom.contains(hashInt32(col[i]));
+            }
+        }
+        return res;
+    }
+};
+
+
+/**
+ * The filters a scan of col_name can take from the num_of_keys keys an
+ * operator will match, e.g. a join build side: the set of the keys if
+ * there are few distinct ones, their range and a bloom filter over them
+ * otherwise. The cheap range check comes first.
+ */
+inline std::vector<std::shared_ptr<const RuntimeFilter>> makeKeyFilters(const std::string& col_name, const int32_t *keys, uint64_t num_of_keys) {
+    std::vector<int32_t> distinct{};
+    for (uint64_t r = 0; r < num_of_keys && distinct.size() <= RUNTIME_FILTER_MAX_IN_SET; r++) {
+        if (std::find(distinct.begin(), distinct.end(), keys[r]) == distinct.end())
+            distinct.push_back(keys[r]);
+    }
+    if (distinct.size() <= RUNTIME_FILTER_MAX_IN_SET)
+        return {std::make_shared<InSetRuntimeFilter>(col_name, distinct)};
+
+    int32_t min = keys[0];
+    int32_t max = keys[0];
+    for (uint64_t r = 1; r < num_of_keys; r++) {
+        min = std::min(min, keys[r]);
+        max = std::max(max, keys[r]);
+    }
+    auto bloom = std::make_shared<BlockedBloomFilter>(num_of_keys);
+    for (uint64_t r = 0; r < num_of_keys; r++)
+        bloom->insert(hashInt32(keys[r]));
+    return {std::make_shared<MinMaxRuntimeFilter>(col_name, min, max),
+            std::make_shared<BloomRuntimeFilter>(col_name, bloom)};
+}
+
+
+#endif //PROJECT_RUNTIME_FILTER_H
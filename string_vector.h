@@ -0,0 +1,150 @@
+#ifndef PROJECT_STRING_VECTOR_H
+#define PROJECT_STRING_VECTOR_H
+
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <iostream>
+
+
+/**
+ * A 16-byte string header:
+ *
+ *   | len (4) | prefix (4) | inlined (8) or ptr (8) |
+ *
+ * Strings up to 12 bytes live entirely in the header (prefix followed by
+ * inlined). Longer strings keep their first 4 bytes in prefix and point to
+ * the full string in the StringHeap of the batch. Most comparisons are
+ * decided by the first 8 bytes (len + prefix) without touching the heap.
+ */
+struct DbString {
+    static const uint32_t INLINE_LEN = 12;
+
+    uint32_t len;
+    char prefix[4];
+    union {
+        char inlined[8];
+        const char *ptr;
+    };
+
+    const char* data() const {
+        return len <= INLINE_LEN ? prefix : ptr;
+    }
+
+    /**
+     * len and prefix as one word.
+     */
+    uint64_t head() const {
+        uint64_t w;
+        memcpy(&w, this, sizeof(w));
+        return w;
+    }
+
+    /**
+     * The second word: the inlined bytes or the pointer.
+     */
+    uint64_t tail() const {
+        uint64_t w;
+        memcpy(&w, reinterpret_cast<const char*>(this) + 8, sizeof(w));
+        return w;
+    }
+};
+
+static_assert(sizeof(DbString) == 16, "DbString must be 16 bytes");
+
+
+/**
+ * Arena for the bytes of the long strings of a batch. Freed all at once
+ * with the batch.
+ */
+class StringHeap {
+private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    std::vector<char*> chunks_;
+    std::vector<size_t> chunk_sizes_;
+    size_t used_;
+    size_t chunk_capacity_;
+
+public:
+    StringHeap() : chunks_(), chunk_sizes_(), used_(0), chunk_capacity_(0) {}
+
+    StringHeap(const StringHeap&) = delete;
+    StringHeap& operator=(const StringHeap&) = delete;
+
+    ~StringHeap() {
+        for (auto chunk : chunks_)
+            delete[] chunk;
+    }
+
+    const char* add(const char *s, uint32_t len) {
+        if (used_ + len > chunk_capacity_) {
+            chunk_capacity_ = len > CHUNK_SIZE ? len : CHUNK_SIZE;
+            chunks_.push_back(new char[chunk_capacity_]);
+            chunk_sizes_.push_back(chunk_capacity_);
+            used_ = 0;
+        }
+
+        char *dst = chunks_.back() + used_;
+        memcpy(dst, s, len);
+        used_ += len;
+        return dst;
+    }
+
+    uint32_t getNumOfChunks() const {
+        return (uint32_t) chunks_.size();
+    }
+
+    const char* getChunk(uint32_t i) const {
+        return chunks_[i];
+    }
+
+    size_t getChunkSize(uint32_t i) const {
+        return chunk_sizes_[i];
+    }
+
+    /**
+     * The chunk holding p and the offset of p in it; false if p is not in
+     * this heap. The search starts at *chunk, so consecutive strings of one
+     * chunk are found right away.
+     */
+    bool find(const char *p, uint32_t *chunk, uint32_t *offset) const {
+        auto num_of_chunks = (uint32_t) chunks_.size();
+        for (uint32_t k = 0; k < num_of_chunks; k++) {
+            uint32_t c = (*chunk + k) % num_of_chunks;
+            if (p >= chunks_[c] && p < chunks_[c] + chunk_sizes_[c]) {
+                *chunk = c;
+                *offset = (uint32_t) (p - chunks_[c]);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+
+/**
+ * Build the header of s. Long strings are copied into heap.
+ */
+inline DbString makeDbString(const char *s, uint32_t len, StringHeap *heap) {
+    DbString res;
+    memset(&res, 0, sizeof(res));
+    res.len = len;
+    if (len <= DbString::INLINE_LEN) {
+        memcpy(res.prefix, s, len);
+    }
+    else {
+        memcpy(res.prefix, s, sizeof(res.prefix));
+        res.ptr = heap->add(s, len);
+    }
+    return res;
+}
+
+
+inline std::ostream& operator<<(std::ostream& os, const DbString& s) {
+    return os.write(s.data(), s.len);
+}
+
+
+#endif //PROJECT_STRING_VECTOR_H
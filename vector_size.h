@@ -0,0 +1,306 @@
+#ifndef PROJECT_VECTOR_SIZE_H
+#define PROJECT_VECTOR_SIZE_H
+
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+
+/**
+ * Picking the vector (batch) size of a plan.
+ *
+ * A vectorized plan keeps a handful of vectors alive at the same time: the
+ * scanned columns, the selection vector and the intermediates produced by the
+ * primitives. The batch size should be as large as possible to amortize the
+ * per-call overhead of the primitives, but small enough that all of those live
+ * vectors stay in the cache. The best value depends on the plan and on the
+ * machine, so instead of a fixed 1K we
+ *   1. read the L1d/L2 sizes (sysfs first, cpuid as a fallback)
+ *   2. derive the candidate sizes whose live intermediates fit in L2
+ *   3. run the plan on a sample with every candidate and keep the fastest one
+ */
+
+
+struct CacheInfo {
+    uint32_t l1d;
+    uint32_t l2;
+};
+
+
+/**
+ * Parse a sysfs cache size such as "48K" or "2M".
+ */
+inline uint32_t parseCacheSize_(const std::string& s) {
+    char *end = nullptr;
+    unsigned long v = strtoul(s.c_str(), &end, 10);
+    if (end != nullptr) {
+        if (*end == 'K')
+            v *= 1024;
+        else if (*end == 'M')
+            v *= 1024 * 1024;
+    }
+    return (uint32_t) v;
+}
+
+
+inline std::string readSysfsLine_(const std::string& path) {
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+        return "";
+
+    char buf[64];
+    std::string line;
+    if (fgets(buf, sizeof(buf), f) != nullptr) {
+        line = buf;
+        while (!line.empty() && (line.back() == '\n' || line.back() == ' '))
+            line.pop_back();
+    }
+    fclose(f);
+    return line;
+}
+
+
+inline bool detectCacheInfoSysfs_(CacheInfo *info) {
+    bool found = false;
+    for (int idx = 0; idx < 16; idx++) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(idx) + "/";
+        std::string level = readSysfsLine_(dir + "level");
+        if (level.empty())
+            break;
+
+        std::string type = readSysfsLine_(dir + "type");
+        uint32_t size = parseCacheSize_(readSysfsLine_(dir + "size"));
+        if (level == "1" && type == "Data") {
+            info->l1d = size;
+            found = true;
+        }
+        else if (level == "2" && (type == "Unified" || type == "Data")) {
+            info->l2 = size;
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+inline bool detectCacheInfoCpuid_(CacheInfo *info) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    bool found = false;
+
+    // Intel: deterministic cache parameters
+    if (__get_cpuid_count(4, 0, &eax, &ebx, &ecx, &edx) && (eax & 0x1f) != 0) {
+        for (unsigned int sub = 0; __get_cpuid_count(4, sub, &eax, &ebx, &ecx, &edx); sub++) {
+            unsigned int type = eax & 0x1f;
+            if (type == 0)
+                break;
+
+            unsigned int level = (eax >> 5) & 0x7;
+            uint32_t size = (((ebx >> 22) & 0x3ff) + 1) *
+                            (((ebx >> 12) & 0x3ff) + 1) *
+                            ((ebx & 0xfff) + 1) *
+                            (ecx + 1);
+            if (level == 1 && type == 1) {
+                info->l1d = size;
+                found = true;
+            }
+            else if (level == 2 && (type == 1 || type == 3)) {
+                info->l2 = size;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // AMD: extended cache leaves
+    if (__get_cpuid(0x80000005, &eax, &ebx, &ecx, &edx)) {
+        info->l1d = (ecx >> 24) * 1024;
+        found = true;
+    }
+    if (__get_cpuid(0x80000006, &eax, &ebx, &ecx, &edx)) {
+        info->l2 = (ecx >> 16) * 1024;
+        found = true;
+    }
+    return found;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * Return the L1d and L2 size of the current machine. Falls back to
+ * 32K/256K when neither sysfs nor cpuid reports anything.
+ */
+inline CacheInfo detectCacheInfo() {
+    CacheInfo info{32 * 1024, 256 * 1024};
+    if (!detectCacheInfoSysfs_(&info))
+        detectCacheInfoCpuid_(&info);
+    return info;
+}
+
+
+/**
+ * A count given on a command line: a decimal number in [1, max]; 0 if arg
+ * is anything else.
+ */
+inline uint32_t parseCount(const char *arg, uint32_t max) {
+    if (arg[0] < '0' || arg[0] > '9')
+        return 0;
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long v = strtoull(arg, &end, 10);
+    if (*end != '\0' || errno != 0 || v > max)
+        return 0;
+    return (uint32_t) v;
+}
+
+
+/**
+ * The vector size given on a command line: a decimal number in
+ * [1, UINT32_MAX]; 0 if arg is anything else.
+ */
+inline uint32_t parseVectorSize(const char *arg) {
+    return parseCount(arg, UINT32_MAX);
+}
+
+
+class VectorSizeTuner {
+private:
+    CacheInfo cache_;
+    uint32_t live_vectors_;
+    uint32_t bytes_per_value_;
+    uint64_t sample_rows_;
+    uint32_t repeats_;
+
+public:
+    /**
+     * live_vectors is the number of vectors the plan keeps alive at the same
+     * time (scanned columns + selection vectors + intermediates).
+     */
+    VectorSizeTuner(CacheInfo cache,
+                    uint32_t live_vectors,
+                    uint32_t bytes_per_value = sizeof(int32_t),
+                    uint64_t sample_rows = 1u << 20,
+                    uint32_t repeats = 3) :
+            cache_(cache),
+            live_vectors_(live_vectors),
+            bytes_per_value_(bytes_per_value),
+            sample_rows_(sample_rows),
+            repeats_(repeats)
+    {}
+
+    /**
+     * Power-of-two sizes from 64 up to the largest one whose live vectors
+     * still fit in L2.
+     */
+    std::vector<uint32_t> candidates() const {
+        std::vector<uint32_t> res{};
+        uint64_t per_value = (uint64_t) live_vectors_ * bytes_per_value_;
+        for (uint32_t n = 64; n <= (1u << 20); n <<= 1) {
+            if (n * per_value > cache_.l2 && !res.empty())
+                break;
+            res.push_back(n);
+        }
+        return res;
+    }
+
+    /**
+     * Largest size whose live vectors fit in L1d. It is the answer when we
+     * are not allowed to benchmark.
+     */
+    uint32_t l1Resident() const {
+        uint32_t best = 64;
+        uint64_t per_value = (uint64_t) live_vectors_ * bytes_per_value_;
+        for (uint32_t n = 64; n <= (1u << 20); n <<= 1) {
+            if (n * per_value > cache_.l1d)
+                break;
+            best = n;
+        }
+        return best;
+    }
+
+    /**
+     * run(vector_size, num_of_batches) must build the plan with the given
+     * vector size, execute it and release it. Every candidate processes the
+     * same number of rows; the fastest of repeats_ runs is compared.
+     */
+    uint32_t tune(const std::function<void(uint32_t, uint32_t)>& run, bool verbose = false) const {
+        uint32_t best = l1Resident();
+        double best_ms = -1;
+
+        for (auto n : candidates()) {
+            auto num_of_batches = (uint32_t) ((sample_rows_ + n - 1) / n);
+            double ms = -1;
+            for (uint32_t r = 0; r < repeats_; r++) {
+                auto start = std::chrono::steady_clock::now();
+                run(n, num_of_batches);
+                auto end = std::chrono::steady_clock::now();
+                double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
+                if (ms < 0 || elapsed < ms)
+                    ms = elapsed;
+            }
+
+            if (verbose)
+                std::cout << "vector size " << n << ": " << ms << "ms\n";
+
+            if (best_ms < 0 || ms < best_ms) {
+                best_ms = ms;
+                best = n;
+            }
+        }
+
+        return best;
+    }
+};
+
+
+/**
+ * The vector size the first command line argument of a benchmark asks for,
+ * default_size without one: auto tunes it with run (see
+ * VectorSizeTuner::tune) for a plan keeping live_vectors vectors alive,
+ * column makes the num_of_rows rows a single batch, anything else must be
+ * a vector size. Prints why and the usage and returns 0 for a bad argument.
+ */
+inline uint32_t parseVectorSizeArg(int argc, char **argv, uint64_t num_of_rows, uint32_t default_size,
+                                   const char *usage, uint32_t live_vectors,
+                                   const std::function<void(uint32_t, uint32_t)>& run) {
+    if (argc <= 1)
+        return default_size;
+
+    if (strcmp(argv[1], "auto") == 0) {
+        VectorSizeTuner tuner(detectCacheInfo(), live_vectors);
+        uint32_t vector_size = tuner.tune(run, true);
+        std::cout << "vector size: " << vector_size << "\n";
+        return vector_size;
+    }
+
+    if (strcmp(argv[1], "column") == 0) {
+        // the whole table must fit one batch
+        if (num_of_rows == 0 || num_of_rows > UINT32_MAX) {
+            std::cout << "column needs 1 to " << UINT32_MAX << " rows\n" << usage << "\n";
+            return 0;
+        }
+        return (uint32_t) num_of_rows;
+    }
+
+    uint32_t vector_size = parseVectorSize(argv[1]);
+    if (vector_size == 0)
+        std::cout << "Invalid vector size " << argv[1] << "\n" << usage << "\n";
+    return vector_size;
+}
+
+
+#endif //PROJECT_VECTOR_SIZE_H